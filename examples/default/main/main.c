@@ -181,6 +181,15 @@ static esp_err_t on_settings_changed(const settings_group_t *settings, void *arg
     return ESP_OK;
 }
 
+#ifdef CONFIG_SETTINGS_NOTIFY_SUPPORT
+/* called from the settings notification task with changed network settings only */
+static void on_network_changed(const settings_change_t *changes, size_t count, void *arg)
+{
+    for (size_t i = 0; i < count; i++)
+        ESP_LOGI(TAG, "-> %s/%s changed", changes[i].group->id, changes[i].setting->id);
+}
+#endif
+
 void app_main(void)
 {
     /* Initialize NVS */
@@ -194,6 +203,9 @@ void app_main(void)
     settings_nvs_read(app_settings);
     settings_pack_print(app_settings);
     settings_handler_register(on_settings_changed, NULL);
+#ifdef CONFIG_SETTINGS_NOTIFY_SUPPORT
+    settings_subscribe(&(settings_filter_t){ .group_id = GROUP_NETWORK_ID }, on_network_changed, NULL);
+#endif
 
     ESP_LOGI(TAG, "Starting webserver + WiFi (APSTA)");
     ESP_ERROR_CHECK(webserver_init(app_settings));
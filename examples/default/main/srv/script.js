@@ -123,7 +123,13 @@ function getSettingsForm(){
 						html+=`<span class="label-inline">Netmask</span><input type="text" name="${gr.id}:${item.id}:netmask" value="${item.netmask}" inputmode="decimal" pattern="^(?:[0-9]{1,3}\\.){3}[0-9]{1,3}$" placeholder="255.255.255.0" style="width:250px"><br>`;
 						html+=`<span class="label-inline">Gateway</span><input type="text" name="${gr.id}:${item.id}:gateway" value="${item.gateway}" inputmode="decimal" pattern="^(?:[0-9]{1,3}\\.){3}[0-9]{1,3}$" placeholder="192.168.1.1" style="width:250px"><br></div>`;
 						break;
+					case "ARRAY":
+						html+=`<span class="label-inline">${item.label}</span><input type="text" name="${gr.id}:${item.id}" value="${item.val.join(',')}" style="width:250px"><br>`;
+						break;
 					default:
+						/* application defined types are edited as text */
+						if (item.type)
+							html+=`<span class="label-inline">${item.label}</span><input type="text" name="${gr.id}:${item.id}" value="${item.val}" style="width:250px"><br>`;
 						break;
 				}
 			});
@@ -136,10 +142,11 @@ function getSettingsForm(){
 
 		div.innerHTML = html;
 		setupNetifDhcpToggles();
+		watchSettings();
 		const form = document.getElementById('brd-form');
 		form.onsubmit = function(e){
 			e.preventDefault();
-			let data = decodeURIComponent(new URLSearchParams(new FormData(this)));
+			let data = new URLSearchParams(new FormData(this)).toString();
 			fetch(esp_url+"/settings?action=set",
 			{
 				method: "POST",
@@ -151,4 +158,42 @@ function getSettingsForm(){
 	})
 }
 
+function setInput(name, update) {
+	const input = document.querySelector(`[name="${name}"]`);
+	if (input && input !== document.activeElement)
+		update(input);
+}
+
+function applySettings(data) {
+	data.groups.forEach((gr) => {
+		gr.settings.forEach((item) => {
+			const name = `${gr.id}:${item.id}`;
+			const hhmm = String(item.hh).padStart(2,'0')+":"+String(item.mm).padStart(2,'0');
+			const date = String(item.year).padStart(4,'0')+"-"+String(item.month).padStart(2,'0')+"-"+String(item.day).padStart(2,'0');
 
+			if ("dhcp" in item) {
+				setInput(name+":dhcp", (el) => { el.checked = item.dhcp; el.dispatchEvent(new Event("change")); });
+				["ip", "netmask", "gateway"].forEach((f) => setInput(`${name}:${f}`, (el) => { el.value = item[f]; }));
+			} else if ("year" in item && "hh" in item) {
+				setInput(name, (el) => { el.value = date+"T"+hhmm; });
+			} else if ("year" in item) {
+				setInput(name, (el) => { el.value = date; });
+			} else if ("hh" in item) {
+				setInput(name, (el) => { el.value = hhmm; });
+			} else if (typeof item.val === "boolean") {
+				setInput(name, (el) => { el.checked = item.val; });
+			} else {
+				setInput(name, (el) => { el.value = item.val; });
+			}
+		});
+	});
+}
+
+/* live updates pushed by the board instead of reloading the form */
+function watchSettings() {
+	const url = (esp_url || location.origin).replace(/^http/, "ws") + "/settings/ws";
+	const ws = new WebSocket(url);
+
+	ws.onmessage = (e) => applySettings(JSON.parse(e.data).data);
+	ws.onclose = () => setTimeout(watchSettings, 5000);
+}
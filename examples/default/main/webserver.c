@@ -61,6 +61,21 @@ static httpd_uri_t settings_post_handler = { .uri = "/settings",
                                              .method = HTTP_POST,
                                              .handler = settings_httpd_handler };
 
+static httpd_uri_t settings_schema_handler = { .uri = "/settings/schema",
+                                               .method = HTTP_GET,
+                                               .handler = settings_schema_httpd_handler };
+
+static httpd_uri_t settings_values_handler = { .uri = "/settings/values",
+                                               .method = HTTP_GET,
+                                               .handler = settings_values_httpd_handler };
+
+#ifdef CONFIG_SETTINGS_WS_PUSH
+static httpd_uri_t settings_ws_handler = { .uri = "/settings/ws",
+                                           .method = HTTP_GET,
+                                           .handler = settings_ws_httpd_handler,
+                                           .is_websocket = true };
+#endif
+
 static void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
 {
     if (event_base == WIFI_EVENT) {
@@ -155,9 +170,19 @@ esp_err_t webserver_init(const settings_group_t device_settings[])
     /* register CGI-like handlers for settings */
     settings_get_handler.user_ctx = (void *)device_settings;
     settings_post_handler.user_ctx = (void *)device_settings;
+    settings_schema_handler.user_ctx = (void *)device_settings;
+    settings_values_handler.user_ctx = (void *)device_settings;
+#ifdef CONFIG_SETTINGS_WS_PUSH
+    settings_ws_handler.user_ctx = (void *)device_settings;
+#endif
 
     ESP_ERROR_CHECK(httpd_register_uri_handler(server, &settings_get_handler));
     ESP_ERROR_CHECK(httpd_register_uri_handler(server, &settings_post_handler));
+    ESP_ERROR_CHECK(httpd_register_uri_handler(server, &settings_schema_handler));
+    ESP_ERROR_CHECK(httpd_register_uri_handler(server, &settings_values_handler));
+#ifdef CONFIG_SETTINGS_WS_PUSH
+    ESP_ERROR_CHECK(httpd_register_uri_handler(server, &settings_ws_handler));
+#endif
 
     ESP_LOGI(TAG, "server started on port %d, free mem: %" PRIu32 " bytes", config.server_port,
              esp_get_free_heap_size());
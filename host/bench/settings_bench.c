@@ -0,0 +1,1038 @@
+/*
+ * Copyright (c) 2025 <qb4.dev@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/*
+ * Host benchmarks of the settings component on a synthetic settings pack.
+ *
+ * usage: settings_bench [-g groups] [-s settings per group] [-t text length] [-n iterations] [-c]
+ *
+ * Every benchmark reports time per operation, heap allocations per operation,
+ * peak heap use above the level before the run, NVS entry reads and writes
+ * per operation and, for HTTP benchmarks, the response size in bytes. Heap
+ * figures need the malloc wrappers linked in (Linux, see CMakeLists.txt). -t
+ * sets the buffer length of text settings, stored values fill it. -c prints
+ * CSV.
+ */
+#include <stdio.h>
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <esp_log.h>
+#include <nvs_flash.h>
+
+#include "settings.h"
+
+#define BENCH_TEXT_LEN  32
+#define BENCH_ARRAY_LEN 256
+
+typedef struct {
+    const char *name;
+    void (*run)(int iteration);
+    void (*setup)(void);
+    void (*teardown)(void);
+    setting_t **needs; /* skipped when the pack has no such setting */
+} bench_t;
+
+typedef struct {
+    uint64_t allocs;
+    int64_t  current;
+    int64_t  peak;
+} bench_heap_t;
+
+static bench_heap_t      heap;
+static settings_group_t *pack;
+static settings_group_t *linear_pack; /* the groups of `pack`, never indexed */
+static int               pack_groups;
+static int               pack_per_group;
+static setting_t        *first_num;
+static setting_t        *first_text;
+static setting_t        *first_netif;
+static size_t            text_len = BENCH_TEXT_LEN;
+static char             *text_def;
+static char             *text_buf;
+static char             *text_alt;
+static settings_group_t *text_pack;
+static char             *form_body;
+static char             *json_body;
+static size_t            resp_bytes;
+static bool              writer_stop;
+static pthread_t         writer_thread;
+static volatile int      sink;
+#ifdef CONFIG_SETTINGS_NOTIFY_SUPPORT
+static int notify_published;
+static int notify_delivered;
+#endif
+#ifdef CONFIG_SETTINGS_CBOR_SUPPORT
+static uint8_t *cbor_body;
+static size_t   cbor_body_len;
+#endif
+#ifdef CONFIG_SETTINGS_WS_PUSH
+static char            ws_msg[256];
+static httpd_host_ws_t ws_client = { .fd = 1, .msg_buf = ws_msg, .msg_size = sizeof(ws_msg) };
+#endif
+#ifdef CONFIG_SETTINGS_ARRAY_SUPPORT
+static settings_group_t *array_pack;
+static char              array_body[2][BENCH_ARRAY_LEN * 8 + 32];
+static char              array_range_body[2][128];
+#endif
+
+static const char *bench_options[] = { "off", "low", "high", NULL };
+
+#ifdef BENCH_HEAP_TRACE
+#include <malloc.h>
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void  __real_free(void *ptr);
+
+/* settings tasks allocate too - peak is approximate while they run */
+static void bench_heap_add(void *ptr)
+{
+    int64_t current;
+
+    if (!ptr)
+        return;
+    __atomic_add_fetch(&heap.allocs, 1, __ATOMIC_RELAXED);
+    current = __atomic_add_fetch(&heap.current, malloc_usable_size(ptr), __ATOMIC_RELAXED);
+    if (current > __atomic_load_n(&heap.peak, __ATOMIC_RELAXED))
+        __atomic_store_n(&heap.peak, current, __ATOMIC_RELAXED);
+}
+
+void *__wrap_malloc(size_t size)
+{
+    void *ptr = __real_malloc(size);
+
+    bench_heap_add(ptr);
+    return ptr;
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+    void *ptr = __real_calloc(nmemb, size);
+
+    bench_heap_add(ptr);
+    return ptr;
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    if (ptr)
+        __atomic_sub_fetch(&heap.current, malloc_usable_size(ptr), __ATOMIC_RELAXED);
+    ptr = __real_realloc(ptr, size);
+    bench_heap_add(ptr);
+    return ptr;
+}
+
+void __wrap_free(void *ptr)
+{
+    if (ptr)
+        __atomic_sub_fetch(&heap.current, malloc_usable_size(ptr), __ATOMIC_RELAXED);
+    __real_free(ptr);
+}
+#endif
+
+static uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static void bench_text_init(setting_t *setting)
+{
+    setting->type = SETTING_TYPE_TEXT;
+#ifdef CONFIG_SETTINGS_LAZY_TEXT
+    setting->text.lazy = true;
+#else
+    setting->text.val = calloc(1, text_len);
+#endif
+    setting->text.def = text_def;
+    setting->text.len = text_len;
+}
+
+/* synthetic pack: every group holds a mix of the supported setting types */
+static void bench_setting_init(setting_t *setting, int index)
+{
+    static const setting_type_t types[] = {
+        SETTING_TYPE_BOOL,
+        SETTING_TYPE_NUM,
+        SETTING_TYPE_ONEOF,
+        SETTING_TYPE_TEXT,
+#ifdef CONFIG_SETTINGS_DATETIME_SUPPORT
+        SETTING_TYPE_TIME,
+#endif
+#ifdef CONFIG_SETTINGS_COLOR_SUPPORT
+        SETTING_TYPE_COLOR,
+#endif
+#ifdef CONFIG_SETTINGS_NET_SUPPORT
+        SETTING_TYPE_IPADDR,
+        SETTING_TYPE_NETIF,
+#endif
+    };
+    char *id = malloc(16);
+
+    snprintf(id, 16, "S%03d", index);
+    setting->id = id;
+    setting->label = id;
+    setting->type = types[index % (sizeof(types) / sizeof(types[0]))];
+
+    switch (setting->type) {
+    case SETTING_TYPE_BOOL:
+        setting->boolean.def = true;
+        break;
+    case SETTING_TYPE_NUM:
+        setting->num.def = index;
+        setting->num.range[0] = 0;
+        setting->num.range[1] = 100000;
+        break;
+    case SETTING_TYPE_ONEOF:
+        setting->oneof.options = bench_options;
+        break;
+    case SETTING_TYPE_TEXT:
+        bench_text_init(setting);
+        break;
+#ifdef CONFIG_SETTINGS_DATETIME_SUPPORT
+    case SETTING_TYPE_TIME:
+        setting->time.hh = 12;
+        break;
+#endif
+#ifdef CONFIG_SETTINGS_COLOR_SUPPORT
+    case SETTING_TYPE_COLOR:
+        setting->color.def.combined = 0x00FF8000;
+        break;
+#endif
+#ifdef CONFIG_SETTINGS_NET_SUPPORT
+    case SETTING_TYPE_IPADDR:
+        setting->ipaddr.def.addr = 0x0101A8C0;
+        break;
+    case SETTING_TYPE_NETIF:
+        setting->netif.def.dhcp = true;
+        break;
+#endif
+    default:
+        break;
+    }
+}
+
+static settings_group_t *bench_pack_create(int groups, int per_group)
+{
+    settings_group_t *gr = calloc(groups + 1, sizeof(settings_group_t));
+
+    for (int g = 0; g < groups; g++) {
+        char *id = malloc(16);
+
+        snprintf(id, 16, "G%03d", g);
+        gr[g].id = id;
+        gr[g].label = id;
+        gr[g].settings = calloc(per_group + 1, sizeof(setting_t));
+        for (int s = 0; s < per_group; s++)
+            bench_setting_init(&gr[g].settings[s], s);
+    }
+    return gr;
+}
+
+/* single group of text settings only */
+static settings_group_t *bench_text_pack_create(int count)
+{
+    settings_group_t *gr = calloc(2, sizeof(settings_group_t));
+
+    gr->id = "T000";
+    gr->label = "Texts";
+    gr->settings = calloc(count + 1, sizeof(setting_t));
+    for (int s = 0; s < count; s++) {
+        char *id = malloc(16);
+
+        snprintf(id, 16, "S%03d", s);
+        gr->settings[s].id = id;
+        gr->settings[s].label = id;
+        bench_text_init(&gr->settings[s]);
+    }
+    return gr;
+}
+
+#ifdef CONFIG_SETTINGS_ARRAY_SUPPORT
+/* single calibration table of int16 elements, two full and two ranged update bodies */
+static settings_group_t *bench_array_pack_create(void)
+{
+    settings_group_t *gr = calloc(2, sizeof(settings_group_t));
+
+    gr->id = "A000";
+    gr->label = "Arrays";
+    gr->settings = calloc(2, sizeof(setting_t));
+    gr->settings->id = "S000";
+    gr->settings->label = "S000";
+    gr->settings->type = SETTING_TYPE_ARRAY;
+    gr->settings->array.val = calloc(BENCH_ARRAY_LEN, sizeof(int16_t));
+    gr->settings->array.len = BENCH_ARRAY_LEN;
+    gr->settings->array.elem = SETTING_ARRAY_INT16;
+
+    for (int b = 0; b < 2; b++) {
+        int len = snprintf(array_body[b], sizeof(array_body[b]), "{\"A000\":{\"S000\":[");
+
+        for (int i = 0; i < BENCH_ARRAY_LEN; i++)
+            len += snprintf(array_body[b] + len, sizeof(array_body[b]) - len, i ? ",%d" : "%d", i * 100 - 12800 + b);
+        snprintf(array_body[b] + len, sizeof(array_body[b]) - len, "]}}");
+        snprintf(array_range_body[b], sizeof(array_range_body[b]),
+                 "{\"A000\":{\"S000\":{\"offset\":100,\"val\":[%d,2,3,4,5,6,7,8]}}}", b);
+    }
+    return gr;
+}
+#endif
+
+/* form body setting every value of the pack, as sent by the web page */
+static char *bench_form_create(const settings_group_t *settings_pack)
+{
+    size_t len = 1;
+    char  *body;
+    char  *pos;
+
+    for (const settings_group_t *gr = settings_pack; gr->id; gr++) {
+        for (setting_t *setting = gr->settings; setting->id; setting++)
+            len += 128;
+    }
+    body = calloc(1, len);
+    pos = body;
+
+    for (const settings_group_t *gr = settings_pack; gr->id; gr++) {
+        for (setting_t *setting = gr->settings; setting->id; setting++) {
+            const char *sep = pos == body ? "" : "&";
+            const char *key_gr = gr->id;
+            const char *key_id = setting->id;
+
+            switch (setting->type) {
+            case SETTING_TYPE_BOOL:
+                pos += sprintf(pos, "%s%s:%s=on", sep, key_gr, key_id);
+                break;
+            case SETTING_TYPE_NUM:
+                pos += sprintf(pos, "%s%s:%s=42", sep, key_gr, key_id);
+                break;
+            case SETTING_TYPE_ONEOF:
+                pos += sprintf(pos, "%s%s:%s=2", sep, key_gr, key_id);
+                break;
+            case SETTING_TYPE_TEXT:
+                pos += sprintf(pos, "%s%s:%s=form+text+%%2F+value", sep, key_gr, key_id);
+                break;
+#ifdef CONFIG_SETTINGS_DATETIME_SUPPORT
+            case SETTING_TYPE_TIME:
+                pos += sprintf(pos, "%s%s:%s=07%%3A30", sep, key_gr, key_id);
+                break;
+#endif
+#ifdef CONFIG_SETTINGS_COLOR_SUPPORT
+            case SETTING_TYPE_COLOR:
+                pos += sprintf(pos, "%s%s:%s=%%23102030", sep, key_gr, key_id);
+                break;
+#endif
+#ifdef CONFIG_SETTINGS_NET_SUPPORT
+            case SETTING_TYPE_IPADDR:
+                pos += sprintf(pos, "%s%s:%s=10.0.0.1", sep, key_gr, key_id);
+                break;
+            case SETTING_TYPE_NETIF:
+                pos += sprintf(pos, "%s%s:%s:ip=10.0.0.2&%s:%s:netmask=255.0.0.0&%s:%s:gateway=10.0.0.1", sep,
+                               key_gr, key_id, key_gr, key_id, key_gr, key_id);
+                break;
+#endif
+            default:
+                break;
+            }
+        }
+    }
+    return body;
+}
+
+/* JSON update with the same changes as the form body */
+static char *bench_json_create(const settings_group_t *settings_pack)
+{
+    size_t len = 16;
+    char  *body;
+    char  *pos;
+
+    for (const settings_group_t *gr = settings_pack; gr->id; gr++) {
+        len += 16;
+        for (setting_t *setting = gr->settings; setting->id; setting++)
+            len += 128;
+    }
+    body = calloc(1, len);
+    pos = body + sprintf(body, "{");
+
+    for (const settings_group_t *gr = settings_pack; gr->id; gr++) {
+        pos += sprintf(pos, "%s\"%s\":{", gr == settings_pack ? "" : ",", gr->id);
+        for (setting_t *setting = gr->settings; setting->id; setting++) {
+            const char *sep = setting == gr->settings ? "" : ",";
+
+            switch (setting->type) {
+            case SETTING_TYPE_BOOL:
+                pos += sprintf(pos, "%s\"%s\":true", sep, setting->id);
+                break;
+            case SETTING_TYPE_NUM:
+                pos += sprintf(pos, "%s\"%s\":42", sep, setting->id);
+                break;
+            case SETTING_TYPE_ONEOF:
+                pos += sprintf(pos, "%s\"%s\":2", sep, setting->id);
+                break;
+            case SETTING_TYPE_TEXT:
+                pos += sprintf(pos, "%s\"%s\":\"form text \\/ value\"", sep, setting->id);
+                break;
+#ifdef CONFIG_SETTINGS_DATETIME_SUPPORT
+            case SETTING_TYPE_TIME:
+                pos += sprintf(pos, "%s\"%s\":{\"hh\":7,\"mm\":30}", sep, setting->id);
+                break;
+#endif
+#ifdef CONFIG_SETTINGS_COLOR_SUPPORT
+            case SETTING_TYPE_COLOR:
+                pos += sprintf(pos, "%s\"%s\":\"#102030\"", sep, setting->id);
+                break;
+#endif
+#ifdef CONFIG_SETTINGS_NET_SUPPORT
+            case SETTING_TYPE_IPADDR:
+                pos += sprintf(pos, "%s\"%s\":\"10.0.0.1\"", sep, setting->id);
+                break;
+            case SETTING_TYPE_NETIF:
+                pos += sprintf(pos, "%s\"%s\":{\"ip\":\"10.0.0.2\",\"netmask\":\"255.0.0.0\",\"gateway\":\"10.0.0.1\"}",
+                               sep, setting->id);
+                break;
+#endif
+            default:
+                pos += sprintf(pos, "%s\"%s\":null", sep, setting->id);
+                break;
+            }
+        }
+        pos += sprintf(pos, "}");
+    }
+    sprintf(pos, "}");
+    return body;
+}
+
+#ifdef CONFIG_SETTINGS_CBOR_SUPPORT
+static uint8_t *bench_cbor_head(uint8_t *pos, uint8_t major, uint32_t val)
+{
+    if (val < 24) {
+        *pos++ = major << 5 | val;
+    } else if (val <= 0xff) {
+        *pos++ = major << 5 | 24;
+        *pos++ = val;
+    } else if (val <= 0xffff) {
+        *pos++ = major << 5 | 25;
+        *pos++ = val >> 8;
+        *pos++ = val;
+    } else {
+        *pos++ = major << 5 | 26;
+        for (int shift = 24; shift >= 0; shift -= 8)
+            *pos++ = val >> shift;
+    }
+    return pos;
+}
+
+static uint8_t *bench_cbor_text(uint8_t *pos, const char *text)
+{
+    size_t len = strlen(text);
+
+    pos = bench_cbor_head(pos, 3, len);
+    memcpy(pos, text, len);
+    return pos + len;
+}
+
+/* CBOR update with the same changes as the form body */
+static uint8_t *bench_cbor_create(const settings_group_t *settings_pack, size_t *len)
+{
+    size_t   size = 16;
+    uint8_t *body;
+    uint8_t *pos;
+    int      groups = 0;
+
+    for (const settings_group_t *gr = settings_pack; gr->id; gr++, groups++) {
+        for (setting_t *setting = gr->settings; setting->id; setting++)
+            size += 96;
+    }
+    body = calloc(1, size);
+    pos = bench_cbor_head(body, 5, groups);
+
+    for (const settings_group_t *gr = settings_pack; gr->id; gr++) {
+        int count = 0;
+
+        for (setting_t *setting = gr->settings; setting->id; setting++)
+            count++;
+        pos = bench_cbor_text(pos, gr->id);
+        pos = bench_cbor_head(pos, 5, count);
+        for (setting_t *setting = gr->settings; setting->id; setting++) {
+            pos = bench_cbor_text(pos, setting->id);
+            switch (setting->type) {
+            case SETTING_TYPE_BOOL:
+                *pos++ = 0xf5;
+                break;
+            case SETTING_TYPE_NUM:
+                pos = bench_cbor_head(pos, 0, 42);
+                break;
+            case SETTING_TYPE_ONEOF:
+                pos = bench_cbor_head(pos, 0, 2);
+                break;
+            case SETTING_TYPE_TEXT:
+                pos = bench_cbor_text(pos, "form text / value");
+                break;
+#ifdef CONFIG_SETTINGS_DATETIME_SUPPORT
+            case SETTING_TYPE_TIME:
+                pos = bench_cbor_head(pos, 5, 2);
+                pos = bench_cbor_text(pos, "hh");
+                pos = bench_cbor_head(pos, 0, 7);
+                pos = bench_cbor_text(pos, "mm");
+                pos = bench_cbor_head(pos, 0, 30);
+                break;
+#endif
+#ifdef CONFIG_SETTINGS_COLOR_SUPPORT
+            case SETTING_TYPE_COLOR:
+                pos = bench_cbor_head(pos, 0, 0x102030);
+                break;
+#endif
+#ifdef CONFIG_SETTINGS_NET_SUPPORT
+            case SETTING_TYPE_IPADDR:
+                pos = bench_cbor_head(pos, 0, 0x0a000001);
+                break;
+            case SETTING_TYPE_NETIF:
+                pos = bench_cbor_head(pos, 5, 3);
+                pos = bench_cbor_text(pos, "ip");
+                pos = bench_cbor_head(pos, 0, 0x0a000002);
+                pos = bench_cbor_text(pos, "netmask");
+                pos = bench_cbor_head(pos, 0, 0xff000000);
+                pos = bench_cbor_text(pos, "gateway");
+                pos = bench_cbor_head(pos, 0, 0x0a000001);
+                break;
+#endif
+            default:
+                *pos++ = 0xf6; /* null, skipped */
+                break;
+            }
+        }
+    }
+    *len = pos - body;
+    return body;
+}
+#endif
+
+static void bench_nvs_read(int iteration)
+{
+    settings_nvs_read(pack);
+}
+
+static void bench_nvs_read_text(int iteration)
+{
+    settings_nvs_read(text_pack);
+}
+
+/* make the main pack the one loaded again */
+static void bench_pack_reload(void)
+{
+    settings_nvs_read(pack);
+}
+
+/* device where only one setting per group was ever changed from its default */
+static void bench_nvs_sparse_start(void)
+{
+    nvs_flash_erase();
+    for (const settings_group_t *gr = pack; gr->id; gr++)
+        setting_nvs_write_single(&gr->settings[1]);
+}
+
+static void bench_nvs_sparse_stop(void)
+{
+    settings_pack_mark_dirty(pack);
+    settings_nvs_write(pack);
+}
+
+static void bench_nvs_write_all(int iteration)
+{
+    settings_pack_mark_dirty(pack);
+    settings_nvs_write(pack);
+}
+
+static void bench_nvs_write_one(int iteration)
+{
+    setting_set_num(first_num, iteration % 2);
+    settings_nvs_write(pack);
+}
+
+static void bench_httpd_pack(settings_group_t *settings_pack, esp_err_t (*handler)(httpd_req_t *), const char *query,
+                             const char *headers, const void *body, size_t body_len)
+{
+    httpd_req_t      req;
+    httpd_host_req_t host;
+
+    httpd_host_req_init(&req, &host, query, headers, NULL, settings_pack);
+    httpd_host_req_set_body(&req, body, body_len);
+    handler(&req);
+    resp_bytes = host.resp_len;
+}
+
+static void bench_httpd(esp_err_t (*handler)(httpd_req_t *), const char *query, const char *headers, const void *body,
+                        size_t body_len)
+{
+    bench_httpd_pack(pack, handler, query, headers, body, body_len);
+}
+
+static void bench_json_get(int iteration)
+{
+    bench_httpd(settings_httpd_handler, NULL, NULL, NULL, 0);
+}
+
+static void bench_json_values(int iteration)
+{
+    bench_httpd(settings_values_httpd_handler, NULL, NULL, NULL, 0);
+}
+
+/* fleet monitor poll of a few values */
+static void bench_json_values_keys(int iteration)
+{
+    bench_httpd(settings_values_httpd_handler, "keys=G000:S001,G000:S003,G000:S006", NULL, NULL, 0);
+}
+
+static void bench_json_values_group(int iteration)
+{
+    bench_httpd(settings_values_httpd_handler, "group=G000", NULL, NULL, 0);
+}
+
+#ifdef CONFIG_SETTINGS_CHANGE_FEED
+/* dashboard catching up with one change since its last poll */
+static void bench_json_values_since(int iteration)
+{
+    char query[40];
+
+    setting_set_num(first_num, iteration % 2);
+    snprintf(query, sizeof(query), "since=%08" PRIx32 "-%" PRIu32, settings_get_epoch(),
+             settings_get_generation() - 1);
+    bench_httpd(settings_values_httpd_handler, query, NULL, NULL, 0);
+}
+#endif
+
+static void bench_form_post(int iteration)
+{
+    bench_httpd(settings_httpd_handler, "action=set", NULL, form_body, strlen(form_body));
+}
+
+static void bench_json_post(int iteration)
+{
+    bench_httpd(settings_httpd_handler, "action=set", "Content-Type: application/json\n", json_body, strlen(json_body));
+}
+
+#ifdef CONFIG_SETTINGS_CBOR_SUPPORT
+static void bench_cbor_get(int iteration)
+{
+    bench_httpd(settings_httpd_handler, NULL, "Accept: " SETTINGS_HTTPD_TYPE_CBOR "\n", NULL, 0);
+}
+
+static void bench_cbor_values(int iteration)
+{
+    bench_httpd(settings_values_httpd_handler, NULL, "Accept: " SETTINGS_HTTPD_TYPE_CBOR "\n", NULL, 0);
+}
+
+static void bench_cbor_post(int iteration)
+{
+    bench_httpd(settings_httpd_handler, "action=set",
+                "Content-Type: " SETTINGS_HTTPD_TYPE_CBOR "\nAccept: " SETTINGS_HTTPD_TYPE_CBOR "\n", cbor_body,
+                cbor_body_len);
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_ARRAY_SUPPORT
+/* whole table, alternating between two sets of values */
+static void bench_array_post(int iteration)
+{
+    const char *body = array_body[iteration % 2];
+
+    bench_httpd_pack(array_pack, settings_httpd_handler, "action=set", "Content-Type: application/json\n", body,
+                     strlen(body));
+}
+
+/* eight elements from the middle of the table */
+static void bench_array_post_range(int iteration)
+{
+    const char *body = array_range_body[iteration % 2];
+
+    bench_httpd_pack(array_pack, settings_httpd_handler, "action=set", "Content-Type: application/json\n", body,
+                     strlen(body));
+}
+#endif
+
+/* lookup of every setting of the pack in turn */
+static void bench_find(const settings_group_t *settings_pack, int iteration)
+{
+    const settings_group_t *gr = &pack[iteration / pack_per_group % pack_groups];
+    setting_t              *setting = &gr->settings[iteration % pack_per_group];
+
+    sink = settings_pack_find(settings_pack, gr->id, setting->id) == setting;
+}
+
+static void bench_find_indexed(int iteration)
+{
+    bench_find(pack, iteration);
+}
+
+static void bench_find_linear(int iteration)
+{
+    bench_find(linear_pack, iteration);
+}
+
+static void bench_get_num(int iteration)
+{
+    sink = setting_get_num(first_num);
+}
+
+static void bench_get_text(int iteration)
+{
+    sink = setting_get_text(first_text, text_buf, text_len);
+}
+
+static void bench_set_text(int iteration)
+{
+    setting_set_text(first_text, iteration % 2 ? text_alt : text_def);
+}
+
+/* value equal to the current one is not copied again */
+static void bench_set_text_same(int iteration)
+{
+    setting_set_text(first_text, text_def);
+}
+
+static void bench_text_restore(void)
+{
+    setting_set_text(first_text, text_def);
+    settings_nvs_write(pack);
+}
+
+#ifdef CONFIG_SETTINGS_LAZY_TEXT
+/* first access after the value was released */
+static void bench_get_text_cold(int iteration)
+{
+    setting_text_evict(first_text);
+    sink = setting_get_text(first_text, text_buf, text_len);
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_NET_SUPPORT
+static void bench_get_netif(int iteration)
+{
+    netif_conf_t netif;
+
+    setting_get_netif(first_netif, &netif);
+    /* all fields are written together by the writer thread */
+    if (netif.ip.addr != netif.gateway.addr) {
+        fprintf(stderr, "torn netif read\n");
+        exit(1);
+    }
+    sink = netif.ip.addr;
+}
+
+static void *bench_writer(void *arg)
+{
+    netif_conf_t netif = { 0 };
+
+    while (!__atomic_load_n(&writer_stop, __ATOMIC_RELAXED)) {
+        netif.ip.addr++;
+        netif.netmask.addr = netif.ip.addr;
+        netif.gateway.addr = netif.ip.addr;
+        setting_set_netif(first_netif, &netif);
+    }
+    return NULL;
+}
+
+static void bench_netif_reset(void)
+{
+    netif_conf_t netif = { 0 };
+
+    setting_set_netif(first_netif, &netif);
+}
+
+static void bench_writer_start(void)
+{
+    bench_netif_reset();
+    __atomic_store_n(&writer_stop, false, __ATOMIC_RELAXED);
+    pthread_create(&writer_thread, NULL, bench_writer, NULL);
+}
+
+static void bench_writer_stop(void)
+{
+    __atomic_store_n(&writer_stop, true, __ATOMIC_RELAXED);
+    pthread_join(writer_thread, NULL);
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_NOTIFY_SUPPORT
+static void bench_notify_cb(const settings_change_t *changes, size_t count, void *arg)
+{
+    __atomic_add_fetch(&notify_delivered, 1, __ATOMIC_RELEASE);
+}
+
+static void bench_notify_start(void)
+{
+    settings_filter_t filter = { .types = SETTING_TYPE_MASK(SETTING_TYPE_NUM) };
+
+    notify_published = 0;
+    notify_delivered = 0;
+    settings_subscribe(&filter, bench_notify_cb, NULL);
+}
+
+/* one changed setting per publish, delivered by the notification task */
+static void bench_notify(int iteration)
+{
+    setting_set_num(first_num, iteration & 1);
+    if (settings_notify(pack) == ESP_OK)
+        notify_published++;
+}
+
+static void bench_notify_stop(void)
+{
+    while (__atomic_load_n(&notify_delivered, __ATOMIC_ACQUIRE) < notify_published)
+        usleep(100);
+    settings_unsubscribe(bench_notify_cb, NULL);
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_WS_PUSH
+static void bench_ws_start(void)
+{
+    httpd_req_t      req;
+    httpd_host_req_t host;
+
+    ws_client.closed = false;
+    httpd_host_ws_open(&ws_client);
+    httpd_host_req_init(&req, &host, NULL, NULL, NULL, pack);
+    req.handle = &ws_client;
+    host.fd = ws_client.fd;
+    settings_ws_httpd_handler(&req);
+    httpd_host_run_work();
+}
+
+/* one change pushed to a websocket client by the server task */
+static void bench_ws_push(int iteration)
+{
+    size_t bytes = ws_client.bytes;
+
+    setting_set_num(first_num, iteration & 1);
+    httpd_host_run_work();
+    resp_bytes = ws_client.bytes - bytes;
+}
+
+/*
+ * A change stored right away: the message must stay a delta of that one
+ * setting, the save must not push anything of its own.
+ */
+static void bench_ws_push_save(int iteration)
+{
+    size_t   bytes = ws_client.bytes;
+    uint32_t messages = ws_client.messages;
+    int      values = 0;
+
+    setting_set_num(first_num, !setting_get_num(first_num));
+    settings_nvs_write(pack);
+    httpd_host_run_work();
+    resp_bytes = ws_client.bytes - bytes;
+
+    for (const char *p = strstr(ws_msg, "\"val\""); p; p = strstr(p + 1, "\"val\""))
+        values++;
+    if (ws_client.messages - messages != 1 || !strstr(ws_msg, "\"since\"") || values != 1) {
+        fprintf(stderr, "ws push after save: %" PRIu32 " messages, last %s\n", ws_client.messages - messages,
+                ws_msg);
+        exit(1);
+    }
+}
+
+static void bench_ws_stop(void)
+{
+    ws_client.closed = true;
+    setting_set_num(first_num, 0);
+    httpd_host_run_work();
+    httpd_host_ws_remove(&ws_client);
+}
+#endif
+
+static const bench_t benchmarks[] = {
+    { "nvs_read", bench_nvs_read },
+    { "nvs_read_sparse", bench_nvs_read, bench_nvs_sparse_start, bench_nvs_sparse_stop },
+    { "nvs_read_text", bench_nvs_read_text, NULL, bench_pack_reload },
+    { "nvs_write_all", bench_nvs_write_all },
+    { "nvs_write_one", bench_nvs_write_one },
+    { "json_get", bench_json_get },
+    { "json_values", bench_json_values },
+    { "json_values_keys", bench_json_values_keys },
+    { "json_values_group", bench_json_values_group },
+#ifdef CONFIG_SETTINGS_CHANGE_FEED
+    { "json_values_since", bench_json_values_since, NULL, NULL, &first_num },
+#endif
+    { "form_post", bench_form_post },
+    { "json_post", bench_json_post },
+#ifdef CONFIG_SETTINGS_CBOR_SUPPORT
+    { "cbor_get", bench_cbor_get },
+    { "cbor_values", bench_cbor_values },
+    { "cbor_post", bench_cbor_post },
+#endif
+#ifdef CONFIG_SETTINGS_ARRAY_SUPPORT
+    { "array_post", bench_array_post },
+    { "array_post_range", bench_array_post_range },
+#endif
+    { "find_indexed", bench_find_indexed },
+    { "find_linear", bench_find_linear },
+    { "get_num", bench_get_num },
+    { "get_text", bench_get_text },
+#ifdef CONFIG_SETTINGS_LAZY_TEXT
+    { "get_text_cold", bench_get_text_cold },
+#endif
+    { "set_text", bench_set_text, NULL, bench_text_restore },
+    { "set_text_same", bench_set_text_same, bench_text_restore },
+#ifdef CONFIG_SETTINGS_NET_SUPPORT
+    { "get_netif", bench_get_netif, bench_netif_reset, NULL, &first_netif },
+    { "get_netif_contend", bench_get_netif, bench_writer_start, bench_writer_stop, &first_netif },
+#endif
+#ifdef CONFIG_SETTINGS_NOTIFY_SUPPORT
+    { "notify", bench_notify, bench_notify_start, bench_notify_stop, &first_num },
+#endif
+#ifdef CONFIG_SETTINGS_WS_PUSH
+    { "ws_push", bench_ws_push, bench_ws_start, bench_ws_stop, &first_num },
+    { "ws_push_save", bench_ws_push_save, bench_ws_start, bench_ws_stop, &first_num },
+#endif
+};
+
+/* heap counters are also updated by the settings tasks */
+static void bench_heap_get(bench_heap_t *snap)
+{
+    snap->allocs = __atomic_load_n(&heap.allocs, __ATOMIC_RELAXED);
+    snap->current = __atomic_load_n(&heap.current, __ATOMIC_RELAXED);
+    snap->peak = __atomic_load_n(&heap.peak, __ATOMIC_RELAXED);
+}
+
+static void bench_run(const bench_t *bench, int iterations, bool csv)
+{
+    nvs_host_counters_t nvs;
+    bench_heap_t        before;
+    bench_heap_t        after;
+    uint64_t            start;
+    uint64_t            elapsed;
+
+    resp_bytes = 0;
+    bench_heap_get(&before);
+    if (bench->setup)
+        bench->setup();
+    __atomic_store_n(&heap.peak, __atomic_load_n(&heap.current, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+    nvs_host_reset_counters();
+
+    start = bench_now_ns();
+    for (int i = 0; i < iterations; i++)
+        bench->run(i);
+    elapsed = bench_now_ns() - start;
+
+    bench_heap_get(&after);
+    nvs_host_get_counters(&nvs);
+    if (bench->teardown)
+        bench->teardown();
+
+    printf(csv ? "%s,%.0f,%.2f,%lld,%.2f,%.2f,%zu\n" : "%-18s %12.0f %10.2f %12lld %12.2f %12.2f %8zu\n",
+           bench->name, (double)elapsed / iterations, (double)(after.allocs - before.allocs) / iterations,
+           (long long)(after.peak - before.current), (double)nvs.reads / iterations, (double)nvs.writes / iterations,
+           resp_bytes);
+}
+
+int main(int argc, char **argv)
+{
+    int  groups = 8;
+    int  per_group = 16;
+    int  iterations = 1000;
+    bool csv = false;
+    int  opt;
+
+    while ((opt = getopt(argc, argv, "g:s:t:n:c")) != -1) {
+        switch (opt) {
+        case 'g':
+            groups = atoi(optarg);
+            break;
+        case 's':
+            per_group = atoi(optarg);
+            break;
+        case 't':
+            text_len = atoi(optarg);
+            break;
+        case 'n':
+            iterations = atoi(optarg);
+            break;
+        case 'c':
+            csv = true;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-g groups] [-s settings per group] [-t text length] [-n iterations] [-c]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (groups < 1 || groups > 999 || per_group < 4 || per_group > 999 || text_len < 8 || text_len > 4000 ||
+        iterations < 1) {
+        fprintf(stderr, "invalid arguments - 1..999 groups, 4..999 settings per group, 8..4000 text length\n");
+        return 1;
+    }
+
+    /* stored text values fill the whole buffer */
+    text_def = malloc(text_len);
+    text_buf = malloc(text_len);
+    text_alt = malloc(text_len);
+    for (size_t i = 0; i < text_len - 1; i++) {
+        text_def[i] = "synthetic text value "[i % 21];
+        text_alt[i] = "changed text value "[i % 19];
+    }
+    text_def[text_len - 1] = '\0';
+    text_alt[text_len - 1] = '\0';
+
+    esp_log_level_set("*", ESP_LOG_ERROR);
+
+    pack = bench_pack_create(groups, per_group);
+    pack_groups = groups;
+    pack_per_group = per_group;
+    linear_pack = calloc(groups + 1, sizeof(settings_group_t));
+    memcpy(linear_pack, pack, groups * sizeof(settings_group_t));
+    form_body = bench_form_create(pack);
+    json_body = bench_json_create(pack);
+#ifdef CONFIG_SETTINGS_CBOR_SUPPORT
+    cbor_body = bench_cbor_create(pack, &cbor_body_len);
+#endif
+    first_num = settings_pack_find(pack, "G000", "S001");
+    first_text = settings_pack_find(pack, "G000", "S003");
+#ifdef CONFIG_SETTINGS_NET_SUPPORT
+    first_netif = settings_pack_find(pack, "G000", "S007");
+#endif
+
+    /* build keys and index, store everything once */
+    text_pack = bench_text_pack_create(per_group);
+    settings_nvs_read(text_pack);
+    settings_pack_mark_dirty(text_pack);
+    settings_nvs_write(text_pack);
+#ifdef CONFIG_SETTINGS_ARRAY_SUPPORT
+    array_pack = bench_array_pack_create();
+    settings_nvs_read(array_pack);
+    settings_pack_mark_dirty(array_pack);
+    settings_nvs_write(array_pack);
+#endif
+    settings_nvs_read(pack);
+    settings_pack_mark_dirty(pack);
+    settings_nvs_write(pack);
+
+    if (csv) {
+        printf("benchmark,ns_per_op,allocs_per_op,peak_heap_bytes,nvs_reads_per_op,nvs_writes_per_op,resp_bytes\n");
+    } else {
+        printf("%d groups x %d settings, %zu byte texts, %d iterations, %s layout\n", groups, per_group, text_len,
+               iterations,
+#ifdef CONFIG_SETTINGS_STORAGE_GROUP_BLOB
+               "group blob"
+#else
+               "per-key"
+#endif
+        );
+        printf("%-18s %12s %10s %12s %12s %12s %8s\n", "benchmark", "ns/op", "allocs/op", "peak heap B",
+               "nvs reads/op", "nvs writes/op", "resp B");
+    }
+    for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+        if (benchmarks[i].needs && !*benchmarks[i].needs)
+            continue;
+        bench_run(&benchmarks[i], iterations, csv);
+    }
+    return 0;
+}
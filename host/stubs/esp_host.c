@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2025 <qb4.dev@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <time.h>
+#include <malloc.h>
+
+#include <esp_err.h>
+#include <esp_log.h>
+#include <esp_system.h>
+#include <esp_random.h>
+#include <esp_timer.h>
+#include <nvs.h>
+
+#define HOST_SHUTDOWN_HANDLERS 5
+#define HOST_HEAP_SIZE         (256 * 1024)
+
+static esp_log_level_t    log_level = ESP_LOG_INFO;
+static shutdown_handler_t shutdown_handlers[HOST_SHUTDOWN_HANDLERS];
+
+static const struct {
+    esp_err_t   code;
+    const char *name;
+} esp_err_names[] = {
+    { ESP_OK, "ESP_OK" },
+    { ESP_FAIL, "ESP_FAIL" },
+    { ESP_ERR_NO_MEM, "ESP_ERR_NO_MEM" },
+    { ESP_ERR_INVALID_ARG, "ESP_ERR_INVALID_ARG" },
+    { ESP_ERR_INVALID_STATE, "ESP_ERR_INVALID_STATE" },
+    { ESP_ERR_INVALID_SIZE, "ESP_ERR_INVALID_SIZE" },
+    { ESP_ERR_NOT_FOUND, "ESP_ERR_NOT_FOUND" },
+    { ESP_ERR_NOT_SUPPORTED, "ESP_ERR_NOT_SUPPORTED" },
+    { ESP_ERR_TIMEOUT, "ESP_ERR_TIMEOUT" },
+    { ESP_ERR_INVALID_RESPONSE, "ESP_ERR_INVALID_RESPONSE" },
+    { ESP_ERR_INVALID_CRC, "ESP_ERR_INVALID_CRC" },
+    { ESP_ERR_INVALID_VERSION, "ESP_ERR_INVALID_VERSION" },
+    { ESP_ERR_NVS_NOT_INITIALIZED, "ESP_ERR_NVS_NOT_INITIALIZED" },
+    { ESP_ERR_NVS_NOT_FOUND, "ESP_ERR_NVS_NOT_FOUND" },
+    { ESP_ERR_NVS_TYPE_MISMATCH, "ESP_ERR_NVS_TYPE_MISMATCH" },
+    { ESP_ERR_NVS_READ_ONLY, "ESP_ERR_NVS_READ_ONLY" },
+    { ESP_ERR_NVS_NOT_ENOUGH_SPACE, "ESP_ERR_NVS_NOT_ENOUGH_SPACE" },
+    { ESP_ERR_NVS_INVALID_NAME, "ESP_ERR_NVS_INVALID_NAME" },
+    { ESP_ERR_NVS_INVALID_HANDLE, "ESP_ERR_NVS_INVALID_HANDLE" },
+    { ESP_ERR_NVS_KEY_TOO_LONG, "ESP_ERR_NVS_KEY_TOO_LONG" },
+    { ESP_ERR_NVS_INVALID_LENGTH, "ESP_ERR_NVS_INVALID_LENGTH" },
+};
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    for (size_t i = 0; i < sizeof(esp_err_names) / sizeof(esp_err_names[0]); i++) {
+        if (esp_err_names[i].code == code)
+            return esp_err_names[i].name;
+    }
+    return "UNKNOWN ERROR";
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+    log_level = level;
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    va_list args;
+
+    if (level > log_level)
+        return;
+
+    fprintf(stderr, "%c %s: ", "-EWIDV"[level], tag);
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    fputc('\n', stderr);
+}
+
+esp_err_t esp_register_shutdown_handler(shutdown_handler_t handler)
+{
+    for (int i = 0; i < HOST_SHUTDOWN_HANDLERS; i++) {
+        if (shutdown_handlers[i] == handler)
+            return ESP_ERR_INVALID_STATE;
+        if (!shutdown_handlers[i]) {
+            shutdown_handlers[i] = handler;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+void esp_restart(void)
+{
+    for (int i = HOST_SHUTDOWN_HANDLERS - 1; i >= 0; i--) {
+        if (shutdown_handlers[i])
+            shutdown_handlers[i]();
+    }
+    ESP_LOGW("HOST", "esp_restart() - exiting");
+    exit(0);
+}
+
+/* counts from the first call like from boot on the device */
+int64_t esp_timer_get_time(void)
+{
+    static int64_t  boot_us;
+    struct timespec ts;
+    int64_t         now;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    now = (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    if (!boot_us)
+        boot_us = now;
+    return now - boot_us;
+}
+
+uint32_t esp_get_free_heap_size(void)
+{
+    struct mallinfo2 mi = mallinfo2();
+
+    return mi.uordblks < HOST_HEAP_SIZE ? HOST_HEAP_SIZE - mi.uordblks : 0;
+}
+
+uint32_t esp_random(void)
+{
+    static uint32_t state;
+
+    if (!state) {
+        struct timespec ts;
+
+        clock_gettime(CLOCK_REALTIME, &ts);
+        state = (uint32_t)ts.tv_nsec ^ (uint32_t)ts.tv_sec ^ 0x9e3779b9u;
+    }
+    /* xorshift32 */
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
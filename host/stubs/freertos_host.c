@@ -0,0 +1,278 @@
+/*
+ * Copyright (c) 2025 <qb4.dev@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+struct host_semaphore {
+    pthread_mutex_t mutex;
+};
+
+struct host_queue {
+    pthread_mutex_t mutex;
+    pthread_cond_t  not_empty;
+    pthread_cond_t  not_full;
+    UBaseType_t     length;
+    UBaseType_t     item_size;
+    UBaseType_t     head;
+    UBaseType_t     count;
+    unsigned char   items[];
+};
+
+struct host_task {
+    TaskFunction_t  func;
+    void           *arg;
+    pthread_mutex_t mutex;
+    pthread_cond_t  notified;
+    uint32_t        notify;
+};
+
+static __thread TaskHandle_t host_current_task;
+
+static void host_deadline(struct timespec *ts, TickType_t ticks)
+{
+    clock_gettime(CLOCK_REALTIME, ts);
+    ts->tv_sec += ticks / 1000;
+    ts->tv_nsec += (ticks % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+static SemaphoreHandle_t host_mutex_create(int type)
+{
+    SemaphoreHandle_t   sem = calloc(1, sizeof(*sem));
+    pthread_mutexattr_t attr;
+
+    if (!sem)
+        return NULL;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, type);
+    pthread_mutex_init(&sem->mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return host_mutex_create(PTHREAD_MUTEX_NORMAL);
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void)
+{
+    return host_mutex_create(PTHREAD_MUTEX_RECURSIVE);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+    pthread_mutex_destroy(&sem->mutex);
+    free(sem);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    struct timespec deadline;
+
+    if (ticks == portMAX_DELAY)
+        return pthread_mutex_lock(&sem->mutex) == 0 ? pdTRUE : pdFALSE;
+    if (ticks == 0)
+        return pthread_mutex_trylock(&sem->mutex) == 0 ? pdTRUE : pdFALSE;
+
+    host_deadline(&deadline, ticks);
+    return pthread_mutex_timedlock(&sem->mutex, &deadline) == 0 ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    return pthread_mutex_unlock(&sem->mutex) == 0 ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    return xSemaphoreTake(sem, ticks);
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t sem)
+{
+    return xSemaphoreGive(sem);
+}
+
+/* wait on a queue condition, the queue mutex is held */
+static BaseType_t host_queue_wait(QueueHandle_t queue, pthread_cond_t *cond, UBaseType_t busy, TickType_t ticks)
+{
+    struct timespec deadline;
+
+    if (ticks != portMAX_DELAY)
+        host_deadline(&deadline, ticks);
+    while (queue->count == busy) {
+        if (ticks == 0)
+            return pdFALSE;
+        if (ticks == portMAX_DELAY)
+            pthread_cond_wait(cond, &queue->mutex);
+        else if (pthread_cond_timedwait(cond, &queue->mutex, &deadline) == ETIMEDOUT)
+            return queue->count != busy;
+    }
+    return pdTRUE;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    QueueHandle_t queue = calloc(1, sizeof(*queue) + (size_t)length * item_size);
+
+    if (!queue)
+        return NULL;
+    pthread_mutex_init(&queue->mutex, NULL);
+    pthread_cond_init(&queue->not_empty, NULL);
+    pthread_cond_init(&queue->not_full, NULL);
+    queue->length = length;
+    queue->item_size = item_size;
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    pthread_cond_destroy(&queue->not_full);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_mutex_destroy(&queue->mutex);
+    free(queue);
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+    BaseType_t rc;
+
+    pthread_mutex_lock(&queue->mutex);
+    rc = host_queue_wait(queue, &queue->not_full, queue->length, ticks);
+    if (rc == pdTRUE) {
+        UBaseType_t tail = (queue->head + queue->count) % queue->length;
+
+        memcpy(queue->items + tail * queue->item_size, item, queue->item_size);
+        queue->count++;
+        pthread_cond_signal(&queue->not_empty);
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    return rc;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+    BaseType_t rc;
+
+    pthread_mutex_lock(&queue->mutex);
+    rc = host_queue_wait(queue, &queue->not_empty, 0, ticks);
+    if (rc == pdTRUE) {
+        memcpy(item, queue->items + queue->head * queue->item_size, queue->item_size);
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        pthread_cond_signal(&queue->not_full);
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    return rc;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    UBaseType_t count;
+
+    pthread_mutex_lock(&queue->mutex);
+    count = queue->count;
+    pthread_mutex_unlock(&queue->mutex);
+    return count;
+}
+
+static void *host_task_entry(void *arg)
+{
+    host_current_task = arg;
+    host_current_task->func(host_current_task->arg);
+    return NULL;
+}
+
+/* tasks never end on the host, their handles stay valid */
+BaseType_t xTaskCreate(TaskFunction_t func, const char *name, uint32_t stack_size, void *arg, UBaseType_t priority,
+                       TaskHandle_t *handle)
+{
+    TaskHandle_t   task = calloc(1, sizeof(*task));
+    pthread_attr_t attr;
+    pthread_t      thread;
+    int            rc;
+
+    if (!task)
+        return pdFAIL;
+    task->func = func;
+    task->arg = arg;
+    pthread_mutex_init(&task->mutex, NULL);
+    pthread_cond_init(&task->notified, NULL);
+
+    /* stack size and priority are ignored, host threads get the defaults */
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    rc = pthread_create(&thread, &attr, host_task_entry, task);
+    pthread_attr_destroy(&attr);
+    if (rc != 0) {
+        pthread_cond_destroy(&task->notified);
+        pthread_mutex_destroy(&task->mutex);
+        free(task);
+        return pdFAIL;
+    }
+    if (handle)
+        *handle = task;
+    return pdPASS;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    pthread_mutex_lock(&task->mutex);
+    task->notify++;
+    pthread_cond_signal(&task->notified);
+    pthread_mutex_unlock(&task->mutex);
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks)
+{
+    TaskHandle_t    task = host_current_task;
+    struct timespec deadline;
+    uint32_t        count;
+
+    if (ticks != portMAX_DELAY)
+        host_deadline(&deadline, ticks);
+    pthread_mutex_lock(&task->mutex);
+    while (!task->notify && ticks != 0) {
+        if (ticks == portMAX_DELAY)
+            pthread_cond_wait(&task->notified, &task->mutex);
+        else if (pthread_cond_timedwait(&task->notified, &task->mutex, &deadline) == ETIMEDOUT)
+            break;
+    }
+    count = task->notify;
+    if (count)
+        task->notify = clear ? 0 : count - 1;
+    pthread_mutex_unlock(&task->mutex);
+    return count;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    struct timespec ts = { .tv_sec = ticks / 1000, .tv_nsec = (ticks % 1000) * 1000000L };
+
+    nanosleep(&ts, NULL);
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (TickType_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
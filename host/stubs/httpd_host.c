@@ -0,0 +1,372 @@
+/*
+ * Copyright (c) 2025 <qb4.dev@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <esp_http_server.h>
+
+void httpd_host_req_init(httpd_req_t *req, httpd_host_req_t *host, const char *query, const char *headers,
+                         const char *body, void *user_ctx)
+{
+    memset(req, 0, sizeof(*req));
+    memset(host, 0, sizeof(*host));
+    host->query = query ? query : "";
+    host->headers = headers ? headers : "";
+    strcpy(host->status, "200 OK");
+
+    req->aux = host;
+    req->user_ctx = user_ctx;
+    httpd_host_req_set_body(req, body, body ? strlen(body) : 0);
+}
+
+void httpd_host_req_set_body(httpd_req_t *req, const void *body, size_t len)
+{
+    httpd_host_req_t *host = req->aux;
+
+    host->body = body;
+    host->body_len = len;
+    host->body_pos = 0;
+    req->method = body ? HTTP_POST : HTTP_GET;
+    req->content_len = len;
+}
+
+static esp_err_t httpd_host_append(httpd_req_t *r, const char *buf, size_t len)
+{
+    httpd_host_req_t *host = r->aux;
+
+    if (host->resp_buf && host->resp_len < host->resp_size - 1) {
+        size_t copy = host->resp_size - 1 - host->resp_len;
+
+        if (copy > len)
+            copy = len;
+        memcpy(&host->resp_buf[host->resp_len], buf, copy);
+        host->resp_buf[host->resp_len + copy] = '\0';
+    }
+    host->resp_len += len;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type)
+{
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status)
+{
+    httpd_host_req_t *host = r->aux;
+
+    snprintf(host->status, sizeof(host->status), "%s", status);
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value)
+{
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+    if (buf_len == HTTPD_RESP_USE_STRLEN)
+        buf_len = buf ? strlen(buf) : 0;
+    return httpd_host_append(r, buf, buf_len);
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+    if (!buf)
+        return ESP_OK;
+    if (buf_len == HTTPD_RESP_USE_STRLEN)
+        buf_len = strlen(buf);
+    return httpd_host_append(r, buf, buf_len);
+}
+
+esp_err_t httpd_resp_sendstr(httpd_req_t *r, const char *str)
+{
+    return httpd_resp_send(r, str, HTTPD_RESP_USE_STRLEN);
+}
+
+esp_err_t httpd_resp_sendstr_chunk(httpd_req_t *r, const char *str)
+{
+    return httpd_resp_send_chunk(r, str, HTTPD_RESP_USE_STRLEN);
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const char *msg)
+{
+    httpd_host_req_t *host = req->aux;
+
+    snprintf(host->status, sizeof(host->status), "%d", error);
+    return httpd_resp_sendstr(req, msg ? msg : "");
+}
+
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len)
+{
+    httpd_host_req_t *host = r->aux;
+    size_t            left = host->body_len - host->body_pos;
+
+    if (buf_len > left)
+        buf_len = left;
+    memcpy(buf, host->body + host->body_pos, buf_len);
+    host->body_pos += buf_len;
+    return buf_len;
+}
+
+size_t httpd_req_get_url_query_len(httpd_req_t *r)
+{
+    httpd_host_req_t *host = r->aux;
+
+    return strlen(host->query);
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf, size_t buf_len)
+{
+    httpd_host_req_t *host = r->aux;
+
+    if (!*host->query)
+        return ESP_ERR_NOT_FOUND;
+    snprintf(buf, buf_len, "%s", host->query);
+    return ESP_OK;
+}
+
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t val_size)
+{
+    size_t key_len = strlen(key);
+
+    for (const char *param = qry; param && *param;) {
+        const char *end = strchr(param, '&');
+        const char *eq = strchr(param, '=');
+        size_t      len;
+
+        if (!end)
+            end = param + strlen(param);
+        if (eq && eq < end && (size_t)(eq - param) == key_len && !strncmp(param, key, key_len)) {
+            len = end - eq - 1;
+            if (len >= val_size)
+                len = val_size - 1;
+            memcpy(val, eq + 1, len);
+            val[len] = '\0';
+            return ESP_OK;
+        }
+        param = *end ? end + 1 : NULL;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+static const char *httpd_host_hdr_find(httpd_req_t *r, const char *field, size_t *len)
+{
+    httpd_host_req_t *host = r->aux;
+    size_t            field_len = strlen(field);
+
+    for (const char *line = host->headers; *line;) {
+        const char *end = strchr(line, '\n');
+
+        if (!end)
+            end = line + strlen(line);
+        if (!strncasecmp(line, field, field_len) && line[field_len] == ':') {
+            const char *value = line + field_len + 1;
+
+            while (*value == ' ')
+                value++;
+            *len = end - value;
+            return value;
+        }
+        line = *end ? end + 1 : end;
+    }
+    return NULL;
+}
+
+size_t httpd_req_get_hdr_value_len(httpd_req_t *r, const char *field)
+{
+    size_t len = 0;
+
+    httpd_host_hdr_find(r, field, &len);
+    return len;
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r, const char *field, char *val, size_t val_size)
+{
+    size_t      len = 0;
+    const char *value = httpd_host_hdr_find(r, field, &len);
+
+    if (!value)
+        return ESP_ERR_NOT_FOUND;
+    if (len >= val_size)
+        len = val_size - 1;
+    memcpy(val, value, len);
+    val[len] = '\0';
+    return ESP_OK;
+}
+
+int httpd_req_to_sockfd(httpd_req_t *r)
+{
+    httpd_host_req_t *host = r->aux;
+
+    return host->fd;
+}
+
+esp_err_t httpd_ws_recv_frame(httpd_req_t *req, httpd_ws_frame_t *pkt, size_t max_len)
+{
+    httpd_host_req_t *host = req->aux;
+
+    pkt->type = HTTPD_WS_TYPE_TEXT;
+    pkt->final = true;
+    pkt->len = host->body_len - host->body_pos;
+    if (!max_len)
+        return ESP_OK;
+    if (pkt->len > max_len)
+        return ESP_ERR_INVALID_SIZE;
+    pkt->len = httpd_req_recv(req, (char *)pkt->payload, pkt->len);
+    return ESP_OK;
+}
+
+#define HTTPD_HOST_WS_MAX   16
+#define HTTPD_HOST_WORK_MAX 32
+
+typedef struct {
+    httpd_work_fn_t work;
+    void           *arg;
+} httpd_host_work_t;
+
+static pthread_mutex_t   httpd_host_mutex = PTHREAD_MUTEX_INITIALIZER;
+static httpd_host_ws_t  *httpd_host_ws[HTTPD_HOST_WS_MAX];
+static httpd_host_work_t httpd_host_work[HTTPD_HOST_WORK_MAX];
+static int               httpd_host_work_count;
+
+esp_err_t httpd_host_ws_open(httpd_host_ws_t *ws)
+{
+    esp_err_t rc = ESP_ERR_NO_MEM;
+
+    pthread_mutex_lock(&httpd_host_mutex);
+    for (int i = 0; i < HTTPD_HOST_WS_MAX; i++) {
+        if (!httpd_host_ws[i] || httpd_host_ws[i]->fd == ws->fd) {
+            httpd_host_ws[i] = ws;
+            rc = ESP_OK;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&httpd_host_mutex);
+    return rc;
+}
+
+void httpd_host_ws_remove(httpd_host_ws_t *ws)
+{
+    pthread_mutex_lock(&httpd_host_mutex);
+    for (int i = 0; i < HTTPD_HOST_WS_MAX; i++) {
+        if (httpd_host_ws[i] == ws)
+            httpd_host_ws[i] = NULL;
+    }
+    pthread_mutex_unlock(&httpd_host_mutex);
+}
+
+static httpd_host_ws_t *httpd_host_ws_find(int fd)
+{
+    for (int i = 0; i < HTTPD_HOST_WS_MAX; i++) {
+        if (httpd_host_ws[i] && httpd_host_ws[i]->fd == fd)
+            return httpd_host_ws[i];
+    }
+    return NULL;
+}
+
+httpd_ws_client_info_t httpd_ws_get_fd_info(httpd_handle_t hd, int fd)
+{
+    httpd_host_ws_t *ws;
+
+    pthread_mutex_lock(&httpd_host_mutex);
+    ws = httpd_host_ws_find(fd);
+    pthread_mutex_unlock(&httpd_host_mutex);
+    return ws && !ws->closed ? HTTPD_WS_CLIENT_WEBSOCKET : HTTPD_WS_CLIENT_INVALID;
+}
+
+esp_err_t httpd_ws_send_frame_async(httpd_handle_t hd, int fd, httpd_ws_frame_t *frame)
+{
+    httpd_host_ws_t *ws;
+
+    pthread_mutex_lock(&httpd_host_mutex);
+    ws = httpd_host_ws_find(fd);
+    pthread_mutex_unlock(&httpd_host_mutex);
+    if (!ws || ws->closed)
+        return ESP_FAIL;
+
+    if (frame->type != HTTPD_WS_TYPE_CONTINUE)
+        ws->msg_len = 0;
+    if (ws->msg_buf && ws->msg_len < ws->msg_size - 1) {
+        size_t copy = ws->msg_size - 1 - ws->msg_len;
+
+        if (copy > frame->len)
+            copy = frame->len;
+        memcpy(&ws->msg_buf[ws->msg_len], frame->payload, copy);
+        ws->msg_buf[ws->msg_len + copy] = '\0';
+    }
+    ws->msg_len += frame->len;
+    ws->bytes += frame->len;
+    ws->frames++;
+    if (!frame->fragmented || frame->final)
+        ws->messages++;
+    return ESP_OK;
+}
+
+esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work, void *arg)
+{
+    esp_err_t rc = ESP_FAIL;
+
+    pthread_mutex_lock(&httpd_host_mutex);
+    if (httpd_host_work_count < HTTPD_HOST_WORK_MAX) {
+        httpd_host_work[httpd_host_work_count++] = (httpd_host_work_t){ work, arg };
+        rc = ESP_OK;
+    }
+    pthread_mutex_unlock(&httpd_host_mutex);
+    return rc;
+}
+
+int httpd_host_run_work(void)
+{
+    int run = 0;
+
+    for (;;) {
+        httpd_host_work_t item;
+
+        pthread_mutex_lock(&httpd_host_mutex);
+        if (!httpd_host_work_count) {
+            pthread_mutex_unlock(&httpd_host_mutex);
+            return run;
+        }
+        item = httpd_host_work[0];
+        memmove(&httpd_host_work[0], &httpd_host_work[1], --httpd_host_work_count * sizeof(item));
+        pthread_mutex_unlock(&httpd_host_mutex);
+
+        item.work(item.arg);
+        run++;
+    }
+}
+
+esp_err_t httpd_req_async_handler_begin(httpd_req_t *r, httpd_req_t **out)
+{
+    httpd_host_req_t *host = r->aux;
+    httpd_req_t      *copy = malloc(sizeof(*copy));
+
+    if (!copy)
+        return ESP_ERR_NO_MEM;
+    *copy = *r;
+    pthread_mutex_lock(&httpd_host_mutex);
+    host->async++;
+    pthread_mutex_unlock(&httpd_host_mutex);
+    *out = copy;
+    return ESP_OK;
+}
+
+esp_err_t httpd_req_async_handler_complete(httpd_req_t *r)
+{
+    httpd_host_req_t *host = r->aux;
+
+    pthread_mutex_lock(&httpd_host_mutex);
+    host->async--;
+    pthread_mutex_unlock(&httpd_host_mutex);
+    free(r);
+    return ESP_OK;
+}
@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2025 <qb4.dev@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/*
+ * Host stand-in for ESP-IDF esp_http_server.h
+ *
+ * There is no server - a request is an `httpd_req_t` whose `aux` points to
+ * `httpd_host_req_t` holding the URL query, request headers and body. The
+ * response is counted and optionally copied into a caller provided buffer.
+ *
+ * Websocket clients are `httpd_host_ws_t` sinks registered by socket number,
+ * work queued with `httpd_queue_work()` runs in `httpd_host_run_work()`.
+ * Async handler copies of a request share its `aux`, so their response goes
+ * to the same sink.
+ */
+#ifndef ESP_HTTP_SERVER_H_
+#define ESP_HTTP_SERVER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "esp_err.h"
+
+#define HTTPD_TYPE_JSON "application/json"
+#define HTTPD_TYPE_TEXT "text/html"
+
+#define HTTPD_SOCK_ERR_FAIL    -1
+#define HTTPD_SOCK_ERR_INVALID -2
+#define HTTPD_SOCK_ERR_TIMEOUT -3
+
+#define HTTPD_RESP_USE_STRLEN -1
+
+enum http_method {
+    HTTP_DELETE = 0,
+    HTTP_GET = 1,
+    HTTP_HEAD = 2,
+    HTTP_POST = 3,
+    HTTP_PUT = 4
+};
+
+typedef enum {
+    HTTPD_400_BAD_REQUEST = 400,
+    HTTPD_404_NOT_FOUND = 404,
+    HTTPD_500_INTERNAL_SERVER_ERROR = 500
+} httpd_err_code_t;
+
+typedef void *httpd_handle_t;
+
+typedef void (*httpd_work_fn_t)(void *arg);
+
+typedef enum {
+    HTTPD_WS_TYPE_CONTINUE = 0x0,
+    HTTPD_WS_TYPE_TEXT = 0x1,
+    HTTPD_WS_TYPE_BINARY = 0x2,
+    HTTPD_WS_TYPE_CLOSE = 0x8,
+    HTTPD_WS_TYPE_PING = 0x9,
+    HTTPD_WS_TYPE_PONG = 0xA
+} httpd_ws_type_t;
+
+typedef enum {
+    HTTPD_WS_CLIENT_INVALID = 0x0,
+    HTTPD_WS_CLIENT_HTTP = 0x1,
+    HTTPD_WS_CLIENT_WEBSOCKET = 0x2
+} httpd_ws_client_info_t;
+
+typedef struct {
+    bool            final;
+    bool            fragmented;
+    httpd_ws_type_t type;
+    uint8_t        *payload;
+    size_t          len;
+} httpd_ws_frame_t;
+
+typedef struct httpd_req {
+    httpd_handle_t handle;
+    int            method;
+    const char    *uri;
+    size_t         content_len;
+    void          *aux;
+    void          *user_ctx;
+} httpd_req_t;
+
+/**
+ * @brief Host only: request data and response sink
+ *
+ * `headers` holds request headers as "Name: value\n" lines. When `resp_buf`
+ * is set the response body is copied there (truncated to `resp_size - 1`,
+ * always NUL terminated), `resp_len` counts all response bytes. `async`
+ * counts async copies begun and not completed yet.
+ */
+typedef struct {
+    int         fd;
+    const char *query;
+    const char *headers;
+    const char *body;
+    size_t      body_len;
+    size_t      body_pos;
+    char        status[32];
+    char       *resp_buf;
+    size_t      resp_size;
+    size_t      resp_len;
+    uint32_t    async;
+} httpd_host_req_t;
+
+/** @brief Host only: prepare request, body may be NULL */
+void httpd_host_req_init(httpd_req_t *req, httpd_host_req_t *host, const char *query, const char *headers,
+                         const char *body, void *user_ctx);
+
+/** @brief Host only: replace the request body with `len` bytes of binary data */
+void httpd_host_req_set_body(httpd_req_t *req, const void *body, size_t len);
+
+/**
+ * @brief Host only: websocket client
+ *
+ * The last complete message is kept in `msg_buf` (truncated to
+ * `msg_size - 1`, NUL terminated). Set `closed` to make sends fail.
+ */
+typedef struct {
+    int      fd;
+    bool     closed;
+    char    *msg_buf;
+    size_t   msg_size;
+    size_t   msg_len;
+    size_t   bytes;
+    uint32_t frames;
+    uint32_t messages;
+} httpd_host_ws_t;
+
+/** @brief Host only: make `ws` the client on socket `ws->fd` */
+esp_err_t httpd_host_ws_open(httpd_host_ws_t *ws);
+
+/** @brief Host only: forget the client, its socket becomes invalid */
+void httpd_host_ws_remove(httpd_host_ws_t *ws);
+
+/** @brief Host only: run work queued by `httpd_queue_work()`, returns the number of items run */
+int httpd_host_run_work(void);
+
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type);
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status);
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value);
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len);
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len);
+esp_err_t httpd_resp_sendstr(httpd_req_t *r, const char *str);
+esp_err_t httpd_resp_sendstr_chunk(httpd_req_t *r, const char *str);
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const char *msg);
+
+esp_err_t httpd_req_async_handler_begin(httpd_req_t *r, httpd_req_t **out);
+esp_err_t httpd_req_async_handler_complete(httpd_req_t *r);
+
+int       httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len);
+size_t    httpd_req_get_url_query_len(httpd_req_t *r);
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf, size_t buf_len);
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t val_size);
+size_t    httpd_req_get_hdr_value_len(httpd_req_t *r, const char *field);
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r, const char *field, char *val, size_t val_size);
+
+int                    httpd_req_to_sockfd(httpd_req_t *r);
+esp_err_t              httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work, void *arg);
+esp_err_t              httpd_ws_recv_frame(httpd_req_t *req, httpd_ws_frame_t *pkt, size_t max_len);
+esp_err_t              httpd_ws_send_frame_async(httpd_handle_t hd, int fd, httpd_ws_frame_t *frame);
+httpd_ws_client_info_t httpd_ws_get_fd_info(httpd_handle_t hd, int fd);
+
+#endif /* ESP_HTTP_SERVER_H_ */
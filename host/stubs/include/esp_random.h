@@ -0,0 +1,16 @@
+/*
+ * Copyright (c) 2025 <qb4.dev@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/* Host stand-in for ESP-IDF esp_random.h */
+#ifndef ESP_RANDOM_H_
+#define ESP_RANDOM_H_
+
+#include <stdint.h>
+
+/** @brief Random 32 bit word, different on every run of the host process */
+uint32_t esp_random(void);
+
+#endif /* ESP_RANDOM_H_ */
@@ -0,0 +1,26 @@
+/*
+ * Copyright (c) 2025 <qb4.dev@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/* Host stand-in for ESP-IDF esp_system.h */
+#ifndef ESP_SYSTEM_H_
+#define ESP_SYSTEM_H_
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+typedef void (*shutdown_handler_t)(void);
+
+/** @brief Registers a function called by esp_restart() */
+esp_err_t esp_register_shutdown_handler(shutdown_handler_t handler);
+
+/** @brief Runs the shutdown handlers and exits the host process */
+void esp_restart(void) __attribute__((noreturn));
+
+/** @brief Free heap of a nominal 256 KiB device heap minus the bytes allocated by the process */
+uint32_t esp_get_free_heap_size(void);
+
+#endif /* ESP_SYSTEM_H_ */
@@ -0,0 +1,16 @@
+/*
+ * Copyright (c) 2025 <qb4.dev@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/* Host stand-in for ESP-IDF esp_timer.h */
+#ifndef ESP_TIMER_H_
+#define ESP_TIMER_H_
+
+#include <stdint.h>
+
+/** @brief Microseconds of the monotonic clock */
+int64_t esp_timer_get_time(void);
+
+#endif /* ESP_TIMER_H_ */
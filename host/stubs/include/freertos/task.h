@@ -0,0 +1,25 @@
+/*
+ * Copyright (c) 2025 <qb4.dev@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/* Host stand-in for FreeRTOS task.h - tasks are detached pthreads with notification counters */
+#ifndef TASK_H_
+#define TASK_H_
+
+#include "FreeRTOS.h"
+
+typedef void (*TaskFunction_t)(void *arg);
+typedef struct host_task *TaskHandle_t;
+
+#define tskIDLE_PRIORITY 0
+
+BaseType_t xTaskCreate(TaskFunction_t func, const char *name, uint32_t stack_size, void *arg, UBaseType_t priority,
+                       TaskHandle_t *handle);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t   ulTaskNotifyTake(BaseType_t clear, TickType_t ticks);
+void       vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+
+#endif /* TASK_H_ */
@@ -0,0 +1,20 @@
+/*
+ * Copyright (c) 2025 <qb4.dev@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/* Host stand-in for ESP-IDF nvs_flash.h */
+#ifndef NVS_FLASH_H_
+#define NVS_FLASH_H_
+
+#include "nvs.h"
+
+esp_err_t nvs_flash_init(void);
+
+esp_err_t nvs_flash_init_partition(const char *partition_label);
+
+/** @brief Drops all namespaces and entries */
+esp_err_t nvs_flash_erase(void);
+
+#endif /* NVS_FLASH_H_ */
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2025 <qb4.dev@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/* Host build configuration - Kconfig defaults of the settings component */
+#ifndef SDKCONFIG_H_
+#define SDKCONFIG_H_
+
+#define CONFIG_SETTINGS_DATETIME_SUPPORT 1
+#define CONFIG_SETTINGS_TIMEZONE_SUPPORT 1
+#define CONFIG_SETTINGS_COLOR_SUPPORT 1
+#define CONFIG_SETTINGS_NET_SUPPORT 1
+#define CONFIG_SETTINGS_ARRAY_SUPPORT 1
+#define CONFIG_SETTINGS_CBOR_SUPPORT 1
+#define CONFIG_SETTINGS_THREAD_SAFE 1
+#define CONFIG_SETTINGS_NOTIFY_SUPPORT 1
+#define CONFIG_SETTINGS_NOTIFY_MAX_SUBSCRIBERS 8
+#define CONFIG_SETTINGS_NOTIFY_QUEUE_LEN 4
+#define CONFIG_SETTINGS_NOTIFY_TASK_STACK_SIZE 3072
+#define CONFIG_SETTINGS_NOTIFY_TASK_PRIORITY 2
+#define CONFIG_SETTINGS_CALLBACK_SUPPORT 1
+#define CONFIG_SETTINGS_CHANGE_FEED 1
+#define CONFIG_SETTINGS_CHANGE_FEED_LEN 32
+#define CONFIG_SETTINGS_CHANGE_FEED_MAX_WAIT_MS 30000
+#define CONFIG_HTTPD_WS_SUPPORT 1
+#define CONFIG_SETTINGS_WS_PUSH 1
+#define CONFIG_SETTINGS_WS_MAX_CLIENTS 4
+#define CONFIG_SETTINGS_WS_QUEUE_LEN 16
+
+#ifndef CONFIG_SETTINGS_STORAGE_GROUP_BLOB
+#define CONFIG_SETTINGS_STORAGE_PER_KEY 1
+#endif
+
+#ifdef CONFIG_SETTINGS_WRITE_BACK
+#ifndef CONFIG_SETTINGS_WRITE_BACK_QUIET_MS
+#define CONFIG_SETTINGS_WRITE_BACK_QUIET_MS 1000
+#endif
+#ifndef CONFIG_SETTINGS_WRITE_BACK_MAX_DELAY_MS
+#define CONFIG_SETTINGS_WRITE_BACK_MAX_DELAY_MS 10000
+#endif
+#define CONFIG_SETTINGS_WRITE_BACK_TASK_STACK_SIZE 4096
+#define CONFIG_SETTINGS_WRITE_BACK_TASK_PRIORITY 1
+#endif
+
+#ifndef CONFIG_SETTINGS_JSON_CHUNK_SIZE
+#define CONFIG_SETTINGS_JSON_CHUNK_SIZE 256
+#endif
+
+#endif /* SDKCONFIG_H_ */
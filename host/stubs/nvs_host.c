@@ -0,0 +1,475 @@
+/*
+ * Copyright (c) 2025 <qb4.dev@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#include <stdlib.h>
+
+#include <nvs_flash.h>
+
+#define NVS_HOST_ENTRIES    4096 /* power of 2 */
+#define NVS_HOST_NAMESPACES 16
+#define NVS_HOST_ARENA_SIZE (512 * 1024)
+#define NVS_HOST_PART_SIZE  17 /* partition label length + 1 */
+
+#define NVS_HOST_HANDLE_RW 0x100
+
+enum {
+    ENTRY_EMPTY = 0,
+    ENTRY_USED,
+    ENTRY_ERASED
+};
+
+typedef struct {
+    uint8_t  state;
+    uint8_t  ns;
+    uint8_t  type;
+    uint16_t tag; /* bumped when the slot is reused, invalidates old log records */
+    char     key[NVS_KEY_NAME_MAX_SIZE];
+    uint32_t offset; /* value location in the arena */
+    uint32_t size;
+    uint32_t capacity;
+} nvs_host_entry_t;
+
+/* namespaces of all partitions share the entry table */
+typedef struct {
+    char part[NVS_HOST_PART_SIZE];
+    char name[NVS_NS_NAME_MAX_SIZE];
+} nvs_host_ns_t;
+
+/* entries in the order they were added, walked by iterators like flash pages */
+typedef struct {
+    uint16_t slot;
+    uint16_t tag;
+} nvs_host_log_t;
+
+static nvs_host_entry_t    entries[NVS_HOST_ENTRIES];
+static size_t              used_entries;
+static nvs_host_log_t      entry_log[NVS_HOST_ENTRIES * 2];
+static size_t              entry_log_len;
+static nvs_host_ns_t       namespaces[NVS_HOST_NAMESPACES];
+static uint8_t             arena[NVS_HOST_ARENA_SIZE];
+static size_t              arena_used;
+static nvs_host_counters_t counters;
+
+static uint32_t nvs_host_hash(uint8_t ns, const char *key)
+{
+    uint32_t hash = 2166136261u ^ ns;
+
+    for (const char *c = key; *c; c++)
+        hash = (hash ^ (uint8_t)*c) * 16777619u;
+    return hash;
+}
+
+static bool nvs_host_handle_ns(nvs_handle_t handle, uint8_t *ns)
+{
+    uint32_t index = (handle & 0xFF) - 1;
+
+    if (index >= NVS_HOST_NAMESPACES || !namespaces[index].name[0])
+        return false;
+    *ns = index;
+    return true;
+}
+
+/* entry with the key, or NULL and a free slot for it in `insert` */
+static nvs_host_entry_t *nvs_host_find(uint8_t ns, const char *key, nvs_host_entry_t **insert)
+{
+    uint32_t          slot = nvs_host_hash(ns, key) & (NVS_HOST_ENTRIES - 1);
+    nvs_host_entry_t *free_slot = NULL;
+
+    for (size_t probe = 0; probe < NVS_HOST_ENTRIES; probe++, slot = (slot + 1) & (NVS_HOST_ENTRIES - 1)) {
+        nvs_host_entry_t *entry = &entries[slot];
+
+        if (entry->state == ENTRY_EMPTY) {
+            if (!free_slot)
+                free_slot = entry;
+            break;
+        }
+        if (entry->state == ENTRY_ERASED) {
+            if (!free_slot)
+                free_slot = entry;
+            continue;
+        }
+        if (entry->ns == ns && !strcmp(entry->key, key))
+            return entry;
+    }
+    if (insert)
+        *insert = free_slot;
+    return NULL;
+}
+
+static bool nvs_host_log_valid(const nvs_host_log_t *rec)
+{
+    return entries[rec->slot].state == ENTRY_USED && entries[rec->slot].tag == rec->tag;
+}
+
+/* append a new entry, dropping records of erased entries when full (garbage collection) */
+static void nvs_host_log_add(nvs_host_entry_t *entry)
+{
+    if (entry_log_len == sizeof(entry_log) / sizeof(entry_log[0])) {
+        size_t len = 0;
+
+        for (size_t i = 0; i < entry_log_len; i++) {
+            if (nvs_host_log_valid(&entry_log[i]))
+                entry_log[len++] = entry_log[i];
+        }
+        entry_log_len = len;
+    }
+    entry_log[entry_log_len].slot = entry - entries;
+    entry_log[entry_log_len].tag = entry->tag;
+    entry_log_len++;
+}
+
+static esp_err_t nvs_host_set(nvs_handle_t handle, const char *key, nvs_type_t type, const void *value, size_t size)
+{
+    nvs_host_entry_t *entry;
+    nvs_host_entry_t *insert = NULL;
+    uint8_t           ns;
+
+    if (!nvs_host_handle_ns(handle, &ns))
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    if (!(handle & NVS_HOST_HANDLE_RW))
+        return ESP_ERR_NVS_READ_ONLY;
+    if (!key || !*key)
+        return ESP_ERR_NVS_INVALID_NAME;
+    if (strlen(key) >= NVS_KEY_NAME_MAX_SIZE)
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+
+    entry = nvs_host_find(ns, key, &insert);
+    if (!entry) {
+        /* keep the table below 3/4 load like a full partition would refuse writes */
+        if (!insert || used_entries >= NVS_HOST_ENTRIES * 3 / 4)
+            return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+        uint16_t tag = insert->tag + 1;
+
+        entry = insert;
+        memset(entry, 0, sizeof(*entry));
+        entry->ns = ns;
+        entry->tag = tag;
+        strcpy(entry->key, key);
+        used_entries++;
+        nvs_host_log_add(entry);
+    }
+    if (size > entry->capacity) {
+        if (arena_used + size > sizeof(arena)) {
+            if (!entry->capacity) {
+                entry->state = ENTRY_ERASED;
+                used_entries--;
+            }
+            return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+        }
+        entry->offset = arena_used;
+        entry->capacity = size;
+        arena_used += size;
+    }
+    entry->state = ENTRY_USED;
+    entry->type = type;
+    entry->size = size;
+    memcpy(&arena[entry->offset], value, size);
+    counters.writes++;
+    return ESP_OK;
+}
+
+static esp_err_t nvs_host_get(nvs_handle_t handle, const char *key, nvs_type_t type, void *value, size_t *size)
+{
+    nvs_host_entry_t *entry;
+    uint8_t           ns;
+
+    if (!nvs_host_handle_ns(handle, &ns))
+        return ESP_ERR_NVS_INVALID_HANDLE;
+
+    counters.reads++;
+    entry = nvs_host_find(ns, key, NULL);
+    if (!entry || entry->type != type)
+        return ESP_ERR_NVS_NOT_FOUND;
+
+    if (type == NVS_TYPE_STR || type == NVS_TYPE_BLOB) {
+        if (!value) {
+            *size = entry->size;
+            return ESP_OK;
+        }
+        if (*size < entry->size) {
+            *size = entry->size;
+            return ESP_ERR_NVS_INVALID_LENGTH;
+        }
+        *size = entry->size;
+    }
+    memcpy(value, &arena[entry->offset], entry->size);
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_init_partition(const char *partition_label)
+{
+    if (!partition_label || strlen(partition_label) >= NVS_HOST_PART_SIZE)
+        return ESP_ERR_INVALID_ARG;
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    memset(entries, 0, sizeof(entries));
+    memset(namespaces, 0, sizeof(namespaces));
+    used_entries = 0;
+    entry_log_len = 0;
+    arena_used = 0;
+    return ESP_OK;
+}
+
+static int nvs_host_ns_find(const char *part_name, const char *name)
+{
+    for (int i = 0; i < NVS_HOST_NAMESPACES; i++) {
+        if (namespaces[i].name[0] && !strcmp(namespaces[i].part, part_name) && !strcmp(namespaces[i].name, name))
+            return i;
+    }
+    return -1;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+    return nvs_open_from_partition(NVS_DEFAULT_PART_NAME, name, open_mode, out_handle);
+}
+
+esp_err_t nvs_open_from_partition(const char *part_name, const char *name, nvs_open_mode_t open_mode,
+                                  nvs_handle_t *out_handle)
+{
+    int index;
+
+    if (!part_name || strlen(part_name) >= NVS_HOST_PART_SIZE)
+        return ESP_ERR_NVS_PART_NOT_FOUND;
+    if (!name || !*name || strlen(name) >= NVS_NS_NAME_MAX_SIZE)
+        return ESP_ERR_NVS_INVALID_NAME;
+
+    counters.opens++;
+    index = nvs_host_ns_find(part_name, name);
+    if (index < 0) {
+        if (open_mode == NVS_READONLY)
+            return ESP_ERR_NVS_NOT_FOUND;
+        for (int i = 0; i < NVS_HOST_NAMESPACES && index < 0; i++) {
+            if (!namespaces[i].name[0])
+                index = i;
+        }
+        if (index < 0)
+            return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+        strcpy(namespaces[index].part, part_name);
+        strcpy(namespaces[index].name, name);
+    }
+    *out_handle = (index + 1) | (open_mode == NVS_READWRITE ? NVS_HOST_HANDLE_RW : 0);
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    uint8_t ns;
+
+    if (!nvs_host_handle_ns(handle, &ns))
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    counters.commits++;
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key)
+{
+    nvs_host_entry_t *entry;
+    uint8_t           ns;
+
+    if (!nvs_host_handle_ns(handle, &ns))
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    if (!(handle & NVS_HOST_HANDLE_RW))
+        return ESP_ERR_NVS_READ_ONLY;
+
+    entry = nvs_host_find(ns, key, NULL);
+    if (!entry)
+        return ESP_ERR_NVS_NOT_FOUND;
+    entry->state = ENTRY_ERASED;
+    used_entries--;
+    counters.erases++;
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_all(nvs_handle_t handle)
+{
+    uint8_t ns;
+
+    if (!nvs_host_handle_ns(handle, &ns))
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    if (!(handle & NVS_HOST_HANDLE_RW))
+        return ESP_ERR_NVS_READ_ONLY;
+
+    for (size_t i = 0; i < NVS_HOST_ENTRIES; i++) {
+        if (entries[i].state == ENTRY_USED && entries[i].ns == ns) {
+            entries[i].state = ENTRY_ERASED;
+            used_entries--;
+            counters.erases++;
+        }
+    }
+    return ESP_OK;
+}
+
+#define NVS_HOST_INT(name, type, nvs_type)                                           \
+    esp_err_t nvs_set_##name(nvs_handle_t handle, const char *key, type value)       \
+    {                                                                                \
+        return nvs_host_set(handle, key, nvs_type, &value, sizeof(value));           \
+    }                                                                                \
+    esp_err_t nvs_get_##name(nvs_handle_t handle, const char *key, type *out_value)  \
+    {                                                                                \
+        return nvs_host_get(handle, key, nvs_type, out_value, NULL);                 \
+    }
+
+NVS_HOST_INT(i8, int8_t, NVS_TYPE_I8)
+NVS_HOST_INT(u8, uint8_t, NVS_TYPE_U8)
+NVS_HOST_INT(i16, int16_t, NVS_TYPE_I16)
+NVS_HOST_INT(u16, uint16_t, NVS_TYPE_U16)
+NVS_HOST_INT(i32, int32_t, NVS_TYPE_I32)
+NVS_HOST_INT(u32, uint32_t, NVS_TYPE_U32)
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char *key, const char *value)
+{
+    return nvs_host_set(handle, key, NVS_TYPE_STR, value, strlen(value) + 1);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    return nvs_host_set(handle, key, NVS_TYPE_BLOB, value, length);
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *out_value, size_t *length)
+{
+    return nvs_host_get(handle, key, NVS_TYPE_STR, out_value, length);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length)
+{
+    return nvs_host_get(handle, key, NVS_TYPE_BLOB, out_value, length);
+}
+
+esp_err_t nvs_get_stats(const char *part_name, nvs_stats_t *nvs_stats)
+{
+    if (!nvs_stats)
+        return ESP_ERR_INVALID_ARG;
+
+    nvs_stats->used_entries = used_entries;
+    nvs_stats->total_entries = NVS_HOST_ENTRIES * 3 / 4;
+    nvs_stats->free_entries = nvs_stats->total_entries - used_entries;
+    nvs_stats->namespace_count = 0;
+    for (int i = 0; i < NVS_HOST_NAMESPACES; i++)
+        nvs_stats->namespace_count += namespaces[i].name[0] != '\0';
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_used_entry_count(nvs_handle_t handle, size_t *used)
+{
+    uint8_t ns;
+
+    if (!used)
+        return ESP_ERR_INVALID_ARG;
+    if (!nvs_host_handle_ns(handle, &ns))
+        return ESP_ERR_NVS_INVALID_HANDLE;
+
+    *used = 0;
+    for (int i = 0; i < NVS_HOST_ENTRIES; i++)
+        *used += entries[i].state == ENTRY_USED && entries[i].ns == ns;
+    return ESP_OK;
+}
+
+struct nvs_host_iterator {
+    uint8_t    ns;
+    nvs_type_t type;
+    size_t     pos; /* record in entry_log */
+};
+
+/* move to the next matching entry at or after `pos`, every visited record counts as a flash read */
+static esp_err_t nvs_host_iterate(nvs_iterator_t it)
+{
+    for (; it->pos < entry_log_len; it->pos++) {
+        const nvs_host_log_t   *rec = &entry_log[it->pos];
+        const nvs_host_entry_t *entry = &entries[rec->slot];
+
+        counters.reads++;
+        if (!nvs_host_log_valid(rec))
+            continue;
+        if (entry->ns == it->ns && (it->type == NVS_TYPE_ANY || entry->type == it->type))
+            return ESP_OK;
+    }
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_entry_find(const char *part_name, const char *namespace_name, nvs_type_t type,
+                         nvs_iterator_t *output_iterator)
+{
+    nvs_iterator_t it;
+    int            ns = -1;
+
+    if (!output_iterator)
+        return ESP_ERR_INVALID_ARG;
+    *output_iterator = NULL;
+
+    if (part_name && namespace_name)
+        ns = nvs_host_ns_find(part_name, namespace_name);
+    if (ns < 0)
+        return ESP_ERR_NVS_NOT_FOUND;
+
+    it = calloc(1, sizeof(*it));
+    if (!it)
+        return ESP_ERR_NO_MEM;
+    it->ns = ns;
+    it->type = type;
+    if (nvs_host_iterate(it) != ESP_OK) {
+        free(it);
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    *output_iterator = it;
+    return ESP_OK;
+}
+
+esp_err_t nvs_entry_next(nvs_iterator_t *iterator)
+{
+    if (!iterator || !*iterator)
+        return ESP_ERR_INVALID_ARG;
+
+    (*iterator)->pos++;
+    if (nvs_host_iterate(*iterator) != ESP_OK) {
+        free(*iterator);
+        *iterator = NULL;
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    return ESP_OK;
+}
+
+esp_err_t nvs_entry_info(const nvs_iterator_t iterator, nvs_entry_info_t *out_info)
+{
+    const nvs_host_entry_t *entry;
+
+    if (!iterator || !out_info)
+        return ESP_ERR_INVALID_ARG;
+
+    entry = &entries[entry_log[iterator->pos].slot];
+    strcpy(out_info->namespace_name, namespaces[iterator->ns].name);
+    strcpy(out_info->key, entry->key);
+    out_info->type = entry->type;
+    return ESP_OK;
+}
+
+void nvs_release_iterator(nvs_iterator_t iterator)
+{
+    free(iterator);
+}
+
+void nvs_host_get_counters(nvs_host_counters_t *out)
+{
+    *out = counters;
+}
+
+void nvs_host_reset_counters(void)
+{
+    memset(&counters, 0, sizeof(counters));
+}
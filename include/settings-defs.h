@@ -46,6 +46,10 @@ typedef enum {
     SETTING_TYPE_IPADDR,
     SETTING_TYPE_NETIF,
 #endif
+#ifdef CONFIG_SETTINGS_ARRAY_SUPPORT
+    SETTING_TYPE_ARRAY,
+#endif
+    SETTING_TYPE_CUSTOM = 32, //first application type, see settings_type_register()
 } setting_type_t;
 
 /**
@@ -89,11 +93,19 @@ typedef struct {
  * `val` points to a mutable buffer holding the current value, `def`
  * is a read-only null-terminated default string, and `len` is the
  * allocated buffer length available in `val`.
+ *
+ * With `CONFIG_SETTINGS_LAZY_TEXT` a setting declared with `lazy` set and
+ * `val` left NULL gets its buffer of `len` bytes from the heap when the value
+ * is first changed or fetched from NVS. Such values must be read with the
+ * `setting_get_*` getters, `val` is NULL while not loaded.
  */
 typedef struct {
     char       *val;
     const char *def;
     size_t      len;
+#ifdef CONFIG_SETTINGS_LAZY_TEXT
+    bool lazy;
+#endif
 } setting_text_t;
 
 #ifdef CONFIG_SETTINGS_DATETIME_SUPPORT
@@ -166,6 +178,51 @@ typedef struct {
     netif_conf_t def;
 } setting_netif_t;
 
+#ifdef CONFIG_SETTINGS_ARRAY_SUPPORT
+/** @brief Element type of an array setting */
+typedef enum {
+    SETTING_ARRAY_INT16 = 0,
+    SETTING_ARRAY_UINT8,
+    SETTING_ARRAY_FLOAT,
+} setting_array_elem_t;
+
+/**
+ * @brief Array setting representation
+ *
+ * `val` points to a mutable buffer of `len` elements of type `elem` and
+ * `def` to the read-only default of the same length, NULL for all zeros.
+ * The whole array is stored as one NVS blob, e.g. a calibration curve:
+ *
+ * @code
+ * static int16_t curve[256];
+ *
+ * S(CAL, CURVE, "Sensor curve", ARRAY, .array = { .val = curve, .len = 256, .elem = SETTING_ARRAY_INT16 })
+ * @endcode
+ */
+typedef struct {
+    void                *val;
+    const void          *def;
+    uint16_t             len;
+    setting_array_elem_t elem;
+} setting_array_t;
+#endif
+
+#ifdef CONFIG_SETTINGS_CUSTOM_TYPES
+/**
+ * @brief Value of an application defined setting type
+ *
+ * `val` points to a mutable buffer of `size` bytes holding the current value
+ * and `def` to the read-only default of the same size. The value is stored
+ * as an NVS blob and converted to text by the `setting_type_desc_t`
+ * registered for the type with `settings_type_register()`.
+ */
+typedef struct {
+    void       *val;
+    const void *def;
+    size_t      size;
+} setting_custom_t;
+#endif
+
 /**
  * @brief Descriptor for a single setting entry
  *
@@ -173,6 +230,12 @@ typedef struct {
  * - `label`: human-readable label for UI or logs
  * - `type`: one of `setting_type_t` describing active union member
  * - `disabled`: if true, setting is not editable or exposed
+ * - `dirty`: set by the `setting_set_*` setters when the value changed and
+ *   cleared once the value is persisted to NVS
+ * - `changed`: set together with `dirty` and cleared once the change is
+ *   published to subscribers by `settings_notify()`
+ * - `nvs_id`: NVS storage key "group:id", built at compile time by the
+ *   `SETTINGS_ITEM()` macro or by `settings_pack_update_nvs_ids()` if left NULL
  * - union: contains the typed current value and default/meta information
  */
 struct setting {
@@ -180,7 +243,11 @@ struct setting {
     const char    *label; //more descriptive
     setting_type_t type;
     bool           disabled;
-    char           nvs_id[SETTINGS_NVS_ID_LEN];
+    bool           dirty;
+#ifdef CONFIG_SETTINGS_NOTIFY_SUPPORT
+    bool changed;
+#endif
+    const char *nvs_id; //"group:id" key, set by SETTINGS_ITEM() or at runtime
 
     union {
         setting_bool_t  boolean;
@@ -202,6 +269,12 @@ struct setting {
 #ifdef CONFIG_SETTINGS_NET_SUPPORT
         setting_ipaddr_t ipaddr;
         setting_netif_t  netif;
+#endif
+#ifdef CONFIG_SETTINGS_ARRAY_SUPPORT
+        setting_array_t array;
+#endif
+#ifdef CONFIG_SETTINGS_CUSTOM_TYPES
+        setting_custom_t custom;
 #endif
     };
 
@@ -223,4 +296,46 @@ typedef struct settings_group {
     setting_t  *settings;
 } settings_group_t;
 
+/**
+ * @brief Compile-time settings declaration helpers
+ *
+ * Settings of a group are listed once in an X-macro list, each entry as
+ * `S(GROUP, ID, label, TYPE, value initializers...)` where GROUP and ID are
+ * bare tokens and TYPE is the `setting_type_t` suffix:
+ *
+ * @code
+ * #define DEV_SETTINGS(S)                                                              \
+ *     S(DEV, ENABLED, "Device enabled", BOOL, .boolean = { .val = true, .def = true }) \
+ *     S(DEV, DISPBR, "Display brightness", NUM, .num = { .val = 5, .def = 5, .range = { 1, 7 } })
+ *
+ * SETTINGS_GROUP_ITEMS(device_settings_items, DEV_SETTINGS);
+ *
+ * static const settings_group_t app_settings[] = {
+ *     SETTINGS_GROUP(DEV, "Device", device_settings_items),
+ *     {}
+ * };
+ * @endcode
+ *
+ * The NVS key of every setting is a string literal in rodata, so nothing is
+ * built at boot. Keys that do not fit into an NVS key and IDs repeated in
+ * the same group are compile errors.
+ */
+#define SETTINGS_NVS_KEY(GR, ID) #GR ":" #ID
+
+#define SETTINGS_ITEM(GR, ID, LABEL, TYPE, ...) \
+    { .id = #ID, .label = LABEL, .type = SETTING_TYPE_##TYPE, .nvs_id = SETTINGS_NVS_KEY(GR, ID), __VA_ARGS__ },
+
+#define SETTING_KEY_CHECK(GR, ID, ...)                                             \
+    _Static_assert(sizeof(SETTINGS_NVS_KEY(GR, ID)) - 1 < SETTINGS_NVS_ID_LEN - 1, \
+                   "NVS key too long: " SETTINGS_NVS_KEY(GR, ID));
+
+#define SETTING_ID_ENUM(GR, ID, ...) SETTING_ID_##GR##_##ID,
+
+#define SETTINGS_GROUP_ITEMS(NAME, LIST)          \
+    LIST(SETTING_KEY_CHECK)                       \
+    enum { LIST(SETTING_ID_ENUM) NAME##_count_ }; \
+    static setting_t NAME[] = { LIST(SETTINGS_ITEM) {} }
+
+#define SETTINGS_GROUP(GR, LABEL, ITEMS) { .id = #GR, .label = LABEL, .settings = ITEMS }
+
 #endif /* SETTINGS_DEF_H_ */
@@ -9,6 +9,7 @@
 
 #include <esp_err.h>
 #include <esp_http_server.h>
+#include <nvs.h>
 
 #include "settings-defs.h"
 
@@ -25,15 +26,166 @@
  */
 typedef esp_err_t (*settings_handler_t)(const settings_group_t *settings, void *arg);
 
+#ifdef CONFIG_SETTINGS_NOTIFY_SUPPORT
+/** @brief Bit of a built-in `setting_type_t` in `settings_filter_t::types` */
+#define SETTING_TYPE_MASK(type) (1u << (type))
+
+/**
+ * @brief Selects the changes delivered to a subscriber.
+ *
+ * Every member narrows the selection, NULL or 0 matches anything. The ID
+ * strings are referenced, not copied, and must stay valid while subscribed.
+ */
+typedef struct {
+    const char *group_id;   //group ID or NULL
+    const char *setting_id; //setting ID or NULL
+    uint32_t    types;      //SETTING_TYPE_MASK() bits or 0
+} settings_filter_t;
+
+/** @brief A changed setting together with its group */
+typedef struct {
+    const settings_group_t *group;
+    setting_t              *setting;
+} settings_change_t;
+
+/**
+ * @brief Subscriber callback receiving changed settings.
+ *
+ * Called from the notification task with the changes published by one
+ * `settings_notify()` call that match the subscriber filter. The array is
+ * only valid during the call, read values with the `setting_get_*` getters.
+ *
+ * @param changes Changed settings, each listed once.
+ * @param count Number of entries in @p changes, never 0.
+ * @param arg User-defined argument given to `settings_subscribe()`.
+ */
+typedef void (*settings_notify_cb_t)(const settings_change_t *changes, size_t count, void *arg);
+#endif
+
+/**
+ * @brief Persistence counters collected by `settings_nvs_write()`.
+ *
+ * `written` counts settings stored to NVS because they were dirty and
+ * `skipped` counts settings left untouched because they did not change
+ * since the last successful write.
+ */
+typedef struct {
+    uint32_t written;
+    uint32_t skipped;
+} settings_nvs_stats_t;
+
+/**
+ * @brief NVS write transaction over a settings pack.
+ *
+ * Holds a single NVS handle for the whole batch. Fill it with
+ * `settings_txn_begin()`, apply changes with the `setting_set_*` setters
+ * and finish with `settings_txn_commit()` or `settings_txn_abort()`.
+ */
+typedef struct {
+    const settings_group_t *pack;
+    nvs_handle_t            nvs;
+} settings_txn_t;
+
+/** @brief Operations timed by `CONFIG_SETTINGS_METRICS` */
+typedef enum {
+    SETTINGS_METRIC_NVS_READ,         //settings_nvs_read()
+    SETTINGS_METRIC_NVS_WRITE,        //settings_txn_commit(), also used by settings_nvs_write()
+    SETTINGS_METRIC_NVS_WRITE_SINGLE, //setting_nvs_write_single()
+    SETTINGS_METRIC_SERIALIZE,        //JSON or CBOR response, including sending it
+    SETTINGS_METRIC_PARSE,            //form, JSON or CBOR update body
+    SETTINGS_METRIC_OP_COUNT
+} settings_metric_op_t;
+
+#ifdef CONFIG_SETTINGS_METRICS
+/** @brief Latency histogram buckets, bucket `i > 0` counts durations from 2^(i+3) to 2^(i+4) us */
+#define SETTINGS_METRICS_BUCKETS 16
+
+/** @brief Call counters and latency of one operation */
+typedef struct {
+    uint32_t count;
+    uint32_t errors;
+    uint64_t total_us;
+    uint32_t max_us;
+    uint32_t hist[SETTINGS_METRICS_BUCKETS];
+} settings_op_metrics_t;
+
+/**
+ * @brief Runtime metrics collected since boot or `settings_metrics_reset()`.
+ *
+ * `http_heap_peak` is the largest drop of free heap below its level at the
+ * start of an HTTP request, sampled after the request body is read, on
+ * every response chunk sent and before a save frees its undo log. It is an
+ * approximation: allocations between the samples are missed, and requests
+ * served in parallel or saves outside a request share one start level.
+ */
+typedef struct {
+    settings_op_metrics_t ops[SETTINGS_METRIC_OP_COUNT];
+    uint32_t              nvs_keys_written;
+    uint32_t              nvs_bytes_written;
+    uint32_t              nvs_commits;
+    uint32_t              http_heap_peak;
+} settings_metrics_t;
+#endif
+
+#ifdef CONFIG_SETTINGS_WEAR_STATS
+/**
+ * @brief Flash wear report of one settings pack.
+ *
+ * Write counters, per pack, per setting and the hot keys, are kept in RAM
+ * only: they cover the time since boot and start over at every reset. NVS
+ * stores values in 32 byte entries and erases a page once its entries are
+ * used up, `entries` estimates how many entries the writes consumed.
+ * `lifetime_days` projects how long the partition still lasts at the write
+ * rate of all packs stored in it since boot, assuming it was new at boot,
+ * NVS spreads the erases over all pages and every page survives
+ * `CONFIG_SETTINGS_WEAR_ERASE_CYCLES` of them.
+ */
+typedef struct {
+    uint32_t uptime_s;          //time covered by the write counters
+    uint32_t writes;            //NVS keys written by this pack
+    uint32_t bytes;             //value bytes written by this pack
+    uint32_t entries;           //NVS entries consumed by this pack
+    uint32_t partition_entries; //NVS entries consumed by all packs in the same partition
+    uint32_t hot_keys;          //settings written `CONFIG_SETTINGS_WEAR_HOT_WRITES` times within this hour
+    uint32_t ns_entries;        //entries used by the pack namespace
+    uint32_t used_entries;      //entries used in the partition
+    uint32_t free_entries;      //entries free in the partition
+    uint32_t total_entries;     //entries of the partition
+    uint32_t lifetime_days;     //projected remaining partition lifetime, UINT32_MAX when nothing was written
+} settings_wear_t;
+#endif
+
+/**
+ * @brief Storage and handler of one settings pack.
+ *
+ * Independent packs (e.g. device and per-channel configuration) each get a
+ * context with their own NVS namespace, optionally on a dedicated NVS
+ * partition kept apart from Wi-Fi and other NVS users, and their own
+ * handler. Fill in the members and call `settings_ctx_init()` before the
+ * pack is first read. Packs without a context use the "settings_nvs"
+ * namespace of the default partition and the global handler, a context
+ * must set a different namespace or partition.
+ */
+typedef struct {
+    const settings_group_t *pack;          //settings pack, must not be NULL
+    const char             *nvs_namespace; //NVS namespace or NULL for "settings_nvs"
+    const char             *partition;     //NVS partition label or NULL for the default partition
+    settings_handler_t      handler;       //called instead of the global handler, may be NULL
+    void                   *handler_arg;
+} settings_ctx_t;
+
 /**
  * @brief Update NVS IDs for all settings in the provided pack.
  *
  * Iterates through the provided @p pack and constructs NVS IDs for
  * each setting in the format "group_id:setting_id", storing them
- * in the `nvs_id` member of each `setting_t`.
+ * in the `nvs_id` member of each `setting_t`. On first call for a pack
+ * it also builds the hash index used by `settings_pack_find()`.
  *
  * @param pack Pointer to the settings group to update. Must not be NULL.
- * @return setting_t* Always returns NULL.
+ * @return esp_err_t ESP_OK on success, ESP_ERR_INVALID_ARG if a key is too
+ *         long or, with `CONFIG_SETTINGS_STORAGE_GROUP_BLOB`, a value can exceed
+ *         65535 bytes, ESP_ERR_NO_MEM if the index could not be allocated.
  */
 esp_err_t settings_pack_update_nvs_ids(const settings_group_t *pack);
 
@@ -53,6 +205,10 @@ void settings_pack_print(const settings_group_t *settings);
  * Searches the provided settings pack for a setting that belongs to the
  * group named @p gr and has the identifier @p id.
  *
+ * Once the pack was indexed by `settings_pack_update_nvs_ids()` (done by
+ * `settings_nvs_read()`) the lookup is a constant time hash probe,
+ * otherwise the pack is scanned linearly.
+ *
  * @param settings Pointer to the settings pack to search. Must not be NULL.
  * @param gr Null-terminated group name to search for.
  * @param id Null-terminated setting identifier to search for.
@@ -94,6 +250,151 @@ void setting_set_ipaddr(setting_t *setting, const ipaddr_t *ipaddr);
 void setting_set_netif(setting_t *setting, const netif_conf_t *netif);
 #endif
 
+/**
+ * @brief Read the value of setting based on its type.
+ *
+ * Safe to call from any task while other tasks update settings: the value
+ * is copied without taking a lock and the copy is retried if an update
+ * happened meanwhile, so the result is never torn. Text getters copy at
+ * most @p buf_len - 1 characters, always terminate @p buf and return the
+ * copied length. Lazy text settings (`CONFIG_SETTINGS_LAZY_TEXT`) are read
+ * under the settings lock and fetched from NVS by the first call.
+ */
+bool   setting_get_bool(const setting_t *setting);
+int    setting_get_num(const setting_t *setting);
+int    setting_get_oneof(const setting_t *setting);
+size_t setting_get_text(const setting_t *setting, char *buf, size_t buf_len);
+#ifdef CONFIG_SETTINGS_DATETIME_SUPPORT
+void setting_get_time(const setting_t *setting, setting_time_t *time);
+void setting_get_date(const setting_t *setting, setting_date_t *date);
+void setting_get_datetime(const setting_t *setting, setting_datetime_t *datetime);
+#endif
+#ifdef CONFIG_SETTINGS_TIMEZONE_SUPPORT
+size_t setting_get_timezone(const setting_t *setting, char *buf, size_t buf_len);
+#endif
+#ifdef CONFIG_SETTINGS_COLOR_SUPPORT
+void setting_get_color(const setting_t *setting, color_t *color);
+#endif
+#ifdef CONFIG_SETTINGS_NET_SUPPORT
+void setting_get_ipaddr(const setting_t *setting, ipaddr_t *ipaddr);
+void setting_get_netif(const setting_t *setting, netif_conf_t *netif);
+#endif
+
+#ifdef CONFIG_SETTINGS_ARRAY_SUPPORT
+/**
+ * @brief Update or read a range of an array setting.
+ *
+ * Copies @p count elements starting at element @p offset from or to
+ * @p vals, which holds elements of the setting's `elem` type. Writing a
+ * range marks the setting changed only if an element differs, the next NVS
+ * write stores the whole array. Reads follow the same lock-free rules as
+ * the other `setting_get_*` getters.
+ *
+ * @return ESP_OK or ESP_ERR_INVALID_ARG if the range exceeds the array.
+ */
+esp_err_t setting_set_array(setting_t *setting, size_t offset, const void *vals, size_t count);
+esp_err_t setting_get_array(const setting_t *setting, size_t offset, void *vals, size_t count);
+#endif
+
+#ifdef CONFIG_SETTINGS_CUSTOM_TYPES
+/**
+ * @brief Text conversion of an application defined setting type
+ *
+ * - `name`: "type" reported in the JSON schema
+ * - `format`: write the value @p val as a null-terminated string of at most
+ *   @p size bytes into @p buf, return false if it does not fit
+ * - `parse`: convert @p text into @p val, which holds the current value on
+ *   entry, return false to reject the text and keep the setting unchanged
+ *
+ * Both are called with the setting of the registered type and a value of
+ * `setting->custom.size` bytes.
+ */
+typedef struct {
+    const char *name;
+    bool (*format)(const setting_t *setting, const void *val, char *buf, size_t size);
+    bool (*parse)(const setting_t *setting, const char *text, void *val);
+} setting_type_desc_t;
+
+/**
+ * @brief Register an application defined setting type.
+ *
+ * Settings declared with @p type keep their value in the `custom` member,
+ * are persisted as NVS blobs and exchanged as strings in JSON, CBOR and form
+ * bodies. Register types before loading settings from NVS, the descriptor is
+ * referenced, not copied.
+ *
+ * @param type `SETTING_TYPE_CUSTOM` up to `SETTING_TYPE_CUSTOM` +
+ *        `CONFIG_SETTINGS_CUSTOM_TYPES_MAX` - 1.
+ * @param desc Conversion functions of the type.
+ * @return ESP_OK, ESP_ERR_INVALID_ARG for a type out of range or an
+ *         incomplete descriptor, ESP_ERR_INVALID_STATE if already registered.
+ */
+esp_err_t settings_type_register(setting_type_t type, const setting_type_desc_t *desc);
+
+/**
+ * @brief Update or read the value of an application defined setting.
+ *
+ * @p val holds `setting->custom.size` bytes. Reads follow the same lock-free
+ * rules as the other `setting_get_*` getters.
+ */
+void setting_set_custom(setting_t *setting, const void *val);
+void setting_get_custom(const setting_t *setting, void *val);
+#endif
+
+#ifdef CONFIG_SETTINGS_LAZY_TEXT
+/**
+ * @brief Release the cached value of a lazy text setting.
+ *
+ * The value is fetched from NVS again on next access. Values changed but not
+ * yet written to NVS are kept.
+ *
+ * @param setting Text or timezone setting declared with `.lazy = true`.
+ * @return ESP_OK, ESP_ERR_INVALID_ARG if the setting is not lazy or
+ *         ESP_ERR_INVALID_STATE if the value is not persisted yet.
+ */
+esp_err_t setting_text_evict(setting_t *setting);
+#endif
+
+/**
+ * @brief Serialize settings writers.
+ *
+ * Setters, NVS transactions and HTTP updates take this recursive lock
+ * internally. Hold it to apply several changes as one update for other
+ * writers, or to read text buffers in place. Readers using the
+ * `setting_get_*` functions never wait for it, except while a single value
+ * update is in progress. No-op without CONFIG_SETTINGS_THREAD_SAFE.
+ */
+void settings_lock(void);
+void settings_unlock(void);
+
+/**
+ * @brief Read several values as one consistent snapshot without locking.
+ *
+ * @code
+ * uint32_t seq;
+ * do {
+ *     seq = settings_read_begin();
+ *     hh = alarm->time.hh;
+ *     mm = alarm->time.mm;
+ *     on = enabled->boolean.val;
+ * } while (settings_read_retry(seq));
+ * @endcode
+ *
+ * Values read between the two calls may be inconsistent and must not be
+ * used before `settings_read_retry()` returned false.
+ *
+ * @return uint32_t Sequence to pass to `settings_read_retry()`.
+ */
+uint32_t settings_read_begin(void);
+
+/**
+ * @brief Check whether values read since `settings_read_begin()` must be read again.
+ *
+ * @param seq Sequence returned by `settings_read_begin()`.
+ * @return true if a setting was updated meanwhile.
+ */
+bool settings_read_retry(uint32_t seq);
+
 /**
  * @brief Initialize all settings in a settings pack to their defaults.
  *
@@ -104,6 +405,16 @@ void setting_set_netif(setting_t *setting, const netif_conf_t *netif);
  */
 void settings_pack_set_defaults(const settings_group_t *settings_pack);
 
+/**
+ * @brief Mark all settings in a settings pack as dirty.
+ *
+ * Forces the next `settings_nvs_write()` to persist every setting, e.g.
+ * after values were modified directly instead of through the setters.
+ *
+ * @param settings_pack Pointer to the settings pack to mark. Must not be NULL.
+ */
+void settings_pack_mark_dirty(const settings_group_t *settings_pack);
+
 /**
  * @brief Read settings from NVS into the provided settings pack.
  *
@@ -121,22 +432,130 @@ esp_err_t settings_nvs_read(const settings_group_t *settings);
  * Persists the provided @p setting to non-volatile storage so it
  * survives reboots.
  *
+ * With `CONFIG_SETTINGS_STORAGE_GROUP_BLOB` the whole group blob of the
+ * setting is written, which needs the pack index built by
+ * settings_nvs_read() or settings_pack_update_nvs_ids() first.
+ *
  * @param setting Pointer to the setting to persist. Must not be NULL.
- * @return esp_err_t ESP_OK on success; otherwise an error code from esp_err.h.
+ * @return esp_err_t ESP_OK on success; ESP_ERR_INVALID_STATE in the group blob
+ *         layout when the setting is in no indexed pack; otherwise an error code from esp_err.h.
  */
 esp_err_t setting_nvs_write_single(setting_t *setting);
 
 /**
  * @brief Write the provided settings pack to NVS.
  *
- * Persists all relevant settings contained in @p settings to non-volatile
- * storage so they survive reboots.
+ * Persists settings contained in @p settings to non-volatile storage so
+ * they survive reboots. Only settings marked dirty since the last
+ * successful write are stored, unchanged ones are skipped.
  *
  * @param settings Pointer to the settings pack to persist. Must not be NULL.
  * @return esp_err_t ESP_OK on success; otherwise an error code from esp_err.h.
  */
 esp_err_t settings_nvs_write(const settings_group_t *settings);
 
+/**
+ * @brief Begin a batched NVS write transaction.
+ *
+ * Opens the settings namespace once for the whole batch. Settings changed
+ * with the setters until `settings_txn_commit()` are persisted together.
+ * The writer lock is held until the transaction is committed or aborted.
+ *
+ * @param txn Pointer to the transaction to initialize. Must not be NULL.
+ * @param settings Pointer to the settings pack the batch applies to. Must not be NULL.
+ * @return esp_err_t ESP_OK on success; otherwise an error code from esp_err.h.
+ */
+esp_err_t settings_txn_begin(settings_txn_t *txn, const settings_group_t *settings);
+
+/**
+ * @brief Persist all dirty settings of the transaction and close it.
+ *
+ * Writes every dirty setting through the transaction handle and issues a
+ * single `nvs_commit()`. If any write fails, keys already written by this
+ * batch are restored to their previous contents, so NVS is left unchanged
+ * and the settings remain dirty.
+ *
+ * @param txn Pointer to a transaction started with `settings_txn_begin()`.
+ * @return esp_err_t ESP_OK on success; otherwise an error code from esp_err.h.
+ */
+esp_err_t settings_txn_commit(settings_txn_t *txn);
+
+/**
+ * @brief Discard the transaction and close it.
+ *
+ * Nothing is written to NVS. Dirty settings are reverted to their stored
+ * values, or to defaults when nothing is stored.
+ *
+ * @param txn Pointer to a transaction started with `settings_txn_begin()`.
+ */
+void settings_txn_abort(settings_txn_t *txn);
+
+/**
+ * @brief Get persistence counters collected since boot or last reset.
+ *
+ * @param stats Pointer to the structure to fill. Must not be NULL.
+ * @return esp_err_t ESP_OK on success, ESP_ERR_INVALID_ARG if @p stats is NULL.
+ */
+esp_err_t settings_nvs_get_stats(settings_nvs_stats_t *stats);
+
+/**
+ * @brief Reset persistence counters to zero.
+ */
+void settings_nvs_reset_stats(void);
+
+#ifdef CONFIG_SETTINGS_METRICS
+/**
+ * @brief Get a copy of the runtime metrics.
+ *
+ * @param metrics Destination, must not be NULL.
+ * @return esp_err_t ESP_OK on success, ESP_ERR_INVALID_ARG if @p metrics is NULL.
+ */
+esp_err_t settings_metrics_get(settings_metrics_t *metrics);
+
+/** @brief Reset all runtime metrics to zero. */
+void settings_metrics_reset(void);
+#endif
+
+#ifdef CONFIG_SETTINGS_WEAR_STATS
+/**
+ * @brief Get the flash wear report of a settings pack.
+ *
+ * @param settings_pack Pointer to the settings pack.
+ * @param wear Destination, must not be NULL.
+ * @return esp_err_t ESP_OK on success, ESP_ERR_INVALID_ARG for NULL arguments,
+ *         ESP_ERR_INVALID_STATE if the pack was not used yet; otherwise an error of `nvs_get_stats()`.
+ */
+esp_err_t settings_wear_get(const settings_group_t *settings_pack, settings_wear_t *wear);
+
+/**
+ * @brief Get the NVS write counters of one setting.
+ *
+ * With `CONFIG_SETTINGS_STORAGE_GROUP_BLOB` every group blob write counts
+ * for the settings that were changed by it.
+ *
+ * Counters are kept in RAM and reset at boot.
+ *
+ * @param setting Pointer to the setting.
+ * @param writes Writes since boot, may be NULL.
+ * @param hour_writes Writes within the current hour since boot, may be NULL.
+ * @return esp_err_t ESP_OK on success, ESP_ERR_NOT_FOUND if the setting belongs to no used pack.
+ */
+esp_err_t setting_wear_get(const setting_t *setting, uint32_t *writes, uint32_t *hour_writes);
+#endif
+
+/**
+ * @brief Store pending changes of the packs loaded by `settings_nvs_read()`.
+ *
+ * Same as `settings_nvs_write()` on each of them. With
+ * `CONFIG_SETTINGS_WRITE_BACK` it forces the delayed write without waiting
+ * for the write-back task, which also calls it from an `esp_restart()`
+ * shutdown handler.
+ *
+ * @return esp_err_t ESP_OK on success, ESP_ERR_INVALID_STATE if no pack was loaded,
+ *         otherwise the first error code from `settings_nvs_write()`.
+ */
+esp_err_t settings_flush(void);
+
 /**
  * @brief Erase all settings stored in NVS.
  *
@@ -161,15 +580,253 @@ esp_err_t settings_nvs_erase(settings_group_t *settings);
  */
 esp_err_t settings_handler_register(settings_handler_t handler, void *arg);
 
+/**
+ * @brief Bind a context to its settings pack.
+ *
+ * Initializes the context partition (`nvs_flash_init_partition()`) and
+ * builds the pack index. From then on every function taking the pack or
+ * one of its settings, including the HTTP handlers, uses the context
+ * namespace, partition and handler. `settings_flush()` and the write-back
+ * task store all packs read by `settings_nvs_read()`.
+ *
+ * @param ctx Context to bind, must stay valid while the pack is in use.
+ * @return esp_err_t ESP_OK on success, ESP_ERR_INVALID_ARG for a missing pack, an
+ *         invalid namespace or the "settings_nvs" namespace of the default partition
+ *         used by packs without a context, ESP_ERR_INVALID_STATE if the pack already has another
+ *         context or another context uses the same namespace and partition,
+ *         otherwise an error from the partition initialization.
+ */
+esp_err_t settings_ctx_init(settings_ctx_t *ctx);
+
+/** @brief Same as `settings_nvs_read()` on the context pack */
+esp_err_t settings_ctx_nvs_read(settings_ctx_t *ctx);
+
+/** @brief Same as `settings_nvs_write()` on the context pack */
+esp_err_t settings_ctx_nvs_write(settings_ctx_t *ctx);
+
+/** @brief Same as `settings_nvs_erase()` on the context pack, erases only its namespace */
+esp_err_t settings_ctx_nvs_erase(settings_ctx_t *ctx);
+
+/**
+ * @brief Register the handler of a context.
+ *
+ * Invoked for the context pack instead of the handler given to
+ * `settings_handler_register()`, which keeps serving packs without one.
+ *
+ * @param ctx Context initialized by `settings_ctx_init()`.
+ * @param handler Handler to register, NULL to fall back to the global one.
+ * @param arg User-defined argument passed to the handler when invoked.
+ * @return esp_err_t ESP_OK on success, ESP_ERR_INVALID_ARG if @p ctx is NULL.
+ */
+esp_err_t settings_ctx_handler_register(settings_ctx_t *ctx, settings_handler_t handler, void *arg);
+
+#ifdef CONFIG_SETTINGS_NOTIFY_SUPPORT
+/**
+ * @brief Subscribe to setting changes.
+ *
+ * Settings changed through the `setting_set_*` setters are collected until
+ * `settings_notify()` publishes them, then @p cb is called from the
+ * notification task with those that match @p filter. The first subscription
+ * starts the task.
+ *
+ * @param filter Changes to deliver, NULL for all of them. Copied.
+ * @param cb Callback to invoke. Must not be NULL.
+ * @param arg User-defined argument passed to @p cb.
+ * @return esp_err_t ESP_OK on success, ESP_ERR_INVALID_ARG if @p cb is NULL,
+ *         ESP_ERR_NO_MEM if all subscriber slots are taken or the task could not be started.
+ */
+esp_err_t settings_subscribe(const settings_filter_t *filter, settings_notify_cb_t cb, void *arg);
+
+/**
+ * @brief Remove a subscription added by `settings_subscribe()`.
+ *
+ * A notification already being dispatched may still reach the callback.
+ *
+ * @param cb Callback given to `settings_subscribe()`.
+ * @param arg Argument given to `settings_subscribe()`.
+ * @return esp_err_t ESP_OK on success, ESP_ERR_NOT_FOUND if there is no such subscription.
+ */
+esp_err_t settings_unsubscribe(settings_notify_cb_t cb, void *arg);
+
+/**
+ * @brief Publish settings changed since the previous call to subscribers.
+ *
+ * Queues the list of changed settings for the notification task and returns
+ * without waiting for subscribers. The HTTP handlers call it after every
+ * update and erase, application code calls it after a batch of setter calls.
+ * Values loaded by `settings_nvs_read()` are not reported.
+ *
+ * @param settings_pack Pointer to the settings pack. Must not be NULL.
+ * @return esp_err_t ESP_OK on success or when nothing changed, ESP_ERR_NO_MEM if the
+ *         list could not be allocated, ESP_ERR_TIMEOUT if the queue is full. Changes
+ *         that were not queued are published by the next call.
+ */
+esp_err_t settings_notify(const settings_group_t *settings_pack);
+#endif
+
+#ifdef CONFIG_SETTINGS_CBOR_SUPPORT
+/**
+ * @brief Setting type codes used by CBOR responses
+ *
+ * CBOR documents have the same structure and keys as the JSON ones, with
+ * `type` sent as one of these codes, colors as 0xRRGGBB, IPv4 addresses as
+ * 32-bit integers with the first octet in the most significant byte and
+ * booleans and numbers as native CBOR values. Application defined types are
+ * sent with their `setting_type_t` value as code.
+ */
+#define SETTINGS_CBOR_TYPE_BOOL     0
+#define SETTINGS_CBOR_TYPE_NUM      1
+#define SETTINGS_CBOR_TYPE_ONEOF    2
+#define SETTINGS_CBOR_TYPE_TEXT     3
+#define SETTINGS_CBOR_TYPE_TIME     4
+#define SETTINGS_CBOR_TYPE_DATE     5
+#define SETTINGS_CBOR_TYPE_DATETIME 6
+#define SETTINGS_CBOR_TYPE_TIMEZONE 7
+#define SETTINGS_CBOR_TYPE_COLOR    8
+#define SETTINGS_CBOR_TYPE_IPADDR   9
+#define SETTINGS_CBOR_TYPE_NETIF    10
+#define SETTINGS_CBOR_TYPE_ARRAY    11
+
+#define SETTINGS_HTTPD_TYPE_CBOR "application/cbor"
+#endif
+
 /**
  * @brief HTTP server handler for serving or updating settings.
  *
  * This function is intended to be used as an ESP HTTPD request handler
  * and implements the settings HTTP endpoint.
  *
+ * The `group` and `keys` query parameters limit the response to some
+ * settings: `?group=NET` selects whole groups and `?keys=DEV:DISPBR,SAFE:VOLT_TH`
+ * single settings, both take comma separated lists and may be combined.
+ * The schema and values handlers accept the same selectors.
+ *
+ * Updates are read as form data, or with `Content-Type: application/json`
+ * as a JSON object of group IDs to objects of setting IDs to values shaped
+ * like in the values response. A JSON update changes only the settings it
+ * lists, `null` resets a setting to its default.
+ *
+ * With `CONFIG_SETTINGS_CBOR_SUPPORT` all settings handlers respond with
+ * CBOR when the `Accept` header lists `application/cbor`. Updates posted
+ * with `Content-Type: application/cbor` are a map of group IDs to maps of
+ * setting IDs to values, only the listed settings are changed. Time, date,
+ * datetime and netif values are maps with the fields of the JSON response.
+ *
+ * An update is applied as a whole or not at all: a body that does not parse
+ * is answered with 400 and a failed NVS write with 500, both leave the
+ * settings as they were.
+ *
  * @param req Pointer to the HTTP request provided by the ESP HTTP server.
  * @return esp_err_t ESP_OK if the request was handled successfully; otherwise an error code.
  */
 esp_err_t settings_httpd_handler(httpd_req_t *req);
 
+/**
+ * @brief HTTP server handler serving the static settings schema.
+ *
+ * Responds with labels, types, defaults, ranges, options and lengths of
+ * all settings, without current values. The schema does not change at
+ * runtime, so the response carries a strong ETag derived from its content
+ * and conditional requests (`If-None-Match`) are answered with 304.
+ *
+ * @param req Pointer to the HTTP request, `user_ctx` must point to the settings pack.
+ * @return esp_err_t ESP_OK if the request was handled successfully; otherwise an error code.
+ */
+esp_err_t settings_schema_httpd_handler(httpd_req_t *req);
+
+/**
+ * @brief HTTP server handler serving current setting values only.
+ *
+ * Responds with the `id` and current value fields of every setting plus
+ * the `gen` generation token. The ETag follows the generation counter
+ * and a random per-boot epoch, so polling clients get 304 until a setting
+ * changes and an ETag from before a reboot never matches. The device clock
+ * reported by datetime settings does not bump the generation. With the
+ * `group` and `keys` selectors only the matching settings are sent, see
+ * settings_httpd_handler().
+ *
+ * With `CONFIG_SETTINGS_CHANGE_FEED`, `?since=<gen>` answers with only the
+ * settings changed after the `gen` token of an earlier response, the
+ * response then carries `since` next to the current `gen`. Tokens are
+ * "<epoch>-<generation>" with a random per-boot epoch. Clients that fell
+ * more than `CONFIG_SETTINGS_CHANGE_FEED_LEN` changes behind, or hold a
+ * token from before a reboot, get a full snapshot without `since`. Adding
+ * `&wait=<ms>` holds the request until something changes or the time is
+ * up, a token from before a reboot is answered at once. A held request is
+ * detached from the server task with `httpd_req_async_handler_begin()` and
+ * keeps its socket open meanwhile. Without async handlers (ESP-IDF before
+ * 5.1) `wait` is ignored.
+ *
+ * @param req Pointer to the HTTP request, `user_ctx` must point to the settings pack.
+ * @return esp_err_t ESP_OK if the request was handled successfully; otherwise an error code.
+ */
+esp_err_t settings_values_httpd_handler(httpd_req_t *req);
+
+#ifdef CONFIG_SETTINGS_WS_PUSH
+/**
+ * @brief Websocket handler pushing setting changes to connected clients.
+ *
+ * Register with `is_websocket = true` and `user_ctx` pointing to the
+ * settings pack. A new client first gets a snapshot shaped like the values
+ * response, then a delta with `gen`, `since` and the changed settings
+ * whenever a `setting_set_*` setter changes a value. Changes made while a
+ * message is being sent are merged into the next one. A client that falls
+ * more than `CONFIG_SETTINGS_WS_QUEUE_LEN` settings behind gets a full
+ * snapshot again. Messages from clients are ignored.
+ *
+ * @param req Pointer to the HTTP request, `user_ctx` must point to the settings pack.
+ * @return esp_err_t ESP_OK if the request was handled successfully; otherwise an error code.
+ */
+esp_err_t settings_ws_httpd_handler(httpd_req_t *req);
+#endif
+
+#ifdef CONFIG_SETTINGS_METRICS
+/**
+ * @brief HTTP server handler serving the runtime metrics.
+ *
+ * Responds with an object holding `count`, `errors`, `avg_us`, `max_us` and
+ * the `hist` latency buckets of every operation, keyed by `nvs_read`,
+ * `nvs_write`, `nvs_write_single`, `serialize` and `parse`, plus the NVS
+ * and heap counters of `settings_metrics_t`. CBOR is served like for the
+ * settings handlers. `?reset=1` clears the metrics after responding.
+ *
+ * @param req Pointer to the HTTP request.
+ * @return esp_err_t ESP_OK if the request was handled successfully; otherwise an error code.
+ */
+esp_err_t settings_metrics_httpd_handler(httpd_req_t *req);
+#endif
+
+#ifdef CONFIG_SETTINGS_WEAR_STATS
+/**
+ * @brief HTTP server handler serving the flash wear report of the pack in `user_ctx`.
+ *
+ * Responds with the fields of `settings_wear_t` and a `keys` array holding
+ * `key`, `writes`, `hour_writes` and `hot` of every setting written since boot.
+ * CBOR is served like for the settings handlers.
+ *
+ * @param req Pointer to the HTTP request.
+ * @return esp_err_t ESP_OK if the request was handled successfully; otherwise an error code.
+ */
+esp_err_t settings_wear_httpd_handler(httpd_req_t *req);
+#endif
+
+/**
+ * @brief Get the settings generation counter.
+ *
+ * The counter is incremented every time a setting value changes in memory.
+ *
+ * @return uint32_t Current generation.
+ */
+uint32_t settings_get_generation(void);
+
+/**
+ * @brief Get the random epoch of this boot.
+ *
+ * Drawn when the first pack is read. Generation tokens in responses are
+ * "<epoch>-<gen>" with the epoch as 8 hex digits.
+ *
+ * @return uint32_t Epoch of the current boot.
+ */
+uint32_t settings_get_epoch(void);
+
 #endif /* SETTINGS_H_ */
@@ -1,19 +1,311 @@
 #include "include/settings.h"
 
 #include <stdio.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
 #include <time.h>
 #include <sys/time.h>
 #include <esp_system.h>
+#if defined(__has_include) && __has_include(<esp_random.h>)
+#include <esp_random.h>
+#endif
 #include <esp_log.h>
 #include <esp_err.h>
 #include <nvs_flash.h>
-#include <cJSON.h>
+#ifdef CONFIG_SETTINGS_THREAD_SAFE
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#endif
+#ifdef CONFIG_SETTINGS_NVS_BULK_READ
+#include <esp_idf_version.h>
+#endif
+#ifdef CONFIG_SETTINGS_NOTIFY_SUPPORT
+#include <freertos/queue.h>
+#endif
+#if defined(CONFIG_SETTINGS_METRICS) || defined(CONFIG_SETTINGS_WEAR_STATS)
+#include <esp_timer.h>
+#endif
+#if defined(CONFIG_SETTINGS_NOTIFY_SUPPORT) || defined(CONFIG_SETTINGS_WRITE_BACK) || defined(CONFIG_SETTINGS_CHANGE_FEED)
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#endif
+#ifdef CONFIG_SETTINGS_CHANGE_FEED
+#include <esp_idf_version.h>
+/* long-polls are parked with async handlers and answered by a task, without them `wait` is ignored */
+#if defined(CONFIG_SETTINGS_THREAD_SAFE) && ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 1, 0)
+#define SETTINGS_FEED_ASYNC 1
+#endif
+#endif
 
 static const char *TAG = "SETTINGS";
 static const char *NVS_STORAGE = "settings_nvs";
 
-static settings_handler_t settings_handler;
-static void              *handler_arg;
+static settings_handler_t   settings_handler;
+static void                *handler_arg;
+static settings_nvs_stats_t nvs_stats;
+static uint32_t             settings_generation;
+/* random per boot, tells generations of different boots apart */
+static uint32_t settings_epoch;
+/* some pack has a context - settings no longer all live in NVS_STORAGE */
+static bool settings_ctx_used;
+#ifdef CONFIG_SETTINGS_WRITE_BACK
+static TaskHandle_t writeback_task;
+static bool         writeback_pending;
+#endif
+#ifdef CONFIG_SETTINGS_CHANGE_FEED
+/* setting that caused generation g is at g % CONFIG_SETTINGS_CHANGE_FEED_LEN */
+static setting_t *feed_ring[CONFIG_SETTINGS_CHANGE_FEED_LEN];
+/* generations up to here are the load by settings_nvs_read() */
+static uint32_t feed_start;
+#endif
+#ifdef SETTINGS_FEED_ASYNC
+static struct settings_feed_waiter *feed_waiters;
+static TaskHandle_t                 feed_task;
+#endif
+#ifdef CONFIG_SETTINGS_WS_PUSH
+static void settings_ws_push(setting_t *setting);
+#endif
+static struct settings_index *setting_index(const setting_t *setting);
+
+/* every generation step is caused by one setting, the change feed remembers which */
+static inline void settings_generation_bump(setting_t *setting)
+{
+    /* copies and settings of packs without an index are not served, their changes are nobody's */
+    if (!setting_index(setting))
+        return;
+    settings_generation++;
+#ifdef CONFIG_SETTINGS_CHANGE_FEED
+    feed_ring[settings_generation % CONFIG_SETTINGS_CHANGE_FEED_LEN] = setting;
+#endif
+#ifdef SETTINGS_FEED_ASYNC
+    if (feed_waiters)
+        xTaskNotifyGive(feed_task);
+#endif
+#ifdef CONFIG_SETTINGS_WS_PUSH
+    settings_ws_push(setting);
+#endif
+}
+
+/* value changed in memory - needs to be persisted and invalidates cached values */
+static inline void setting_changed(setting_t *setting)
+{
+    setting->dirty = true;
+#ifdef CONFIG_SETTINGS_NOTIFY_SUPPORT
+    setting->changed = true;
+#endif
+#ifdef CONFIG_SETTINGS_WRITE_BACK
+    /* first change after a flush wakes the write-back task */
+    if (writeback_task && !writeback_pending) {
+        writeback_pending = true;
+        xTaskNotifyGive(writeback_task);
+    }
+#endif
+    settings_generation_bump(setting);
+}
+
+#ifdef CONFIG_SETTINGS_THREAD_SAFE
+/*
+ * Sequence lock: writers are serialized by a recursive mutex and bump
+ * `settings_seq` before and after each value update, so it is odd while an
+ * update is in progress. Readers copy the value without locking and retry
+ * when the sequence changed in the meantime.
+ */
+static SemaphoreHandle_t settings_mutex;
+static uint32_t          settings_seq;
+
+void settings_lock(void)
+{
+    SemaphoreHandle_t mutex = __atomic_load_n(&settings_mutex, __ATOMIC_ACQUIRE);
+
+    /* created on first use, a task losing the race to install its mutex takes the winner's */
+    if (!mutex) {
+        SemaphoreHandle_t created = xSemaphoreCreateRecursiveMutex();
+
+        if (__atomic_compare_exchange_n(&settings_mutex, &mutex, created, false, __ATOMIC_ACQ_REL,
+                                        __ATOMIC_ACQUIRE))
+            mutex = created;
+        else
+            vSemaphoreDelete(created);
+    }
+    xSemaphoreTakeRecursive(mutex, portMAX_DELAY);
+}
+
+void settings_unlock(void)
+{
+    xSemaphoreGiveRecursive(settings_mutex);
+}
+
+uint32_t settings_read_begin(void)
+{
+    uint32_t seq = __atomic_load_n(&settings_seq, __ATOMIC_ACQUIRE);
+
+    while (seq & 1) {
+        /* block on the writer instead of spinning, it inherits our priority */
+        settings_lock();
+        settings_unlock();
+        seq = __atomic_load_n(&settings_seq, __ATOMIC_ACQUIRE);
+    }
+    return seq;
+}
+
+bool settings_read_retry(uint32_t seq)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&settings_seq, __ATOMIC_RELAXED) != seq;
+}
+
+static inline void settings_write_begin(void)
+{
+    settings_lock();
+    __atomic_store_n(&settings_seq, settings_seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void settings_write_end(void)
+{
+    __atomic_store_n(&settings_seq, settings_seq + 1, __ATOMIC_RELEASE);
+    settings_unlock();
+}
+
+/* consistent copy of a setting, text buffers are shared with the original */
+static setting_t *setting_snapshot(setting_t *setting, setting_t *snap)
+{
+    uint32_t seq;
+
+    do {
+        seq = settings_read_begin();
+        *snap = *setting;
+    } while (settings_read_retry(seq));
+    return snap;
+}
+#else
+void settings_lock(void)
+{
+}
+
+void settings_unlock(void)
+{
+}
+
+uint32_t settings_read_begin(void)
+{
+    return 0;
+}
+
+bool settings_read_retry(uint32_t seq)
+{
+    return false;
+}
+
+static inline void settings_write_begin(void)
+{
+}
+
+static inline void settings_write_end(void)
+{
+}
+
+static setting_t *setting_snapshot(setting_t *setting, setting_t *snap)
+{
+    return setting;
+}
+#endif
+
+#define SETTING_READ(dst, src)                   \
+    do {                                         \
+        uint32_t seq_;                           \
+        do {                                     \
+            seq_ = settings_read_begin();        \
+            (dst) = (src);                       \
+        } while (settings_read_retry(seq_));     \
+    } while (0)
+
+#ifdef CONFIG_SETTINGS_METRICS
+static settings_metrics_t metrics;
+/*
+ * Free heap when the HTTP request being handled started. Requests served
+ * in parallel and commits made outside a request compare against the
+ * latest start, so the peak is an approximation.
+ */
+static size_t metrics_heap_start;
+
+static inline int64_t settings_metrics_start(void)
+{
+    return esp_timer_get_time();
+}
+
+static void settings_metrics_op(settings_metric_op_t op, int64_t start, esp_err_t rc)
+{
+    settings_op_metrics_t *m = &metrics.ops[op];
+    uint32_t               us = esp_timer_get_time() - start;
+    int                    bucket = 32 - __builtin_clz(us | 1) - 4;
+
+    if (bucket < 0)
+        bucket = 0;
+    else if (bucket >= SETTINGS_METRICS_BUCKETS)
+        bucket = SETTINGS_METRICS_BUCKETS - 1;
+
+    settings_lock();
+    m->count++;
+    m->errors += rc != ESP_OK;
+    m->total_us += us;
+    if (us > m->max_us)
+        m->max_us = us;
+    m->hist[bucket]++;
+    settings_unlock();
+}
+
+static void settings_metrics_nvs_write(size_t bytes)
+{
+    settings_lock();
+    metrics.nvs_keys_written++;
+    metrics.nvs_bytes_written += bytes;
+    settings_unlock();
+}
+
+static inline void settings_metrics_http_begin(void)
+{
+    metrics_heap_start = esp_get_free_heap_size();
+}
+
+static void settings_metrics_http_sample(void)
+{
+    size_t free_heap;
+
+    settings_lock();
+    free_heap = esp_get_free_heap_size();
+    if (free_heap < metrics_heap_start && metrics_heap_start - free_heap > metrics.http_heap_peak)
+        metrics.http_heap_peak = metrics_heap_start - free_heap;
+    settings_unlock();
+}
+#else
+static inline int64_t settings_metrics_start(void)
+{
+    return 0;
+}
+
+static inline void settings_metrics_op(settings_metric_op_t op, int64_t start, esp_err_t rc)
+{
+}
+
+static inline void settings_metrics_http_begin(void)
+{
+}
+
+static inline void settings_metrics_http_sample(void)
+{
+}
+#endif
+
+static esp_err_t settings_nvs_commit(nvs_handle_t nvs)
+{
+#ifdef CONFIG_SETTINGS_METRICS
+    __atomic_add_fetch(&metrics.nvs_commits, 1, __ATOMIC_RELAXED);
+#endif
+    return nvs_commit(nvs);
+}
 
 #ifdef CONFIG_SETTINGS_NET_SUPPORT
 typedef struct {
@@ -30,6 +322,22 @@ static void setting_ipaddr_to_string(const ipaddr_t *ipaddr, char *buf, size_t b
              ipaddr->octets[2], ipaddr->octets[3]);
 }
 
+#ifdef CONFIG_SETTINGS_CBOR_SUPPORT
+/* CBOR carries addresses as integers, first octet most significant */
+static uint32_t setting_ipaddr_to_u32(const ipaddr_t *ipaddr)
+{
+    return (uint32_t)ipaddr->octets[0] << 24 | ipaddr->octets[1] << 16 | ipaddr->octets[2] << 8 | ipaddr->octets[3];
+}
+
+static void setting_ipaddr_from_u32(uint32_t val, ipaddr_t *ipaddr)
+{
+    ipaddr->octets[0] = val >> 24;
+    ipaddr->octets[1] = val >> 16;
+    ipaddr->octets[2] = val >> 8;
+    ipaddr->octets[3] = val;
+}
+#endif
+
 static bool setting_ipaddr_from_string(const char *text, ipaddr_t *ipaddr)
 {
     unsigned int octets[4];
@@ -104,726 +412,5709 @@ static int datetime_settimeofday(setting_datetime_t *setting)
 
     return settimeofday(&timeval, NULL);
 }
-#endif
 
-esp_err_t settings_pack_update_nvs_ids(const settings_group_t *pack)
+/* stored representation of time and date values */
+static uint16_t setting_time_pack(const setting_time_t *time)
 {
-    char      nvs_id[SETTINGS_NVS_ID_LEN];
-    size_t    id_len;
-    esp_err_t rc;
+    return (time->hh << 8) | time->mm;
+}
 
-    for (const settings_group_t *gr = pack; gr->id; gr++) {
-        for (setting_t *setting = gr->settings; setting->id; setting++) {
-            snprintf(nvs_id, sizeof(nvs_id), "%s:%s", gr->id, setting->id);
-            id_len = strnlen(nvs_id, sizeof(nvs_id));
-            if (id_len >= NVS_KEY_NAME_MAX_SIZE - 1) {
-                ESP_LOGE(TAG, "NVS key too long (%u >= %d): %s", id_len, NVS_KEY_NAME_MAX_SIZE - 1, nvs_id);
-                rc = ESP_ERR_INVALID_ARG;
-                return rc;
-            }
-            strncpy(setting->nvs_id, nvs_id, SETTINGS_NVS_ID_LEN);
-        }
-    }
-    return ESP_OK;
+static void setting_time_unpack(setting_time_t *time, uint16_t val)
+{
+    time->hh = (val >> 8);
+    time->mm = (val & 0xFF);
 }
 
-void settings_pack_print(const settings_group_t *settings_pack)
+static uint32_t setting_date_pack(const setting_date_t *date)
 {
-    printf("Settings:\n");
-    for (const settings_group_t *gr = settings_pack; gr->label; gr++) {
-        printf("gr %s\n", gr->label);
-        for (setting_t *setting = gr->settings; setting->label; setting++) {
-            printf("- %s: ", setting->label);
-            switch (setting->type) {
-            case SETTING_TYPE_BOOL:
-                printf("%s\n", setting->boolean.val ? "ENABLED" : "DISABLED");
-                break;
-            case SETTING_TYPE_NUM:
-                printf("%d\n", setting->num.val);
-                break;
-            case SETTING_TYPE_ONEOF:
-                printf("%s\n", setting->oneof.options[setting->oneof.val]);
-                break;
-            case SETTING_TYPE_TEXT:
-                printf("%s\n", setting->text.val);
-                break;
-#ifdef CONFIG_SETTINGS_DATETIME_SUPPORT
-            case SETTING_TYPE_TIME:
-                printf("%02d:%02d\n", setting->time.hh, setting->time.mm);
-                break;
-            case SETTING_TYPE_DATE:
-                printf("%02d-%02d-%04d\n", setting->date.day, setting->date.month, setting->date.year);
-                break;
-            case SETTING_TYPE_DATETIME:
-                datetime_gettimeofday(&setting->datetime);
-                printf("%02d:%02d %02d-%02d-%04d\n",
-                       setting->datetime.time.hh, //
-                       setting->datetime.time.mm, //
-                       setting->datetime.date.day, setting->datetime.date.month, setting->datetime.date.year);
-                break;
+    uint32_t val = 0;
+
+    val |= ((uint32_t)(date->day & 0xFF) << 24);
+    val |= ((uint32_t)(date->month & 0xFF) << 16);
+    val |= ((uint32_t)(date->year & 0xFFFF));
+    return val;
+}
+
+static void setting_date_unpack(setting_date_t *date, uint32_t val)
+{
+    date->day = (val >> 24 & 0xFF);
+    date->month = (val >> 16 & 0xFF);
+    date->year = (val & 0xFFFF);
+}
 #endif
-#ifdef CONFIG_SETTINGS_TIMEZONE_SUPPORT
-            case SETTING_TYPE_TIMEZONE:
-                printf("%s\n", setting->timezone.val);
-                break;
+
+#ifdef CONFIG_SETTINGS_WEAR_STATS
+#define SETTINGS_WEAR_HOUR_US (3600LL * 1000000)
+#define NVS_ENTRY_SIZE        32
+
+/* NVS writes of one setting */
+typedef struct {
+    uint32_t writes;
+    uint32_t hour;       /* hour since boot counted by `hour_writes` */
+    uint32_t hour_writes;
+} setting_wear_t;
 #endif
-#ifdef CONFIG_SETTINGS_COLOR_SUPPORT
-            case SETTING_TYPE_COLOR:
-                printf("#%02x%02x%02x\n", setting->color.val.r, setting->color.val.g, setting->color.val.b);
-                break;
+
+/*
+ * Lookup index: open addressing hash table of settings keyed on "group:id".
+ * The key is already stored in `nvs_id`, so slots only hold setting pointers.
+ */
+typedef struct settings_index {
+    struct settings_index  *next;
+    const settings_group_t *pack;
+    const settings_ctx_t   *ctx;    /* NULL - default namespace and handler */
+    bool                    loaded; /* read by settings_nvs_read(), stored by settings_flush() */
+    uint32_t                schema_etag;
+    uint32_t                count;
+    uint32_t                mask;
+#ifdef CONFIG_SETTINGS_WEAR_STATS
+    uint32_t        wear_writes;
+    uint32_t        wear_bytes;
+    uint32_t        wear_entries;
+    setting_wear_t *wear; /* per slot, after `slots` */
 #endif
-#ifdef CONFIG_SETTINGS_NET_SUPPORT
-            case SETTING_TYPE_IPADDR: {
-                char buf[16];
-
-                setting_ipaddr_to_string(&setting->ipaddr.val, buf, sizeof(buf));
-                printf("%s\n", buf);
-            } break;
-            case SETTING_TYPE_NETIF: {
-                char ip[16];
-                char netmask[16];
-                char gateway[16];
-
-                setting_ipaddr_to_string(&setting->netif.val.ip, ip, sizeof(ip));
-                setting_ipaddr_to_string(&setting->netif.val.netmask, netmask, sizeof(netmask));
-                setting_ipaddr_to_string(&setting->netif.val.gateway, gateway, sizeof(gateway));
-                printf("dhcp=%s ip=%s mask=%s gw=%s\n", setting->netif.val.dhcp ? "true" : "false", ip, netmask,
-                       gateway);
-            } break;
-#endif
-            default:
-                break;
-            }
+    setting_t *slots[];
+} settings_index_t;
+
+static settings_index_t *settings_indexes;
+
+static uint32_t settings_hash_str(uint32_t hash, const char *str)
+{
+    for (const char *c = str; *c; c++)
+        hash = (hash ^ (uint8_t)*c) * 16777619u;
+    return hash;
+}
+
+static uint32_t settings_key_hash(const char *gr_id, const char *id)
+{
+    uint32_t hash = 2166136261u; /* FNV-1a */
+
+    hash = settings_hash_str(hash, gr_id);
+    hash = (hash ^ ':') * 16777619u;
+    return settings_hash_str(hash, id);
+}
+
+/*
+ * Index holding this very setting, NULL for copies and settings of packs not
+ * indexed yet. `nvs_id` is the "group:id" key, so its hash leads to the slot.
+ */
+static bool settings_index_slot(const settings_index_t *index, const setting_t *setting, uint32_t *slot_out)
+{
+    uint32_t hash;
+
+    if (!setting->nvs_id)
+        return false;
+    hash = settings_hash_str(2166136261u, setting->nvs_id);
+    for (uint32_t slot = hash & index->mask; index->slots[slot]; slot = (slot + 1) & index->mask) {
+        if (index->slots[slot] == setting) {
+            if (slot_out)
+                *slot_out = slot;
+            return true;
         }
     }
+    return false;
 }
 
-setting_t *settings_pack_find(const settings_group_t *pack, const char *gr_id, const char *id)
+static settings_index_t *setting_index(const setting_t *setting)
 {
-    for (const settings_group_t *gr = pack; gr->id; gr++) {
-        if (strcmp(gr_id, gr->id))
-            continue;
-        for (setting_t *setting = gr->settings; setting->id; setting++) {
-            if (!strcmp(id, setting->id))
-                return setting;
-        }
+    for (settings_index_t *index = settings_indexes; index; index = index->next) {
+        if (settings_index_slot(index, setting, NULL))
+            return index;
     }
     return NULL;
 }
 
-void setting_set_defaults(setting_t *setting)
+static bool setting_key_match(const setting_t *setting, const char *gr_id, const char *id)
 {
-    switch (setting->type) {
-    case SETTING_TYPE_BOOL:
-        setting->boolean.val = setting->boolean.def;
-        break;
-    case SETTING_TYPE_NUM:
-        setting->num.val = setting->num.def;
-        break;
-    case SETTING_TYPE_ONEOF:
-        setting->oneof.val = setting->oneof.def;
-        break;
-    case SETTING_TYPE_TEXT:
-        strncpy(setting->text.val, setting->text.def, setting->text.len);
-        break;
-#ifdef CONFIG_SETTINGS_DATETIME_SUPPORT
-    case SETTING_TYPE_TIME:
-        memset(&setting->time, 0, sizeof(setting_time_t));
-        break;
-    case SETTING_TYPE_DATE:
-        memset(&setting->date, 0, sizeof(setting_date_t));
-        break;
-    case SETTING_TYPE_DATETIME:
-        datetime_gettimeofday(&setting->datetime);
-        break;
-#endif
-#ifdef CONFIG_SETTINGS_TIMEZONE_SUPPORT
-    case SETTING_TYPE_TIMEZONE:
-        strncpy(setting->timezone.val, setting->timezone.def, setting->timezone.len);
-        break;
-#endif
-#ifdef CONFIG_SETTINGS_COLOR_SUPPORT
-    case SETTING_TYPE_COLOR:
-        setting->color.val = setting->color.def;
-        break;
-#endif
-#ifdef CONFIG_SETTINGS_NET_SUPPORT
-    case SETTING_TYPE_IPADDR:
-        setting->ipaddr.val = setting->ipaddr.def;
-        break;
-    case SETTING_TYPE_NETIF:
-        setting->netif.val = setting->netif.def;
-        break;
-#endif
-    default:
-        break;
-    }
+    size_t gr_len = strlen(gr_id);
+
+    return !strncmp(setting->nvs_id, gr_id, gr_len) && setting->nvs_id[gr_len] == ':' &&
+           !strcmp(&setting->nvs_id[gr_len + 1], id);
 }
 
-void settings_pack_set_defaults(const settings_group_t *settings_pack)
+static settings_index_t *settings_index_get(const settings_group_t *pack)
 {
-    for (const settings_group_t *gr = settings_pack; gr->label; gr++) {
-        for (setting_t *setting = gr->settings; setting->label; setting++)
-            setting_set_defaults(setting);
+    for (settings_index_t *index = settings_indexes; index; index = index->next) {
+        if (index->pack == pack)
+            return index;
     }
+    return NULL;
 }
 
-void setting_set_bool(setting_t *setting, const bool value)
+#if defined(CONFIG_SETTINGS_STORAGE_GROUP_BLOB) || defined(CONFIG_SETTINGS_WEAR_STATS)
+/* index of the pack owning a setting, searched in the packs registered so far */
+static settings_index_t *settings_index_of(const setting_t *setting, const settings_group_t **group)
 {
-    setting->boolean.val = value;
-#ifdef CONFIG_SETTINGS_CALLBACK_SUPPORT
-    if (setting->on_set_callback)
-        setting->on_set_callback(setting);
-#endif
+    for (settings_index_t *index = settings_indexes; index; index = index->next) {
+        for (const settings_group_t *gr = index->pack; gr->id; gr++) {
+            for (setting_t *item = gr->settings; item->id; item++) {
+                if (item == setting) {
+                    if (group)
+                        *group = gr;
+                    return index;
+                }
+            }
+        }
+    }
+    return NULL;
 }
+#endif
 
-void setting_set_num(setting_t *setting, const int value)
+static const settings_ctx_t *settings_pack_ctx(const settings_group_t *pack)
 {
-    if (value < setting->num.range[0] || value > setting->num.range[1])
-        return;
+    settings_index_t *index;
 
-    setting->num.val = value;
-#ifdef CONFIG_SETTINGS_CALLBACK_SUPPORT
-    if (setting->on_set_callback)
-        setting->on_set_callback(setting);
-#endif
+    if (!settings_ctx_used)
+        return NULL;
+    index = settings_index_get(pack);
+    return index ? index->ctx : NULL;
 }
 
-void setting_set_oneof(setting_t *setting, const int index)
+static const settings_ctx_t *setting_ctx(const setting_t *setting)
 {
-    int labels_count = 0;
-    for (const char **label = setting->oneof.options; *label != NULL; label++)
-        labels_count++;
+    settings_index_t *index;
 
-    if (index < 0 || index >= labels_count)
-        return;
+    if (!settings_ctx_used)
+        return NULL;
+    index = setting_index(setting);
+    return index ? index->ctx : NULL;
+}
 
-    setting->oneof.val = index;
-#ifdef CONFIG_SETTINGS_CALLBACK_SUPPORT
-    if (setting->on_set_callback)
-        setting->on_set_callback(setting);
-#endif
+static const char *settings_ctx_namespace(const settings_ctx_t *ctx)
+{
+    return ctx && ctx->nvs_namespace ? ctx->nvs_namespace : NVS_STORAGE;
 }
 
-void setting_set_text(setting_t *setting, const char *text)
+static const char *settings_ctx_partition(const settings_ctx_t *ctx)
 {
-    if (setting->text.val && setting->text.len > 0) {
-        if (text) {
-            size_t copy_len = strnlen(text, setting->text.len - 1);
-            memmove(setting->text.val, text, copy_len);
-            setting->text.val[copy_len] = '\0';
-        } else {
-            setting->text.val[0] = '\0';
-        }
-    }
-#ifdef CONFIG_SETTINGS_CALLBACK_SUPPORT
-    if (setting->on_set_callback)
-        setting->on_set_callback(setting);
-#endif
+    return ctx && ctx->partition ? ctx->partition : NVS_DEFAULT_PART_NAME;
 }
 
-#ifdef CONFIG_SETTINGS_DATETIME_SUPPORT
-void setting_set_time(setting_t *setting, const setting_time_t *time)
+static esp_err_t settings_ctx_nvs_open(const settings_ctx_t *ctx, nvs_open_mode_t mode, nvs_handle_t *nvs)
 {
-    setting->time.hh = time->hh;
-    setting->time.mm = time->mm;
-#ifdef CONFIG_SETTINGS_CALLBACK_SUPPORT
-    if (setting->on_set_callback)
-        setting->on_set_callback(setting);
-#endif
+    if (ctx && ctx->partition)
+        return nvs_open_from_partition(ctx->partition, settings_ctx_namespace(ctx), mode, nvs);
+    return nvs_open(settings_ctx_namespace(ctx), mode, nvs);
 }
-void setting_set_date(setting_t *setting, const setting_date_t *date)
+
+/* the context handler replaces the global one */
+static void settings_handler_call(const settings_group_t *settings_pack)
 {
-    setting->date.day = date->day;
-    setting->date.month = date->month;
-    setting->date.year = date->year;
-#ifdef CONFIG_SETTINGS_CALLBACK_SUPPORT
-    if (setting->on_set_callback)
-        setting->on_set_callback(setting);
-#endif
+    const settings_ctx_t *ctx = settings_pack_ctx(settings_pack);
+
+    if (ctx && ctx->handler)
+        ctx->handler(settings_pack, ctx->handler_arg);
+    else if (settings_handler != NULL)
+        settings_handler(settings_pack, handler_arg);
 }
-void setting_set_datetime(setting_t *setting, const setting_datetime_t *datetime)
+
+static setting_t *settings_index_lookup(const settings_index_t *index, const char *gr_id, const char *id,
+                                        uint32_t *slot_out)
 {
-    setting->datetime.date.day = datetime->date.day;
-    setting->datetime.date.month = datetime->date.month;
-    setting->datetime.date.year = datetime->date.year;
-    setting->datetime.time.hh = datetime->time.hh;
-    setting->datetime.time.mm = datetime->time.mm;
-#ifdef CONFIG_SETTINGS_CALLBACK_SUPPORT
-    if (setting->on_set_callback)
-        setting->on_set_callback(setting);
+    uint32_t slot = settings_key_hash(gr_id, id) & index->mask;
+
+    for (setting_t *setting; (setting = index->slots[slot]) != NULL; slot = (slot + 1) & index->mask) {
+        if (setting_key_match(setting, gr_id, id)) {
+            if (slot_out)
+                *slot_out = slot;
+            return setting;
+        }
+    }
+    return NULL;
+}
+
+static esp_err_t settings_index_build(const settings_group_t *pack)
+{
+    settings_index_t *index;
+    size_t            count = 0;
+    size_t            size = 1;
+
+    if (settings_index_get(pack))
+        return ESP_OK;
+
+    for (const settings_group_t *gr = pack; gr->id; gr++) {
+        for (setting_t *setting = gr->settings; setting->id; setting++)
+            count++;
+    }
+
+    /* keep load factor below 3/4 */
+    while (size * 3 < count * 4)
+        size <<= 1;
+
+#ifdef CONFIG_SETTINGS_WEAR_STATS
+    index = calloc(1, sizeof(settings_index_t) + size * (sizeof(setting_t *) + sizeof(setting_wear_t)));
+    if (!index)
+        return ESP_ERR_NO_MEM;
+    index->wear = (setting_wear_t *)&index->slots[size];
+#else
+    index = calloc(1, sizeof(settings_index_t) + size * sizeof(setting_t *));
+    if (!index)
+        return ESP_ERR_NO_MEM;
 #endif
+
+    index->pack = pack;
+    index->count = count;
+    index->mask = size - 1;
+    for (const settings_group_t *gr = pack; gr->id; gr++) {
+        for (setting_t *setting = gr->settings; setting->id; setting++) {
+            uint32_t slot = settings_key_hash(gr->id, setting->id) & index->mask;
+
+            while (index->slots[slot])
+                slot = (slot + 1) & index->mask;
+            index->slots[slot] = setting;
+        }
+    }
+    index->next = settings_indexes;
+    settings_indexes = index;
+    return ESP_OK;
+}
+
+#ifdef CONFIG_SETTINGS_WEAR_STATS
+/* 32 byte NVS entries taken by a value: strings add a header entry, blobs an index and a chunk header */
+static uint32_t nvs_entries_of(nvs_type_t type, size_t bytes)
+{
+    switch (type) {
+    case NVS_TYPE_STR:
+        return 1 + (bytes + NVS_ENTRY_SIZE - 1) / NVS_ENTRY_SIZE;
+    case NVS_TYPE_BLOB:
+        return 2 + (bytes + NVS_ENTRY_SIZE - 1) / NVS_ENTRY_SIZE;
+    default:
+        return 1;
+    }
+}
+
+/* count a write of the setting in its slot, warn once an hour it crosses the hot threshold */
+static void setting_wear_count(settings_index_t *index, const setting_t *setting)
+{
+    uint32_t        hour = esp_timer_get_time() / SETTINGS_WEAR_HOUR_US;
+    uint32_t        slot;
+    setting_wear_t *wear;
+
+    if (!settings_index_slot(index, setting, &slot))
+        return;
+
+    wear = &index->wear[slot];
+    wear->writes++;
+    if (wear->hour != hour) {
+        wear->hour = hour;
+        wear->hour_writes = 0;
+    }
+    if (++wear->hour_writes == CONFIG_SETTINGS_WEAR_HOT_WRITES)
+        ESP_LOGW(TAG, "%s written %d times within an hour - flash wear", setting->nvs_id,
+                 CONFIG_SETTINGS_WEAR_HOT_WRITES);
+}
+
+static void settings_wear_add(settings_index_t *index, size_t bytes, uint32_t entries)
+{
+    index->wear_writes++;
+    index->wear_bytes += bytes;
+    index->wear_entries += entries;
 }
 #endif
 
-#ifdef CONFIG_SETTINGS_TIMEZONE_SUPPORT
-void setting_set_timezone(setting_t *setting, const char *timezone)
+#ifdef CONFIG_SETTINGS_STORAGE_GROUP_BLOB
+static esp_err_t settings_blob_check(const settings_group_t *pack);
+#endif
+
+esp_err_t settings_pack_update_nvs_ids(const settings_group_t *pack)
 {
-    if (setting->timezone.val && setting->timezone.len > 0) {
-        if (timezone) {
-            size_t copy_len = strnlen(timezone, setting->timezone.len - 1);
-            memmove(setting->timezone.val, timezone, copy_len);
-            setting->timezone.val[copy_len] = '\0';
-        } else {
-            setting->timezone.val[0] = '\0';
+    char  *keys;
+    size_t keys_len = 0;
+    size_t id_len;
+
+    /* keys are assigned once, index exists only after that */
+    if (settings_index_get(pack))
+        return ESP_OK;
+
+    for (const settings_group_t *gr = pack; gr->id; gr++) {
+        for (setting_t *setting = gr->settings; setting->id; setting++) {
+            id_len = strlen(gr->id) + 1 + strlen(setting->id);
+            if (id_len >= NVS_KEY_NAME_MAX_SIZE - 1) {
+                ESP_LOGE(TAG, "NVS key too long (%u >= %d): %s:%s", (unsigned)id_len, NVS_KEY_NAME_MAX_SIZE - 1,
+                         gr->id, setting->id);
+                return ESP_ERR_INVALID_ARG;
+            }
+            if (!setting->nvs_id) {
+                keys_len += id_len + 1;
+            } else if (!setting_key_match(setting, gr->id, setting->id)) {
+                ESP_LOGE(TAG, "NVS key %s does not match %s:%s", setting->nvs_id, gr->id, setting->id);
+                return ESP_ERR_INVALID_ARG;
+            }
         }
     }
-#ifdef CONFIG_SETTINGS_CALLBACK_SUPPORT
-    if (setting->on_set_callback)
-        setting->on_set_callback(setting);
+#ifdef CONFIG_SETTINGS_STORAGE_GROUP_BLOB
+    if (settings_blob_check(pack) != ESP_OK)
+        return ESP_ERR_INVALID_ARG;
 #endif
+
+    /* settings not declared with SETTINGS_ITEM() get their keys built here */
+    if (keys_len) {
+        keys = malloc(keys_len);
+        if (!keys)
+            return ESP_ERR_NO_MEM;
+
+        for (const settings_group_t *gr = pack; gr->id; gr++) {
+            for (setting_t *setting = gr->settings; setting->id; setting++) {
+                if (setting->nvs_id)
+                    continue;
+                id_len = sprintf(keys, "%s:%s", gr->id, setting->id);
+                setting->nvs_id = keys;
+                keys += id_len + 1;
+            }
+        }
+    }
+    return settings_index_build(pack);
 }
+
+/*
+ * Per-type behavior lives in a table of codecs, see setting_types[]. Values
+ * are stored in the representation produced by `encode` and read back by
+ * `decode`: as an NVS entry of `nvs_type` in the per-key layout and as a
+ * record of the group blob. Types that keep their value elsewhere override
+ * the per-key entry with `nvs_read` and `nvs_write`.
+ */
+typedef struct json_stream json_stream_t;
+typedef struct json_reader json_reader_t;
+#ifdef CONFIG_SETTINGS_CBOR_SUPPORT
+typedef struct cbor_reader cbor_reader_t;
 #endif
 
-#ifdef CONFIG_SETTINGS_COLOR_SUPPORT
-void setting_set_color(setting_t *setting, const color_t *color)
-{
-    setting->color.val = *color;
-#ifdef CONFIG_SETTINGS_CALLBACK_SUPPORT
-    if (setting->on_set_callback)
-        setting->on_set_callback(setting);
+typedef struct {
+    const char *name; /* "type" of the JSON schema */
+#ifdef CONFIG_SETTINGS_CBOR_SUPPORT
+    uint8_t cbor_type; /* "type" of the CBOR schema */
 #endif
-}
+    nvs_type_t nvs_type; /* NVS_TYPE_ANY - not persistent */
+    void (*set_default)(setting_t *setting);
+    size_t (*encode)(const setting_t *setting, void *buf); /* only the length if buf is NULL */
+    esp_err_t (*decode)(setting_t *setting, const void *val, size_t len);
+    esp_err_t (*nvs_read)(setting_t *setting, nvs_handle_t nvs);  /* NULL - decode the NVS entry */
+    esp_err_t (*nvs_write)(setting_t *setting, nvs_handle_t nvs); /* NULL - store the encoded value */
+    void (*print)(setting_t *setting);
+    /* `setting` is a consistent copy for the values, `orig` the setting itself */
+    void (*to_json)(json_stream_t *js, setting_t *setting, setting_t *orig, bool values, bool schema);
+    void (*from_string)(setting_t *setting, const char *value);
+    void (*from_json)(setting_t *setting, json_reader_t *rd);
+#ifdef CONFIG_SETTINGS_CBOR_SUPPORT
+    void (*from_cbor)(setting_t *setting, cbor_reader_t *rd);
 #endif
+} setting_ops_t;
 
-#ifdef CONFIG_SETTINGS_NET_SUPPORT
-void setting_set_ipaddr(setting_t *setting, const ipaddr_t *ipaddr)
+static const setting_ops_t *setting_ops(const setting_t *setting);
+
+static inline bool setting_has_text(const setting_t *setting)
 {
-    setting->ipaddr.val = *ipaddr;
-#ifdef CONFIG_SETTINGS_CALLBACK_SUPPORT
-    if (setting->on_set_callback)
-        setting->on_set_callback(setting);
+#ifdef CONFIG_SETTINGS_TIMEZONE_SUPPORT
+    if (setting->type == SETTING_TYPE_TIMEZONE)
+        return true;
 #endif
+    return setting->type == SETTING_TYPE_TEXT;
 }
 
-void setting_set_netif(setting_t *setting, const netif_conf_t *netif)
+#ifdef CONFIG_SETTINGS_LAZY_TEXT
+/*
+ * Lazy text settings: `val` is NULL while the value is only stored in NVS,
+ * points to `def` while the default is in effect and to a heap buffer of
+ * `len` bytes once fetched or changed. Readers hold settings_lock() as the
+ * buffer may be released by another task.
+ */
+static inline bool setting_text_lazy(const setting_t *setting)
 {
-    setting->netif.val = *netif;
-
-#ifdef CONFIG_SETTINGS_CALLBACK_SUPPORT
-    if (setting->on_set_callback)
-        setting->on_set_callback(setting);
-#endif
+    return setting_has_text(setting) && setting->text.lazy;
 }
-#endif
 
-esp_err_t settings_nvs_read(const settings_group_t *settings_pack)
+static void setting_text_drop(setting_t *setting)
 {
-    nvs_handle nvs;
-    esp_err_t  rc;
+    if (setting->text.val != setting->text.def)
+        free(setting->text.val);
+    setting->text.val = NULL;
+}
 
-    ESP_LOGI(TAG, "NVS init");
-    nvs_flash_init();
+static esp_err_t setting_text_load(setting_t *setting)
+{
+    nvs_handle_t nvs;
+    size_t       len = setting->text.len;
+    char        *buf;
+    esp_err_t    rc;
 
-    settings_pack_set_defaults(settings_pack);
-    settings_pack_update_nvs_ids(settings_pack);
+    if (setting->text.val)
+        return ESP_OK;
 
-    rc = nvs_open(NVS_STORAGE, NVS_READONLY, &nvs);
+    rc = settings_ctx_nvs_open(setting_ctx(setting), NVS_READONLY, &nvs);
     if (rc == ESP_OK) {
-        for (const settings_group_t *gr = settings_pack; gr->id; gr++) {
-            for (setting_t *setting = gr->settings; setting->id; setting++) {
-                switch (setting->type) {
-                case SETTING_TYPE_BOOL: {
-                    bool val;
-                    if (nvs_get_i8(nvs, setting->nvs_id, (int8_t *)&val) == ESP_OK)
-                        setting_set_bool(setting, val);
-                } break;
-                case SETTING_TYPE_NUM: {
-                    int32_t val;
-                    if (nvs_get_i32(nvs, setting->nvs_id, (int32_t *)&val) == ESP_OK)
-                        setting_set_num(setting, val);
-                } break;
-                case SETTING_TYPE_ONEOF: {
-                    int8_t val;
-                    if (nvs_get_i8(nvs, setting->nvs_id, &val) == ESP_OK)
-                        setting_set_oneof(setting, val);
-                } break;
-                case SETTING_TYPE_TEXT: {
-                    char   buf[1024];
-                    size_t len = setting->text.len;
-
-                    if (nvs_get_str(nvs, setting->nvs_id, buf, &len) == ESP_OK)
-                        setting_set_text(setting, buf);
-                } break;
-#ifdef CONFIG_SETTINGS_DATETIME_SUPPORT
-                case SETTING_TYPE_TIME: {
-                    uint16_t       val;
-                    setting_time_t time;
-
-                    if (nvs_get_u16(nvs, setting->nvs_id, &val) == ESP_OK) {
-                        time.hh = (val >> 8);
-                        time.mm = (val & 0xFF);
-                        setting_set_time(setting, &time);
-                    }
-                } break;
-                case SETTING_TYPE_DATE: {
-                    uint32_t       val;
-                    setting_date_t date;
-
-                    if (nvs_get_u32(nvs, setting->nvs_id, &val) == ESP_OK) {
-                        date.day = (val >> 24 & 0xFF);
-                        date.month = (val >> 16 & 0xFF);
-                        date.year = (val & 0xFFFF);
-                        setting_set_date(setting, &date);
-                    }
-                } break;
-                case SETTING_TYPE_DATETIME:
-                    /* this is current date and time on device not from nvs */
-                    datetime_gettimeofday(&setting->datetime);
-                    break;
-#endif
-#ifdef CONFIG_SETTINGS_TIMEZONE_SUPPORT
-                case SETTING_TYPE_TIMEZONE: {
-                    size_t len = setting->timezone.len;
-                    if (nvs_get_str(nvs, setting->nvs_id, setting->timezone.val, &len) == ESP_OK)
-                        setting_set_timezone(setting, setting->timezone.val);
-                } break;
+        buf = malloc(len);
+        if (!buf) {
+            nvs_close(nvs);
+            return ESP_ERR_NO_MEM;
+        }
+        rc = nvs_get_str(nvs, setting->nvs_id, buf, &len);
+        nvs_close(nvs);
+        if (rc == ESP_OK) {
+            setting->text.val = buf;
+            return ESP_OK;
+        }
+        free(buf);
+    }
+    if (rc == ESP_ERR_NVS_NOT_FOUND) {
+        setting->text.val = (char *)setting->text.def;
+        return ESP_OK;
+    }
+    ESP_LOGW(TAG, "nvs get %s: %s", setting->nvs_id, esp_err_to_name(rc));
+    return rc;
+}
 #endif
-#ifdef CONFIG_SETTINGS_COLOR_SUPPORT
-                case SETTING_TYPE_COLOR: {
-                    color_t color;
-                    if (nvs_get_u32(nvs, setting->nvs_id, &color.combined) == ESP_OK)
-                        setting_set_color(setting, &color);
-                } break;
+
+/* text value for output with settings_lock() held, lazy values are not kept */
+static const char *setting_text_borrow(setting_t *setting, bool *fetched)
+{
+    *fetched = false;
+#ifdef CONFIG_SETTINGS_LAZY_TEXT
+    if (setting_text_lazy(setting) && !setting->text.val)
+        *fetched = setting_text_load(setting) == ESP_OK;
 #endif
-#ifdef CONFIG_SETTINGS_NET_SUPPORT
-                case SETTING_TYPE_IPADDR: {
-                    ipaddr_t ipaddr;
-
-                    if (nvs_get_u32(nvs, setting->nvs_id, &ipaddr.addr) == ESP_OK)
-                        setting_set_ipaddr(setting, &ipaddr);
-                } break;
-                case SETTING_TYPE_NETIF: {
-                    size_t               blob_len = sizeof(setting_netif_blob_t);
-                    setting_netif_blob_t blob;
-                    netif_conf_t         netif = setting->netif.val;
-
-                    if (nvs_get_blob(nvs, setting->nvs_id, &blob, &blob_len) == ESP_OK && blob_len == sizeof(blob)) {
-                        setting_netif_from_blob(&netif, &blob);
-                        setting_set_netif(setting, &netif);
-                    }
-                } break;
+    return setting->text.val ? setting->text.val : "";
+}
+
+static void setting_text_return(setting_t *setting, bool fetched)
+{
+#ifdef CONFIG_SETTINGS_LAZY_TEXT
+    if (fetched && setting->text.val != setting->text.def)
+        setting_text_drop(setting);
 #endif
-                default:
-                    break;
-                }
-            }
-        }
-        nvs_close(nvs);
-    } else {
-        ESP_LOGW(TAG, "nvs open error %s", esp_err_to_name(rc));
+}
+
+/* buffer to change a text setting in, lazy settings get it on first change */
+static char *setting_text_buffer(setting_t *setting)
+{
+#ifdef CONFIG_SETTINGS_LAZY_TEXT
+    if (setting_text_lazy(setting) && (!setting->text.val || setting->text.val == setting->text.def)) {
+        char *buf = malloc(setting->text.len);
+
+        if (!buf)
+            return NULL;
+        buf[0] = '\0';
+        setting->text.val = buf;
     }
-    return ESP_OK;
+#endif
+    return setting->text.val;
 }
 
-static esp_err_t setting_nvs_write(setting_t *setting, nvs_handle_t nvs)
+static void setting_text_reset(setting_t *setting)
 {
-    esp_err_t rc;
+#ifdef CONFIG_SETTINGS_LAZY_TEXT
+    if (setting_text_lazy(setting)) {
+        /* no buffer needed while the default is in effect */
+        setting_text_drop(setting);
+        setting->text.val = (char *)setting->text.def;
+        return;
+    }
+#endif
+    if (setting->text.val && setting->text.len) {
+        size_t len = strnlen(setting->text.def, setting->text.len - 1);
 
-    rc = nvs_open(NVS_STORAGE, NVS_READWRITE, &nvs);
-    if (rc != ESP_OK) {
-        ESP_LOGE(TAG, "nvs open error %s", esp_err_to_name(rc));
-        return rc;
+        memcpy(setting->text.val, setting->text.def, len);
+        setting->text.val[len] = '\0';
     }
+}
+
+static void setting_bool_print(setting_t *setting)
+{
+    printf("%s\n", setting->boolean.val ? "ENABLED" : "DISABLED");
+}
+
+static void setting_num_print(setting_t *setting)
+{
+    printf("%d\n", setting->num.val);
+}
+
+static void setting_oneof_print(setting_t *setting)
+{
+    printf("%s\n", setting->oneof.options[setting->oneof.val]);
+}
+
+static void setting_text_print(setting_t *setting)
+{
+    bool fetched;
+
+    printf("%s\n", setting_text_borrow(setting, &fetched));
+    setting_text_return(setting, fetched);
+}
 
-    switch (setting->type) {
-    case SETTING_TYPE_BOOL:
-        rc = nvs_set_i8(nvs, setting->nvs_id, setting->boolean.val);
-        break;
-    case SETTING_TYPE_NUM:
-        rc = nvs_set_i32(nvs, setting->nvs_id, setting->num.val);
-        break;
-    case SETTING_TYPE_ONEOF:
-        rc = nvs_set_i8(nvs, setting->nvs_id, setting->oneof.val);
-        break;
-    case SETTING_TYPE_TEXT:
-        rc = nvs_set_str(nvs, setting->nvs_id, setting->text.val);
-        break;
 #ifdef CONFIG_SETTINGS_DATETIME_SUPPORT
-    case SETTING_TYPE_TIME: {
-        uint16_t val = (setting->time.hh << 8) | setting->time.mm;
-        rc = nvs_set_u16(nvs, setting->nvs_id, val);
-    } break;
-    case SETTING_TYPE_DATE: {
-        uint32_t val = 0;
-        val |= ((uint32_t)(setting->date.day & 0xFF) << 24);
-        val |= ((uint32_t)(setting->date.month & 0xFF) << 16);
-        val |= ((uint32_t)(setting->date.year & 0xFFFF));
-        rc = nvs_set_u32(nvs, setting->nvs_id, val);
-    } break;
-    case SETTING_TYPE_DATETIME:
-        /* set date and time on device - do not store in nvs */
-        rc = datetime_settimeofday(&setting->datetime);
-        break;
-#endif
-#ifdef CONFIG_SETTINGS_TIMEZONE_SUPPORT
-    case SETTING_TYPE_TIMEZONE:
-        rc = nvs_set_str(nvs, setting->nvs_id, setting->timezone.val);
-        break;
+static void setting_time_print(setting_t *setting)
+{
+    printf("%02d:%02d\n", setting->time.hh, setting->time.mm);
+}
+
+static void setting_date_print(setting_t *setting)
+{
+    printf("%02d-%02d-%04d\n", setting->date.day, setting->date.month, setting->date.year);
+}
+
+static void setting_datetime_print(setting_t *setting)
+{
+    datetime_gettimeofday(&setting->datetime);
+    printf("%02d:%02d %02d-%02d-%04d\n",
+           setting->datetime.time.hh, //
+           setting->datetime.time.mm, //
+           setting->datetime.date.day, setting->datetime.date.month, setting->datetime.date.year);
+}
 #endif
+
 #ifdef CONFIG_SETTINGS_COLOR_SUPPORT
-    case SETTING_TYPE_COLOR: {
-        rc = nvs_set_u32(nvs, setting->nvs_id, setting->color.val.combined);
-    } break;
+static void setting_color_print(setting_t *setting)
+{
+    printf("#%02x%02x%02x\n", setting->color.val.r, setting->color.val.g, setting->color.val.b);
+}
 #endif
+
 #ifdef CONFIG_SETTINGS_NET_SUPPORT
-    case SETTING_TYPE_IPADDR:
-        rc = nvs_set_u32(nvs, setting->nvs_id, setting->ipaddr.val.addr);
-        break;
-    case SETTING_TYPE_NETIF: {
-        setting_netif_blob_t blob;
+static void setting_ipaddr_print(setting_t *setting)
+{
+    char buf[16];
+
+    setting_ipaddr_to_string(&setting->ipaddr.val, buf, sizeof(buf));
+    printf("%s\n", buf);
+}
 
-        setting_netif_to_blob(&setting->netif.val, &blob);
-        rc = nvs_set_blob(nvs, setting->nvs_id, &blob, sizeof(blob));
-    } break;
+static void setting_netif_print(setting_t *setting)
+{
+    char ip[16];
+    char netmask[16];
+    char gateway[16];
+
+    setting_ipaddr_to_string(&setting->netif.val.ip, ip, sizeof(ip));
+    setting_ipaddr_to_string(&setting->netif.val.netmask, netmask, sizeof(netmask));
+    setting_ipaddr_to_string(&setting->netif.val.gateway, gateway, sizeof(gateway));
+    printf("dhcp=%s ip=%s mask=%s gw=%s\n", setting->netif.val.dhcp ? "true" : "false", ip, netmask, gateway);
+}
 #endif
+
+#ifdef CONFIG_SETTINGS_ARRAY_SUPPORT
+static size_t setting_array_elem_size(const setting_t *setting)
+{
+    switch (setting->array.elem) {
+    case SETTING_ARRAY_UINT8:
+        return sizeof(uint8_t);
+    case SETTING_ARRAY_FLOAT:
+        return sizeof(float);
     default:
-        rc = ESP_ERR_NOT_SUPPORTED;
-        break;
+        return sizeof(int16_t);
     }
-    return rc;
 }
 
-esp_err_t setting_nvs_write_single(setting_t *setting)
+static size_t setting_array_size(const setting_t *setting)
 {
-    nvs_handle_t nvs;
-    esp_err_t    rc;
+    return setting->array.len * setting_array_elem_size(setting);
+}
 
-    rc = nvs_open(NVS_STORAGE, NVS_READWRITE, &nvs);
-    if (rc != ESP_OK) {
-        ESP_LOGE(TAG, "nvs open error %s", esp_err_to_name(rc));
-        return rc;
-    }
+/* element `i` of `vals` holding elements of the setting's type, any alignment */
+static float setting_array_elem_get(const setting_t *setting, const void *vals, size_t i)
+{
+    const uint8_t *elem = (const uint8_t *)vals + i * setting_array_elem_size(setting);
+    int16_t        i16;
+    float          f;
 
-    rc = setting_nvs_write(setting, nvs);
-    if (rc != ESP_OK) {
-        ESP_LOGE(TAG, "nvs set: %s", esp_err_to_name(rc));
-        nvs_close(nvs);
-        return rc;
+    switch (setting->array.elem) {
+    case SETTING_ARRAY_UINT8:
+        return *elem;
+    case SETTING_ARRAY_FLOAT:
+        memcpy(&f, elem, sizeof(f));
+        return f;
+    default:
+        memcpy(&i16, elem, sizeof(i16));
+        return i16;
     }
-    nvs_commit(nvs);
-    nvs_close(nvs);
-    return ESP_OK;
 }
 
-esp_err_t settings_nvs_write(const settings_group_t *settings_pack)
+/* false if `val` is not a value of the element type */
+static bool setting_array_elem_put(const setting_t *setting, void *vals, size_t i, float val)
 {
-    nvs_handle nvs;
-    esp_err_t  rc;
+    uint8_t *elem = (uint8_t *)vals + i * setting_array_elem_size(setting);
+    int16_t  i16;
 
-    settings_pack_update_nvs_ids(settings_pack);
-    rc = nvs_open(NVS_STORAGE, NVS_READWRITE, &nvs);
-    if (rc == ESP_OK) {
-        for (const settings_group_t *gr = settings_pack; gr->id; gr++) {
-            for (setting_t *setting = gr->settings; setting->id; setting++) {
-                rc = setting_nvs_write(setting, nvs);
-                if (rc != ESP_OK)
-                    break;
-            }
-        }
-        if (rc == ESP_OK) {
-            nvs_commit(nvs);
-        }
-        nvs_close(nvs);
-    } else {
-        ESP_LOGE(TAG, "nvs open error %s", esp_err_to_name(rc));
+    switch (setting->array.elem) {
+    case SETTING_ARRAY_UINT8:
+        if (!(val >= 0 && val <= UINT8_MAX) || val != (uint8_t)val)
+            return false;
+        *elem = val;
+        return true;
+    case SETTING_ARRAY_FLOAT:
+        /* NaN and infinities have no JSON form, they could not be posted back */
+        if (!isfinite(val))
+            return false;
+        memcpy(elem, &val, sizeof(val));
+        return true;
+    default:
+        if (!(val >= INT16_MIN && val <= INT16_MAX) || val != (int16_t)val)
+            return false;
+        i16 = val;
+        memcpy(elem, &i16, sizeof(i16));
+        return true;
     }
-    return rc;
 }
 
-esp_err_t settings_nvs_erase(settings_group_t *settings_pack)
+static void setting_array_print(setting_t *setting)
 {
-    nvs_handle nvs;
-    esp_err_t  rc;
-    rc = nvs_open(NVS_STORAGE, NVS_READWRITE, &nvs);
-    if (rc == ESP_OK) {
+    for (size_t i = 0; i < setting->array.len; i++)
+        printf(i ? ",%g" : "%g", setting_array_elem_get(setting, setting->array.val, i));
+    printf("\n");
+}
+#endif
+
+void settings_pack_print(const settings_group_t *settings_pack)
+{
+    settings_lock();
+    printf("Settings:\n");
+    for (const settings_group_t *gr = settings_pack; gr->label; gr++) {
+        printf("gr %s\n", gr->label);
+        for (setting_t *setting = gr->settings; setting->label; setting++) {
+            const setting_ops_t *ops = setting_ops(setting);
+
+            printf("- %s: ", setting->label);
+            if (ops->print)
+                ops->print(setting);
+        }
+    }
+    settings_unlock();
+}
+
+setting_t *settings_pack_find(const settings_group_t *pack, const char *gr_id, const char *id)
+{
+    settings_index_t *index = settings_index_get(pack);
+
+    if (index)
+        return settings_index_lookup(index, gr_id, id, NULL);
+
+    /* no index yet - settings_pack_update_nvs_ids() not called */
+    for (const settings_group_t *gr = pack; gr->id; gr++) {
+        if (strcmp(gr_id, gr->id))
+            continue;
+        for (setting_t *setting = gr->settings; setting->id; setting++) {
+            if (!strcmp(id, setting->id))
+                return setting;
+        }
+    }
+    return NULL;
+}
+
+static bool setting_is_persistent(const setting_t *setting)
+{
+    return setting_ops(setting)->nvs_type != NVS_TYPE_ANY;
+}
+
+static void setting_bool_set_default(setting_t *setting)
+{
+    setting->boolean.val = setting->boolean.def;
+}
+
+static void setting_num_set_default(setting_t *setting)
+{
+    setting->num.val = setting->num.def;
+}
+
+static void setting_oneof_set_default(setting_t *setting)
+{
+    setting->oneof.val = setting->oneof.def;
+}
+
+#ifdef CONFIG_SETTINGS_DATETIME_SUPPORT
+static void setting_time_set_default(setting_t *setting)
+{
+    memset(&setting->time, 0, sizeof(setting_time_t));
+}
+
+static void setting_date_set_default(setting_t *setting)
+{
+    memset(&setting->date, 0, sizeof(setting_date_t));
+}
+
+static void setting_datetime_set_default(setting_t *setting)
+{
+    /* device clock - nothing to persist */
+    datetime_gettimeofday(&setting->datetime);
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_COLOR_SUPPORT
+static void setting_color_set_default(setting_t *setting)
+{
+    setting->color.val = setting->color.def;
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_NET_SUPPORT
+static void setting_ipaddr_set_default(setting_t *setting)
+{
+    setting->ipaddr.val = setting->ipaddr.def;
+}
+
+static void setting_netif_set_default(setting_t *setting)
+{
+    setting->netif.val = setting->netif.def;
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_ARRAY_SUPPORT
+static void setting_array_set_default(setting_t *setting)
+{
+    if (setting->array.def)
+        memcpy(setting->array.val, setting->array.def, setting_array_size(setting));
+    else
+        memset(setting->array.val, 0, setting_array_size(setting));
+}
+#endif
+
+void setting_set_defaults(setting_t *setting)
+{
+    const setting_ops_t *ops = setting_ops(setting);
+
+    settings_write_begin();
+    if (ops->set_default)
+        ops->set_default(setting);
+    if (setting_is_persistent(setting))
+        setting_changed(setting);
+    settings_write_end();
+}
+
+void settings_pack_set_defaults(const settings_group_t *settings_pack)
+{
+    for (const settings_group_t *gr = settings_pack; gr->label; gr++) {
+        for (setting_t *setting = gr->settings; setting->label; setting++)
+            setting_set_defaults(setting);
+    }
+}
+
+static void settings_group_set_dirty(const settings_group_t *gr, bool dirty)
+{
+    for (setting_t *setting = gr->settings; setting->id; setting++)
+        setting->dirty = dirty;
+}
+
+static void settings_pack_set_dirty(const settings_group_t *settings_pack, bool dirty)
+{
+    for (const settings_group_t *gr = settings_pack; gr->id; gr++)
+        settings_group_set_dirty(gr, dirty);
+}
+
+#ifdef CONFIG_SETTINGS_NOTIFY_SUPPORT
+static void settings_pack_clear_changed(const settings_group_t *settings_pack)
+{
+    for (const settings_group_t *gr = settings_pack; gr->id; gr++) {
+        for (setting_t *setting = gr->settings; setting->id; setting++)
+            setting->changed = false;
+    }
+}
+#endif
+
+void settings_pack_mark_dirty(const settings_group_t *settings_pack)
+{
+    settings_lock();
+    settings_pack_set_dirty(settings_pack, true);
+    settings_unlock();
+}
+
+void setting_set_bool(setting_t *setting, const bool value)
+{
+    settings_write_begin();
+    if (setting->boolean.val != value)
+        setting_changed(setting);
+    setting->boolean.val = value;
+    settings_write_end();
+#ifdef CONFIG_SETTINGS_CALLBACK_SUPPORT
+    if (setting->on_set_callback)
+        setting->on_set_callback(setting);
+#endif
+}
+
+void setting_set_num(setting_t *setting, const int value)
+{
+    if (value < setting->num.range[0] || value > setting->num.range[1])
+        return;
+
+    settings_write_begin();
+    if (setting->num.val != value)
+        setting_changed(setting);
+    setting->num.val = value;
+    settings_write_end();
+#ifdef CONFIG_SETTINGS_CALLBACK_SUPPORT
+    if (setting->on_set_callback)
+        setting->on_set_callback(setting);
+#endif
+}
+
+void setting_set_oneof(setting_t *setting, const int index)
+{
+    int labels_count = 0;
+    for (const char **label = setting->oneof.options; *label != NULL; label++)
+        labels_count++;
+
+    if (index < 0 || index >= labels_count)
+        return;
+
+    settings_write_begin();
+    if (setting->oneof.val != index)
+        setting_changed(setting);
+    setting->oneof.val = index;
+    settings_write_end();
+#ifdef CONFIG_SETTINGS_CALLBACK_SUPPORT
+    if (setting->on_set_callback)
+        setting->on_set_callback(setting);
+#endif
+}
+
+/* shared by text and timezone settings, both use setting_text_t */
+static void setting_text_update(setting_t *setting, const char *text)
+{
+    size_t      copy_len;
+    bool        fetched;
+    const char *cur;
+    char       *buf;
+
+    if (!setting->text.len)
+        return;
+    if (!text)
+        text = "";
+
+    cur = setting_text_borrow(setting, &fetched);
+    if (text == cur)
+        return; /* value read back from the setting itself */
+
+    copy_len = strnlen(text, setting->text.len - 1);
+    if (!strncmp(cur, text, copy_len) && cur[copy_len] == '\0') {
+        setting_text_return(setting, fetched);
+        return;
+    }
+
+    buf = setting_text_buffer(setting);
+    if (!buf)
+        return;
+    memmove(buf, text, copy_len);
+    buf[copy_len] = '\0';
+    setting_changed(setting);
+}
+
+void setting_set_text(setting_t *setting, const char *text)
+{
+    settings_write_begin();
+    setting_text_update(setting, text);
+    settings_write_end();
+#ifdef CONFIG_SETTINGS_CALLBACK_SUPPORT
+    if (setting->on_set_callback)
+        setting->on_set_callback(setting);
+#endif
+}
+
+#ifdef CONFIG_SETTINGS_DATETIME_SUPPORT
+void setting_set_time(setting_t *setting, const setting_time_t *time)
+{
+    settings_write_begin();
+    if (setting->time.hh != time->hh || setting->time.mm != time->mm)
+        setting_changed(setting);
+    setting->time.hh = time->hh;
+    setting->time.mm = time->mm;
+    settings_write_end();
+#ifdef CONFIG_SETTINGS_CALLBACK_SUPPORT
+    if (setting->on_set_callback)
+        setting->on_set_callback(setting);
+#endif
+}
+void setting_set_date(setting_t *setting, const setting_date_t *date)
+{
+    settings_write_begin();
+    if (setting->date.day != date->day || setting->date.month != date->month || setting->date.year != date->year)
+        setting_changed(setting);
+    setting->date.day = date->day;
+    setting->date.month = date->month;
+    setting->date.year = date->year;
+    settings_write_end();
+#ifdef CONFIG_SETTINGS_CALLBACK_SUPPORT
+    if (setting->on_set_callback)
+        setting->on_set_callback(setting);
+#endif
+}
+void setting_set_datetime(setting_t *setting, const setting_datetime_t *datetime)
+{
+    settings_write_begin();
+    /* always applied to the device clock on next write */
+    setting_changed(setting);
+    setting->datetime.date.day = datetime->date.day;
+    setting->datetime.date.month = datetime->date.month;
+    setting->datetime.date.year = datetime->date.year;
+    setting->datetime.time.hh = datetime->time.hh;
+    setting->datetime.time.mm = datetime->time.mm;
+    settings_write_end();
+#ifdef CONFIG_SETTINGS_CALLBACK_SUPPORT
+    if (setting->on_set_callback)
+        setting->on_set_callback(setting);
+#endif
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_TIMEZONE_SUPPORT
+void setting_set_timezone(setting_t *setting, const char *timezone)
+{
+    settings_write_begin();
+    setting_text_update(setting, timezone);
+    settings_write_end();
+#ifdef CONFIG_SETTINGS_CALLBACK_SUPPORT
+    if (setting->on_set_callback)
+        setting->on_set_callback(setting);
+#endif
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_COLOR_SUPPORT
+void setting_set_color(setting_t *setting, const color_t *color)
+{
+    settings_write_begin();
+    if (setting->color.val.combined != color->combined)
+        setting_changed(setting);
+    setting->color.val = *color;
+    settings_write_end();
+#ifdef CONFIG_SETTINGS_CALLBACK_SUPPORT
+    if (setting->on_set_callback)
+        setting->on_set_callback(setting);
+#endif
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_NET_SUPPORT
+void setting_set_ipaddr(setting_t *setting, const ipaddr_t *ipaddr)
+{
+    settings_write_begin();
+    if (setting->ipaddr.val.addr != ipaddr->addr)
+        setting_changed(setting);
+    setting->ipaddr.val = *ipaddr;
+    settings_write_end();
+#ifdef CONFIG_SETTINGS_CALLBACK_SUPPORT
+    if (setting->on_set_callback)
+        setting->on_set_callback(setting);
+#endif
+}
+
+void setting_set_netif(setting_t *setting, const netif_conf_t *netif)
+{
+    settings_write_begin();
+    if (setting->netif.val.dhcp != netif->dhcp || setting->netif.val.ip.addr != netif->ip.addr ||
+        setting->netif.val.netmask.addr != netif->netmask.addr || setting->netif.val.gateway.addr != netif->gateway.addr)
+        setting_changed(setting);
+    setting->netif.val = *netif;
+    settings_write_end();
+#ifdef CONFIG_SETTINGS_CALLBACK_SUPPORT
+    if (setting->on_set_callback)
+        setting->on_set_callback(setting);
+#endif
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_ARRAY_SUPPORT
+esp_err_t setting_set_array(setting_t *setting, size_t offset, const void *vals, size_t count)
+{
+    size_t   size = setting_array_elem_size(setting);
+    uint8_t *dst;
+
+    if (offset > setting->array.len || count > setting->array.len - offset)
+        return ESP_ERR_INVALID_ARG;
+    dst = (uint8_t *)setting->array.val + offset * size;
+
+    settings_write_begin();
+    if (memcmp(dst, vals, count * size)) {
+        setting_changed(setting);
+        memcpy(dst, vals, count * size);
+    }
+    settings_write_end();
+#ifdef CONFIG_SETTINGS_CALLBACK_SUPPORT
+    if (setting->on_set_callback)
+        setting->on_set_callback(setting);
+#endif
+    return ESP_OK;
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_CUSTOM_TYPES
+void setting_set_custom(setting_t *setting, const void *val)
+{
+    settings_write_begin();
+    if (memcmp(setting->custom.val, val, setting->custom.size)) {
+        setting_changed(setting);
+        memcpy(setting->custom.val, val, setting->custom.size);
+    }
+    settings_write_end();
+#ifdef CONFIG_SETTINGS_CALLBACK_SUPPORT
+    if (setting->on_set_callback)
+        setting->on_set_callback(setting);
+#endif
+}
+#endif
+
+bool setting_get_bool(const setting_t *setting)
+{
+    bool val;
+
+    SETTING_READ(val, setting->boolean.val);
+    return val;
+}
+
+int setting_get_num(const setting_t *setting)
+{
+    int val;
+
+    SETTING_READ(val, setting->num.val);
+    return val;
+}
+
+int setting_get_oneof(const setting_t *setting)
+{
+    int val;
+
+    SETTING_READ(val, setting->oneof.val);
+    return val;
+}
+
+/* text and timezone settings share setting_text_t */
+static size_t setting_text_read(const setting_t *setting, char *buf, size_t buf_len)
+{
+    const setting_text_t *text = &setting->text;
+    size_t                len = 0;
+    uint32_t              seq;
+
+    if (!buf || !buf_len)
+        return 0;
+
+#ifdef CONFIG_SETTINGS_LAZY_TEXT
+    if (text->lazy) {
+        /* fetched on first access and kept until evicted */
+        settings_lock();
+        if (setting_text_load((setting_t *)setting) == ESP_OK) {
+            len = strnlen(text->val, (buf_len - 1 < text->len) ? buf_len - 1 : text->len);
+            memcpy(buf, text->val, len);
+        }
+        settings_unlock();
+        buf[len] = '\0';
+        return len;
+    }
+#endif
+
+    do {
+        seq = settings_read_begin();
+        if (text->val) {
+            /* bounded - the buffer may change while it is copied */
+            len = strnlen(text->val, (buf_len - 1 < text->len) ? buf_len - 1 : text->len);
+            memcpy(buf, text->val, len);
+        }
+    } while (settings_read_retry(seq));
+    buf[len] = '\0';
+    return len;
+}
+
+size_t setting_get_text(const setting_t *setting, char *buf, size_t buf_len)
+{
+    return setting_text_read(setting, buf, buf_len);
+}
+
+#ifdef CONFIG_SETTINGS_DATETIME_SUPPORT
+void setting_get_time(const setting_t *setting, setting_time_t *time)
+{
+    SETTING_READ(*time, setting->time);
+}
+
+void setting_get_date(const setting_t *setting, setting_date_t *date)
+{
+    SETTING_READ(*date, setting->date);
+}
+
+void setting_get_datetime(const setting_t *setting, setting_datetime_t *datetime)
+{
+    SETTING_READ(*datetime, setting->datetime);
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_TIMEZONE_SUPPORT
+size_t setting_get_timezone(const setting_t *setting, char *buf, size_t buf_len)
+{
+    return setting_text_read(setting, buf, buf_len);
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_ARRAY_SUPPORT
+esp_err_t setting_get_array(const setting_t *setting, size_t offset, void *vals, size_t count)
+{
+    size_t   size = setting_array_elem_size(setting);
+    uint32_t seq;
+
+    if (offset > setting->array.len || count > setting->array.len - offset)
+        return ESP_ERR_INVALID_ARG;
+
+    do {
+        seq = settings_read_begin();
+        memcpy(vals, (const uint8_t *)setting->array.val + offset * size, count * size);
+    } while (settings_read_retry(seq));
+    return ESP_OK;
+}
+
+/*
+ * Array update received over HTTP: `count` elements parsed into `vals`,
+ * applied from element `offset` once the whole value was read. A single
+ * number instead of a list (`scalar`) is repeated over `fill` elements, to
+ * the end of the array by default. Any invalid element drops the update.
+ */
+typedef struct {
+    uint8_t *vals;
+    size_t   offset;
+    size_t   count;
+    size_t   fill;
+    bool     scalar;
+    bool     ok;
+} setting_array_update_t;
+
+static bool setting_array_update_begin(const setting_t *setting, setting_array_update_t *upd)
+{
+    memset(upd, 0, sizeof(*upd));
+    upd->vals = malloc(setting_array_size(setting));
+    upd->ok = upd->vals != NULL;
+    return upd->ok;
+}
+
+static void setting_array_update_put(const setting_t *setting, setting_array_update_t *upd, float val)
+{
+    if (upd->count < setting->array.len && setting_array_elem_put(setting, upd->vals, upd->count, val))
+        upd->count++;
+    else
+        upd->ok = false;
+}
+
+static void setting_array_update_end(setting_t *setting, setting_array_update_t *upd)
+{
+    size_t size = setting_array_elem_size(setting);
+    size_t count = upd->count;
+
+    if (upd->ok && upd->scalar) {
+        count = upd->fill ? upd->fill : setting->array.len - (upd->offset < setting->array.len ? upd->offset : 0);
+        if (count > setting->array.len)
+            upd->ok = false;
+        for (size_t i = 1; upd->ok && i < count; i++)
+            memcpy(upd->vals + i * size, upd->vals, size);
+    } else if (upd->fill && upd->fill != upd->count) {
+        upd->ok = false;
+    }
+    if (upd->ok && setting_set_array(setting, upd->offset, upd->vals, count) != ESP_OK)
+        upd->ok = false;
+    if (!upd->ok)
+        ESP_LOGW(TAG, "%s: invalid array update", setting->nvs_id);
+    free(upd->vals);
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_CUSTOM_TYPES
+void setting_get_custom(const setting_t *setting, void *val)
+{
+    uint32_t seq;
+
+    do {
+        seq = settings_read_begin();
+        memcpy(val, setting->custom.val, setting->custom.size);
+    } while (settings_read_retry(seq));
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_LAZY_TEXT
+esp_err_t setting_text_evict(setting_t *setting)
+{
+    esp_err_t rc = ESP_OK;
+
+    if (!setting || !setting_text_lazy(setting))
+        return ESP_ERR_INVALID_ARG;
+
+    settings_lock();
+    if (setting->dirty)
+        rc = ESP_ERR_INVALID_STATE;
+    else if (setting->text.val != setting->text.def)
+        setting_text_drop(setting);
+    settings_unlock();
+    return rc;
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_COLOR_SUPPORT
+void setting_get_color(const setting_t *setting, color_t *color)
+{
+    SETTING_READ(*color, setting->color.val);
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_NET_SUPPORT
+void setting_get_ipaddr(const setting_t *setting, ipaddr_t *ipaddr)
+{
+    SETTING_READ(*ipaddr, setting->ipaddr.val);
+}
+
+void setting_get_netif(const setting_t *setting, netif_conf_t *netif)
+{
+    SETTING_READ(*netif, setting->netif.val);
+}
+#endif
+
+/* stored value, the same in NVS entries and group blob records */
+typedef union {
+    int8_t   i8;
+    int32_t  i32;
+    uint16_t u16;
+    uint32_t u32;
+#ifdef CONFIG_SETTINGS_NET_SUPPORT
+    setting_netif_blob_t netif;
+#endif
+} setting_value_t;
+
+static size_t value_put(void *buf, const void *val, size_t len)
+{
+    if (buf)
+        memcpy(buf, val, len);
+    return len;
+}
+
+static size_t setting_bool_encode(const setting_t *setting, void *buf)
+{
+    int8_t val = setting->boolean.val;
+
+    return value_put(buf, &val, sizeof(val));
+}
+
+static esp_err_t setting_bool_decode(setting_t *setting, const void *val, size_t len)
+{
+    if (len != sizeof(int8_t))
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    setting_set_bool(setting, *(const int8_t *)val);
+    return ESP_OK;
+}
+
+static size_t setting_num_encode(const setting_t *setting, void *buf)
+{
+    int32_t val = setting->num.val;
+
+    return value_put(buf, &val, sizeof(val));
+}
+
+static esp_err_t setting_num_decode(setting_t *setting, const void *val, size_t len)
+{
+    int32_t num;
+
+    if (len != sizeof(num))
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    memcpy(&num, val, sizeof(num));
+    setting_set_num(setting, num);
+    return ESP_OK;
+}
+
+static size_t setting_oneof_encode(const setting_t *setting, void *buf)
+{
+    int8_t val = setting->oneof.val;
+
+    return value_put(buf, &val, sizeof(val));
+}
+
+static esp_err_t setting_oneof_decode(setting_t *setting, const void *val, size_t len)
+{
+    if (len != sizeof(int8_t))
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    setting_set_oneof(setting, *(const int8_t *)val);
+    return ESP_OK;
+}
+
+/* text includes the terminating NUL, a lazy value not fetched yet has none */
+static size_t setting_text_encode(const setting_t *setting, void *buf)
+{
+    return setting->text.val ? value_put(buf, setting->text.val, strlen(setting->text.val) + 1) : 0;
+}
+
+static esp_err_t setting_text_decode(setting_t *setting, const void *val, size_t len)
+{
+    const char *text = val;
+
+    if (!len || text[len - 1] != '\0' || len > setting->text.len)
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    setting_set_text(setting, text);
+    return ESP_OK;
+}
+
+#ifdef CONFIG_SETTINGS_DATETIME_SUPPORT
+static size_t setting_time_encode(const setting_t *setting, void *buf)
+{
+    uint16_t val = setting_time_pack(&setting->time);
+
+    return value_put(buf, &val, sizeof(val));
+}
+
+static esp_err_t setting_time_decode(setting_t *setting, const void *val, size_t len)
+{
+    uint16_t       packed;
+    setting_time_t time;
+
+    if (len != sizeof(packed))
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    memcpy(&packed, val, sizeof(packed));
+    setting_time_unpack(&time, packed);
+    setting_set_time(setting, &time);
+    return ESP_OK;
+}
+
+static size_t setting_date_encode(const setting_t *setting, void *buf)
+{
+    uint32_t val = setting_date_pack(&setting->date);
+
+    return value_put(buf, &val, sizeof(val));
+}
+
+static esp_err_t setting_date_decode(setting_t *setting, const void *val, size_t len)
+{
+    uint32_t       packed;
+    setting_date_t date;
+
+    if (len != sizeof(packed))
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    memcpy(&packed, val, sizeof(packed));
+    setting_date_unpack(&date, packed);
+    setting_set_date(setting, &date);
+    return ESP_OK;
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_COLOR_SUPPORT
+static size_t setting_color_encode(const setting_t *setting, void *buf)
+{
+    return value_put(buf, &setting->color.val.combined, sizeof(uint32_t));
+}
+
+static esp_err_t setting_color_decode(setting_t *setting, const void *val, size_t len)
+{
+    color_t color;
+
+    if (len != sizeof(color.combined))
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    memcpy(&color.combined, val, sizeof(color.combined));
+    setting_set_color(setting, &color);
+    return ESP_OK;
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_NET_SUPPORT
+static size_t setting_ipaddr_encode(const setting_t *setting, void *buf)
+{
+    return value_put(buf, &setting->ipaddr.val.addr, sizeof(uint32_t));
+}
+
+static esp_err_t setting_ipaddr_decode(setting_t *setting, const void *val, size_t len)
+{
+    ipaddr_t ipaddr;
+
+    if (len != sizeof(ipaddr.addr))
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    memcpy(&ipaddr.addr, val, sizeof(ipaddr.addr));
+    setting_set_ipaddr(setting, &ipaddr);
+    return ESP_OK;
+}
+
+static size_t setting_netif_encode(const setting_t *setting, void *buf)
+{
+    setting_netif_blob_t blob;
+
+    setting_netif_to_blob(&setting->netif.val, &blob);
+    return value_put(buf, &blob, sizeof(blob));
+}
+
+static esp_err_t setting_netif_decode(setting_t *setting, const void *val, size_t len)
+{
+    setting_netif_blob_t blob;
+    netif_conf_t         netif;
+
+    if (len != sizeof(blob))
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    memcpy(&blob, val, sizeof(blob));
+    setting_netif_from_blob(&netif, &blob);
+    setting_set_netif(setting, &netif);
+    return ESP_OK;
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_ARRAY_SUPPORT
+static size_t setting_array_encode(const setting_t *setting, void *buf)
+{
+    return value_put(buf, setting->array.val, setting_array_size(setting));
+}
+
+static esp_err_t setting_array_decode(setting_t *setting, const void *val, size_t len)
+{
+    if (len != setting_array_size(setting))
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    return setting_set_array(setting, 0, val, setting->array.len);
+}
+#endif
+
+/*
+ * Text values are read straight into the setting buffer, NVS refuses values
+ * longer than `len`. A failed read may leave a partial value behind (CRC
+ * errors are reported as not found), so the default is restored then.
+ */
+static esp_err_t setting_text_nvs_read(setting_t *setting, nvs_handle_t nvs)
+{
+    size_t    len = setting->text.len;
+    esp_err_t rc;
+
+    if (!setting->text.val || !len)
+        return ESP_ERR_INVALID_STATE;
+
+    settings_write_begin();
+    rc = nvs_get_str(nvs, setting->nvs_id, setting->text.val, &len);
+    if (rc == ESP_OK)
+        settings_generation_bump(setting);
+    else
+        setting_text_reset(setting);
+    settings_write_end();
+#ifdef CONFIG_SETTINGS_CALLBACK_SUPPORT
+    if (rc == ESP_OK && setting->on_set_callback)
+        setting->on_set_callback(setting);
+#endif
+    return rc;
+}
+
+static esp_err_t setting_text_nvs_write(setting_t *setting, nvs_handle_t nvs)
+{
+    /* lazy value not fetched yet is still stored */
+    return setting->text.val ? nvs_set_str(nvs, setting->nvs_id, setting->text.val) : ESP_OK;
+}
+
+#if defined(CONFIG_SETTINGS_ARRAY_SUPPORT) || defined(CONFIG_SETTINGS_CUSTOM_TYPES)
+/*
+ * Blob values larger than the stored value union are read straight into
+ * their buffer of `size` bytes. As with text a failed read may leave a
+ * partial value behind, the default is restored then.
+ */
+static esp_err_t setting_buf_nvs_read(setting_t *setting, nvs_handle_t nvs, void *buf, size_t size)
+{
+    size_t    len = size;
+    esp_err_t rc;
+
+    settings_write_begin();
+    rc = nvs_get_blob(nvs, setting->nvs_id, buf, &len);
+    if (rc == ESP_OK && len != size)
+        rc = ESP_ERR_NVS_INVALID_LENGTH;
+    if (rc == ESP_OK)
+        settings_generation_bump(setting);
+    else
+        setting_ops(setting)->set_default(setting);
+    settings_write_end();
+#ifdef CONFIG_SETTINGS_CALLBACK_SUPPORT
+    if (rc == ESP_OK && setting->on_set_callback)
+        setting->on_set_callback(setting);
+#endif
+    return rc;
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_ARRAY_SUPPORT
+static esp_err_t setting_array_nvs_read(setting_t *setting, nvs_handle_t nvs)
+{
+    return setting_buf_nvs_read(setting, nvs, setting->array.val, setting_array_size(setting));
+}
+
+/* one blob for the whole array */
+static esp_err_t setting_array_nvs_write(setting_t *setting, nvs_handle_t nvs)
+{
+    return nvs_set_blob(nvs, setting->nvs_id, setting->array.val, setting_array_size(setting));
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_DATETIME_SUPPORT
+static esp_err_t setting_datetime_nvs_read(setting_t *setting, nvs_handle_t nvs)
+{
+    /* this is current date and time on device not from nvs */
+    settings_write_begin();
+    datetime_gettimeofday(&setting->datetime);
+    settings_write_end();
+    return ESP_OK;
+}
+
+static esp_err_t setting_datetime_nvs_write(setting_t *setting, nvs_handle_t nvs)
+{
+    /* set date and time on device - do not store in nvs */
+    return datetime_settimeofday(&setting->datetime);
+}
+#endif
+
+static esp_err_t setting_nvs_read(setting_t *setting, nvs_handle_t nvs)
+{
+    const setting_ops_t *ops = setting_ops(setting);
+    setting_value_t      val;
+    size_t               len;
+    esp_err_t            rc;
+
+#ifdef CONFIG_SETTINGS_LAZY_TEXT
+    if (setting_text_lazy(setting)) {
+        /* fetched on first access - a cached copy may be stale */
+        setting_text_drop(setting);
+        return ESP_OK;
+    }
+#endif
+    if (ops->nvs_read)
+        return ops->nvs_read(setting, nvs);
+
+    switch (ops->nvs_type) {
+    case NVS_TYPE_I8:
+        rc = nvs_get_i8(nvs, setting->nvs_id, &val.i8);
+        len = sizeof(val.i8);
+        break;
+    case NVS_TYPE_I32:
+        rc = nvs_get_i32(nvs, setting->nvs_id, &val.i32);
+        len = sizeof(val.i32);
+        break;
+    case NVS_TYPE_U16:
+        rc = nvs_get_u16(nvs, setting->nvs_id, &val.u16);
+        len = sizeof(val.u16);
+        break;
+    case NVS_TYPE_U32:
+        rc = nvs_get_u32(nvs, setting->nvs_id, &val.u32);
+        len = sizeof(val.u32);
+        break;
+    case NVS_TYPE_BLOB:
+        len = sizeof(val);
+        rc = nvs_get_blob(nvs, setting->nvs_id, &val, &len);
+        break;
+    default:
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    return rc == ESP_OK ? ops->decode(setting, &val, len) : rc;
+}
+
+#ifdef CONFIG_SETTINGS_STORAGE_GROUP_BLOB
+/*
+ * Group blob layout: header followed by one record per persistent setting
+ *
+ *   [id_len:1][id:id_len][type:1][val_len:2][value:val_len]
+ *
+ * Records are matched by setting id, so settings added, removed or reordered
+ * between firmware versions keep their stored values. Values use the same
+ * representation as the per-key entries, text includes the terminating NUL.
+ */
+#define SETTINGS_BLOB_VERSION 1
+
+typedef struct {
+    uint8_t  version;
+    uint8_t  reserved;
+    uint16_t count; /* number of records */
+    uint32_t crc;   /* CRC-32 of the records */
+} settings_blob_hdr_t;
+
+static uint32_t settings_crc32(const uint8_t *data, size_t len)
+{
+    /* CRC-32 (IEEE), 4 bits per step */
+    static const uint32_t crc_table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+    };
+    uint32_t crc = 0xFFFFFFFF;
+
+    while (len--) {
+        crc ^= *data++;
+        crc = (crc >> 4) ^ crc_table[crc & 0x0F];
+        crc = (crc >> 4) ^ crc_table[crc & 0x0F];
+    }
+    return ~crc;
+}
+
+static bool setting_id_match(const setting_t *setting, const char *id, size_t id_len)
+{
+    return !strncmp(setting->id, id, id_len) && setting->id[id_len] == '\0';
+}
+
+/* records are written in declaration order, so the expected setting is tried first */
+static setting_t *settings_group_find_n(const settings_group_t *gr, setting_t *hint, const char *id, size_t id_len)
+{
+    if (hint && hint->id && setting_id_match(hint, id, id_len))
+        return hint;
+
+    for (setting_t *setting = gr->settings; setting->id; setting++) {
+        if (setting_id_match(setting, id, id_len))
+            return setting;
+    }
+    return NULL;
+}
+
+/*
+ * Load settings of a group from its blob. With dirty_only set, only settings
+ * with uncommitted changes are restored.
+ */
+static esp_err_t settings_group_nvs_read(const settings_group_t *gr, nvs_handle_t nvs, bool dirty_only)
+{
+    settings_blob_hdr_t hdr;
+    uint8_t            *blob;
+    size_t              len = 0;
+    size_t              pos = sizeof(hdr);
+    setting_t          *hint = gr->settings;
+    esp_err_t           rc;
+
+    rc = nvs_get_blob(nvs, gr->id, NULL, &len);
+    if (rc != ESP_OK)
+        return rc;
+    if (len < sizeof(hdr))
+        return ESP_ERR_NVS_INVALID_LENGTH;
+
+    blob = malloc(len);
+    if (!blob)
+        return ESP_ERR_NO_MEM;
+
+    rc = nvs_get_blob(nvs, gr->id, blob, &len);
+    if (rc != ESP_OK)
+        goto out;
+
+    memcpy(&hdr, blob, sizeof(hdr));
+    if (hdr.version != SETTINGS_BLOB_VERSION) {
+        rc = ESP_ERR_INVALID_VERSION;
+        goto out;
+    }
+    if (hdr.crc != settings_crc32(blob + sizeof(hdr), len - sizeof(hdr))) {
+        rc = ESP_ERR_INVALID_CRC;
+        goto out;
+    }
+
+    for (uint16_t rec = 0; rec < hdr.count; rec++) {
+        const char *id;
+        size_t      id_len;
+        uint8_t     type;
+        size_t      val_len;
+        setting_t  *setting;
+
+        if (pos + 1 > len || pos + 1 + blob[pos] + 3 > len) {
+            rc = ESP_ERR_NVS_INVALID_LENGTH;
+            break;
+        }
+        id_len = blob[pos++];
+        id = (const char *)&blob[pos];
+        pos += id_len;
+        type = blob[pos++];
+        val_len = blob[pos] | (blob[pos + 1] << 8);
+        pos += 2;
+        if (pos + val_len > len) {
+            rc = ESP_ERR_NVS_INVALID_LENGTH;
+            break;
+        }
+
+        /* settings removed or retyped since the blob was written are skipped */
+        setting = settings_group_find_n(gr, hint, id, id_len);
+        if (setting)
+            hint = setting + 1;
+        if (setting && setting->type == type && setting_is_persistent(setting) && (!dirty_only || setting->dirty)) {
+            if (setting_ops(setting)->decode(setting, &blob[pos], val_len) != ESP_OK)
+                ESP_LOGW(TAG, "invalid value %s:%.*s", gr->id, (int)id_len, id);
+        }
+        pos += val_len;
+    }
+
+out:
+    free(blob);
+    return rc;
+}
+
+#ifdef CONFIG_SETTINGS_WEAR_STATS
+/* the blob is one write, the dirty settings of the group are what caused it */
+static void settings_group_wear_record(settings_index_t *index, const settings_group_t *gr, size_t bytes)
+{
+    if (!index)
+        return;
+    settings_wear_add(index, bytes, nvs_entries_of(NVS_TYPE_BLOB, bytes));
+    for (setting_t *setting = gr->settings; setting->id; setting++) {
+        if (setting->dirty && setting_is_persistent(setting))
+            setting_wear_count(index, setting);
+    }
+}
+#endif
+
+/* records store the value length in 16 bits, texts may grow up to their buffer */
+static esp_err_t settings_blob_check(const settings_group_t *pack)
+{
+    for (const settings_group_t *gr = pack; gr->id; gr++) {
+        for (setting_t *setting = gr->settings; setting->id; setting++) {
+            const setting_ops_t *ops = setting_ops(setting);
+            size_t               len;
+
+            if (!setting_is_persistent(setting))
+                continue;
+            len = ops->encode == setting_text_encode ? setting->text.len : ops->encode(setting, NULL);
+            if (len > UINT16_MAX) {
+                ESP_LOGE(TAG, "%s:%s too large for a group blob (%u bytes)", gr->id, setting->id, (unsigned)len);
+                return ESP_ERR_INVALID_SIZE;
+            }
+        }
+    }
+    return ESP_OK;
+}
+
+/* `index` is the pack index the write is accounted to, NULL if none */
+static esp_err_t settings_group_nvs_write(settings_index_t *index, const settings_group_t *gr, nvs_handle_t nvs)
+{
+    settings_blob_hdr_t hdr = { .version = SETTINGS_BLOB_VERSION };
+    uint8_t            *blob;
+    size_t              len = sizeof(hdr);
+    size_t              pos = sizeof(hdr);
+    esp_err_t           rc;
+
+    for (setting_t *setting = gr->settings; setting->id; setting++) {
+        if (setting_is_persistent(setting))
+            len += 1 + strlen(setting->id) + 1 + 2 + setting_ops(setting)->encode(setting, NULL);
+    }
+
+    blob = malloc(len);
+    if (!blob)
+        return ESP_ERR_NO_MEM;
+
+    for (setting_t *setting = gr->settings; setting->id; setting++) {
+        size_t id_len = strlen(setting->id);
+        size_t val_len;
+
+        if (!setting_is_persistent(setting))
+            continue;
+
+        blob[pos++] = id_len;
+        memcpy(&blob[pos], setting->id, id_len);
+        pos += id_len;
+        blob[pos++] = setting->type;
+        val_len = setting_ops(setting)->encode(setting, &blob[pos + 2]);
+        blob[pos++] = val_len & 0xFF;
+        blob[pos++] = val_len >> 8;
+        pos += val_len;
+        hdr.count++;
+    }
+    hdr.crc = settings_crc32(blob + sizeof(hdr), len - sizeof(hdr));
+    memcpy(blob, &hdr, sizeof(hdr));
+
+    rc = nvs_set_blob(nvs, gr->id, blob, len);
+    free(blob);
+#ifdef CONFIG_SETTINGS_METRICS
+    if (rc == ESP_OK)
+        settings_metrics_nvs_write(len);
+#endif
+#ifdef CONFIG_SETTINGS_WEAR_STATS
+    if (rc == ESP_OK)
+        settings_group_wear_record(index, gr, len);
+#endif
+    return rc;
+}
+
+/* move values stored with the per-key layout into group blobs */
+static void settings_nvs_migrate(const settings_group_t *settings_pack)
+{
+    nvs_handle_t nvs;
+    esp_err_t    rc;
+
+    /* groups loaded from per-key entries are dirty and written as blobs */
+    rc = settings_nvs_write(settings_pack);
+    if (rc != ESP_OK) {
+        ESP_LOGE(TAG, "nvs migrate error %s", esp_err_to_name(rc));
+        return;
+    }
+
+    rc = settings_ctx_nvs_open(settings_pack_ctx(settings_pack), NVS_READWRITE, &nvs);
+    if (rc != ESP_OK)
+        return;
+    for (const settings_group_t *gr = settings_pack; gr->id; gr++) {
+        for (setting_t *setting = gr->settings; setting->id; setting++)
+            nvs_erase_key(nvs, setting->nvs_id);
+    }
+    settings_nvs_commit(nvs);
+    nvs_close(nvs);
+    ESP_LOGI(TAG, "per-key entries migrated to group blobs");
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_WRITE_BACK
+/*
+ * The first change after a flush wakes the write-back task. It then waits
+ * until a whole quiet period passes without the generation changing, but no
+ * longer than the maximum delay, and stores all dirty settings with a single
+ * commit. Setters only pay for a flag test while the task is waiting.
+ */
+static uint32_t settings_writeback_generation(void)
+{
+    uint32_t gen;
+
+    settings_lock();
+    gen = settings_generation;
+    settings_unlock();
+    return gen;
+}
+
+static void settings_writeback_task(void *arg)
+{
+    const TickType_t quiet = pdMS_TO_TICKS(CONFIG_SETTINGS_WRITE_BACK_QUIET_MS);
+    const TickType_t max_delay = pdMS_TO_TICKS(CONFIG_SETTINGS_WRITE_BACK_MAX_DELAY_MS);
+
+    for (;;) {
+        TickType_t first;
+        TickType_t elapsed;
+        uint32_t   gen;
+        esp_err_t  rc;
+
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        first = xTaskGetTickCount();
+        gen = settings_writeback_generation();
+        while ((elapsed = xTaskGetTickCount() - first) < max_delay) {
+            uint32_t now;
+
+            vTaskDelay(quiet < max_delay - elapsed ? quiet : max_delay - elapsed);
+            now = settings_writeback_generation();
+            if (now == gen)
+                break;
+            gen = now;
+        }
+
+        settings_lock();
+        writeback_pending = false;
+        settings_unlock();
+        rc = settings_flush();
+        if (rc != ESP_OK && rc != ESP_ERR_INVALID_STATE) {
+            /* values stay dirty - try again after the maximum delay */
+            ESP_LOGW(TAG, "write-back failed: %s", esp_err_to_name(rc));
+            settings_lock();
+            writeback_pending = true;
+            settings_unlock();
+            xTaskNotifyGive(writeback_task);
+            vTaskDelay(max_delay);
+        }
+    }
+}
+
+/* packs never loaded are not flushed, their updates are written through */
+static bool settings_writeback_covers(const settings_group_t *pack)
+{
+    settings_index_t *index;
+
+    if (!writeback_task)
+        return false;
+    settings_lock();
+    index = settings_index_get(pack);
+    settings_unlock();
+    return index && index->loaded;
+}
+
+static void settings_writeback_shutdown(void)
+{
+    settings_flush();
+}
+
+static void settings_writeback_start(void)
+{
+    if (writeback_task)
+        return;
+
+    if (xTaskCreate(settings_writeback_task, "settings_wb", CONFIG_SETTINGS_WRITE_BACK_TASK_STACK_SIZE, NULL,
+                    CONFIG_SETTINGS_WRITE_BACK_TASK_PRIORITY, &writeback_task) != pdPASS) {
+        /* HTTP updates keep writing through */
+        ESP_LOGE(TAG, "write-back task start failed");
+        writeback_task = NULL;
+        return;
+    }
+    esp_register_shutdown_handler(settings_writeback_shutdown);
+}
+#endif
+
+#ifndef CONFIG_SETTINGS_STORAGE_GROUP_BLOB
+#ifdef CONFIG_SETTINGS_NVS_BULK_READ
+/* with more than an eighth of declared settings stored, looking up key by key is cheaper */
+#define SETTINGS_BULK_READ_MAX(index) ((index)->count / 8)
+
+static setting_t *settings_nvs_entry_setting(const settings_index_t *index, const nvs_entry_info_t *info)
+{
+    char  key[NVS_KEY_NAME_MAX_SIZE];
+    char *id;
+
+    strncpy(key, info->key, sizeof(key) - 1);
+    key[sizeof(key) - 1] = '\0';
+    id = strchr(key, ':');
+    if (!id)
+        return NULL;
+    *id++ = '\0';
+
+    /* keys of settings removed from the firmware are left alone */
+    return settings_index_lookup(index, key, id, NULL);
+}
+
+/*
+ * Walk the entries stored in the namespace once and resolve every key through
+ * the hash index, so settings never stored (left at default) cost nothing.
+ * Values are read after the walk; it gives up with ESP_ERR_INVALID_SIZE when
+ * most settings turn out to be stored.
+ */
+static esp_err_t settings_nvs_read_bulk(const settings_group_t *settings_pack, nvs_handle_t nvs)
+{
+    const settings_index_t *index = settings_index_get(settings_pack);
+    nvs_iterator_t          it = NULL;
+    nvs_entry_info_t        info;
+    setting_t             **found;
+    uint32_t                count = 0;
+    esp_err_t               rc;
+
+    if (!index)
+        return ESP_ERR_INVALID_STATE;
+    if (!SETTINGS_BULK_READ_MAX(index))
+        return ESP_ERR_INVALID_SIZE;
+
+    found = malloc(SETTINGS_BULK_READ_MAX(index) * sizeof(setting_t *));
+    if (!found)
+        return ESP_ERR_NO_MEM;
+
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
+    for (rc = nvs_entry_find(settings_ctx_partition(index->ctx), settings_ctx_namespace(index->ctx), NVS_TYPE_ANY, &it);
+         rc == ESP_OK; rc = nvs_entry_next(&it)) {
+#else
+    rc = ESP_ERR_NVS_NOT_FOUND;
+    for (it = nvs_entry_find(settings_ctx_partition(index->ctx), settings_ctx_namespace(index->ctx), NVS_TYPE_ANY); it;
+         it = nvs_entry_next(it)) {
+#endif
+        setting_t *setting;
+
+        nvs_entry_info(it, &info);
+        setting = settings_nvs_entry_setting(index, &info);
+        if (!setting)
+            continue;
+        if (count == SETTINGS_BULK_READ_MAX(index)) {
+            rc = ESP_ERR_INVALID_SIZE;
+            break;
+        }
+        found[count++] = setting;
+    }
+    /* NULL once nvs_entry_next() reached the end */
+    nvs_release_iterator(it);
+
+    if (rc == ESP_ERR_NVS_NOT_FOUND) {
+        for (uint32_t i = 0; i < count; i++)
+            setting_nvs_read(found[i], nvs);
+        rc = ESP_OK;
+    }
+    free(found);
+    return rc;
+}
+#endif
+
+static void settings_pack_nvs_read_keys(const settings_group_t *settings_pack, nvs_handle_t nvs)
+{
+#ifdef CONFIG_SETTINGS_NVS_BULK_READ
+    esp_err_t rc = settings_nvs_read_bulk(settings_pack, nvs);
+
+    if (rc == ESP_OK)
+        return;
+    if (rc != ESP_ERR_INVALID_SIZE)
+        ESP_LOGW(TAG, "nvs iterate: %s", esp_err_to_name(rc));
+#endif
+    for (const settings_group_t *gr = settings_pack; gr->id; gr++) {
+        for (setting_t *setting = gr->settings; setting->id; setting++)
+            setting_nvs_read(setting, nvs);
+    }
+}
+#endif
+
+esp_err_t settings_nvs_read(const settings_group_t *settings_pack)
+{
+    int64_t           start = settings_metrics_start();
+    settings_index_t *index;
+    nvs_handle        nvs;
+    esp_err_t         rc;
+    esp_err_t         status = ESP_OK; /* defaults stay in effect on errors, only counted */
+#ifdef CONFIG_SETTINGS_STORAGE_GROUP_BLOB
+    bool migrate = false;
+#endif
+
+    ESP_LOGI(TAG, "NVS init");
+    nvs_flash_init();
+
+    settings_lock();
+    if (!settings_epoch)
+        settings_epoch = esp_random();
+    settings_pack_set_defaults(settings_pack);
+    settings_pack_update_nvs_ids(settings_pack);
+
+    rc = settings_ctx_nvs_open(settings_pack_ctx(settings_pack), NVS_READONLY, &nvs);
+    if (rc == ESP_OK) {
+#ifdef CONFIG_SETTINGS_STORAGE_GROUP_BLOB
+        for (const settings_group_t *gr = settings_pack; gr->id; gr++) {
+            bool legacy = false;
+
+            rc = settings_group_nvs_read(gr, nvs, false);
+            if (rc == ESP_OK) {
+                settings_group_set_dirty(gr, false);
+                continue;
+            }
+            if (rc != ESP_ERR_NVS_NOT_FOUND) {
+                /* keep defaults, rewritten with the next commit */
+                ESP_LOGW(TAG, "nvs group %s: %s", gr->id, esp_err_to_name(rc));
+                settings_group_set_dirty(gr, true);
+                continue;
+            }
+            /* no blob yet - values may still be stored one key per setting */
+            for (setting_t *setting = gr->settings; setting->id; setting++) {
+                if (setting_nvs_read(setting, nvs) == ESP_OK && setting_is_persistent(setting))
+                    legacy = true;
+            }
+            settings_group_set_dirty(gr, legacy);
+            migrate |= legacy;
+        }
+#else
+        settings_pack_nvs_read_keys(settings_pack, nvs);
+        /* in-memory values now match NVS contents */
+        settings_pack_set_dirty(settings_pack, false);
+#endif
+        nvs_close(nvs);
+    } else if (rc == ESP_ERR_NVS_NOT_FOUND) {
+        /* nothing stored yet - defaults are in effect */
+        settings_pack_set_dirty(settings_pack, false);
+    } else {
+        ESP_LOGW(TAG, "nvs open error %s", esp_err_to_name(rc));
+        status = rc;
+    }
+#ifdef CONFIG_SETTINGS_STORAGE_GROUP_BLOB
+    if (migrate)
+        settings_nvs_migrate(settings_pack);
+#endif
+#ifdef CONFIG_SETTINGS_NOTIFY_SUPPORT
+    /* loaded values are the starting point, not changes */
+    settings_pack_clear_changed(settings_pack);
+#endif
+    index = settings_index_get(settings_pack);
+    if (index)
+        index->loaded = true;
+#ifdef CONFIG_SETTINGS_CHANGE_FEED
+    feed_start = settings_generation;
+#endif
+#ifdef CONFIG_SETTINGS_WRITE_BACK
+    settings_writeback_start();
+#endif
+    settings_unlock();
+    settings_metrics_op(SETTINGS_METRIC_NVS_READ, start, status);
+    return ESP_OK;
+}
+
+#if defined(CONFIG_SETTINGS_METRICS) || defined(CONFIG_SETTINGS_WEAR_STATS)
+/* bytes of the value stored by setting_nvs_write(), 0 if nothing is stored */
+static size_t setting_nvs_size(const setting_t *setting)
+{
+    const setting_ops_t *ops = setting_ops(setting);
+
+    return ops->encode ? ops->encode(setting, NULL) : 0;
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_WEAR_STATS
+static void setting_wear_record(settings_index_t *index, const setting_t *setting, size_t bytes)
+{
+    if (!index)
+        return;
+    settings_wear_add(index, bytes, nvs_entries_of(setting_ops(setting)->nvs_type, bytes));
+    setting_wear_count(index, setting);
+}
+#endif
+
+/* `index` is the pack index the write is accounted to, NULL if none */
+static esp_err_t setting_nvs_write(settings_index_t *index, setting_t *setting, nvs_handle_t nvs)
+{
+    const setting_ops_t *ops = setting_ops(setting);
+    setting_value_t      val;
+    size_t               len;
+    esp_err_t            rc;
+
+    if (ops->nvs_write) {
+        rc = ops->nvs_write(setting, nvs);
+    } else {
+        len = ops->encode ? ops->encode(setting, &val) : 0;
+        switch (ops->nvs_type) {
+        case NVS_TYPE_I8:
+            rc = nvs_set_i8(nvs, setting->nvs_id, val.i8);
+            break;
+        case NVS_TYPE_I32:
+            rc = nvs_set_i32(nvs, setting->nvs_id, val.i32);
+            break;
+        case NVS_TYPE_U16:
+            rc = nvs_set_u16(nvs, setting->nvs_id, val.u16);
+            break;
+        case NVS_TYPE_U32:
+            rc = nvs_set_u32(nvs, setting->nvs_id, val.u32);
+            break;
+        case NVS_TYPE_BLOB:
+            rc = nvs_set_blob(nvs, setting->nvs_id, &val, len);
+            break;
+        default:
+            rc = ESP_ERR_NOT_SUPPORTED;
+            break;
+        }
+    }
+#ifdef CONFIG_SETTINGS_METRICS
+    if (rc == ESP_OK && setting_nvs_size(setting))
+        settings_metrics_nvs_write(setting_nvs_size(setting));
+#endif
+#ifdef CONFIG_SETTINGS_WEAR_STATS
+    if (rc == ESP_OK && setting_nvs_size(setting))
+        setting_wear_record(index, setting, setting_nvs_size(setting));
+#endif
+    return rc;
+}
+
+#ifdef CONFIG_SETTINGS_STORAGE_GROUP_BLOB
+/*
+ * Undo log entry: raw group blob stored in NVS before the transaction
+ * overwrote it, `len` is 0 if the group had no blob yet.
+ */
+typedef struct settings_undo {
+    struct settings_undo   *next;
+    const settings_group_t *group;
+    size_t                  len;
+    uint8_t                 blob[];
+} settings_undo_t;
+
+static esp_err_t group_undo_push(settings_undo_t **undo_log, const settings_group_t *gr, nvs_handle_t nvs)
+{
+    settings_undo_t *undo;
+    size_t           len = 0;
+
+    if (nvs_get_blob(nvs, gr->id, NULL, &len) != ESP_OK)
+        len = 0;
+
+    undo = calloc(1, sizeof(settings_undo_t) + len);
+    if (!undo)
+        return ESP_ERR_NO_MEM;
+
+    undo->group = gr;
+    if (len && nvs_get_blob(nvs, gr->id, undo->blob, &len) == ESP_OK)
+        undo->len = len;
+    undo->next = *undo_log;
+    *undo_log = undo;
+    return ESP_OK;
+}
+
+/* restoring writes wear the flash too, they are counted like the writes they undo */
+static void settings_undo_rollback(settings_undo_t *undo_log, settings_index_t *index, nvs_handle_t nvs)
+{
+    for (settings_undo_t *undo = undo_log; undo; undo = undo->next) {
+        if (!undo->len) {
+            nvs_erase_key(nvs, undo->group->id);
+            continue;
+        }
+        if (nvs_set_blob(nvs, undo->group->id, undo->blob, undo->len) != ESP_OK)
+            continue;
+#ifdef CONFIG_SETTINGS_METRICS
+        settings_metrics_nvs_write(undo->len);
+#endif
+#ifdef CONFIG_SETTINGS_WEAR_STATS
+        settings_group_wear_record(index, undo->group, undo->len);
+#endif
+    }
+}
+#else
+/*
+ * Undo log entry: raw value stored in NVS before the transaction overwrote
+ * it. Strings and blobs are copied after the entry. The value is kept as
+ * stored rather than decoded into a setting copy, so no setter range check
+ * or change hook runs for it.
+ */
+typedef struct settings_undo {
+    struct settings_undo *next;
+    setting_t            *setting;
+    bool                  stored; /* false - the key is erased on rollback */
+    size_t                len;
+    setting_value_t       val;
+    uint8_t               data[];
+} settings_undo_t;
+
+static esp_err_t setting_undo_push(settings_undo_t **undo_log, setting_t *setting, nvs_handle_t nvs)
+{
+    nvs_type_t       type = setting_ops(setting)->nvs_type;
+    settings_undo_t *undo;
+    size_t           len = 0;
+    esp_err_t        rc = ESP_OK;
+
+    if (type == NVS_TYPE_STR)
+        rc = nvs_get_str(nvs, setting->nvs_id, NULL, &len);
+    else if (type == NVS_TYPE_BLOB)
+        rc = nvs_get_blob(nvs, setting->nvs_id, NULL, &len);
+    if (rc != ESP_OK)
+        len = 0;
+
+    undo = calloc(1, sizeof(settings_undo_t) + len);
+    if (!undo)
+        return ESP_ERR_NO_MEM;
+
+    undo->setting = setting;
+    undo->len = len;
+    if (rc == ESP_OK) {
+        switch (type) {
+        case NVS_TYPE_I8:
+            rc = nvs_get_i8(nvs, setting->nvs_id, &undo->val.i8);
+            break;
+        case NVS_TYPE_I32:
+            rc = nvs_get_i32(nvs, setting->nvs_id, &undo->val.i32);
+            break;
+        case NVS_TYPE_U16:
+            rc = nvs_get_u16(nvs, setting->nvs_id, &undo->val.u16);
+            break;
+        case NVS_TYPE_U32:
+            rc = nvs_get_u32(nvs, setting->nvs_id, &undo->val.u32);
+            break;
+        case NVS_TYPE_STR:
+            rc = nvs_get_str(nvs, setting->nvs_id, (char *)undo->data, &undo->len);
+            break;
+        case NVS_TYPE_BLOB:
+            rc = nvs_get_blob(nvs, setting->nvs_id, undo->data, &undo->len);
+            break;
+        default:
+            rc = ESP_ERR_NOT_SUPPORTED;
+            break;
+        }
+    }
+    undo->stored = rc == ESP_OK;
+    undo->next = *undo_log;
+    *undo_log = undo;
+    return ESP_OK;
+}
+
+static esp_err_t setting_undo_write(const settings_undo_t *undo, nvs_handle_t nvs)
+{
+    const char *key = undo->setting->nvs_id;
+
+    switch (setting_ops(undo->setting)->nvs_type) {
+    case NVS_TYPE_I8:
+        return nvs_set_i8(nvs, key, undo->val.i8);
+    case NVS_TYPE_I32:
+        return nvs_set_i32(nvs, key, undo->val.i32);
+    case NVS_TYPE_U16:
+        return nvs_set_u16(nvs, key, undo->val.u16);
+    case NVS_TYPE_U32:
+        return nvs_set_u32(nvs, key, undo->val.u32);
+    case NVS_TYPE_STR:
+        return nvs_set_str(nvs, key, (const char *)undo->data);
+    case NVS_TYPE_BLOB:
+        return nvs_set_blob(nvs, key, undo->data, undo->len);
+    default:
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+}
+
+/* restoring writes wear the flash too, they are counted against the setting they restore */
+static void settings_undo_rollback(settings_undo_t *undo_log, settings_index_t *index, nvs_handle_t nvs)
+{
+    for (settings_undo_t *undo = undo_log; undo; undo = undo->next) {
+        if (!undo->stored) {
+            nvs_erase_key(nvs, undo->setting->nvs_id);
+            continue;
+        }
+        if (setting_undo_write(undo, nvs) != ESP_OK)
+            continue;
+#ifdef CONFIG_SETTINGS_METRICS
+        settings_metrics_nvs_write(undo->len ? undo->len : setting_nvs_size(undo->setting));
+#endif
+#ifdef CONFIG_SETTINGS_WEAR_STATS
+        setting_wear_record(index, undo->setting, undo->len ? undo->len : setting_nvs_size(undo->setting));
+#endif
+    }
+}
+#endif
+
+static void settings_undo_free(settings_undo_t *undo_log)
+{
+    while (undo_log) {
+        settings_undo_t *next = undo_log->next;
+        free(undo_log);
+        undo_log = next;
+    }
+}
+
+esp_err_t settings_txn_begin(settings_txn_t *txn, const settings_group_t *settings_pack)
+{
+    esp_err_t rc;
+
+    if (!txn || !settings_pack)
+        return ESP_ERR_INVALID_ARG;
+
+    /* held until commit or abort - other writers wait for the batch */
+    settings_lock();
+    rc = settings_pack_update_nvs_ids(settings_pack);
+    if (rc == ESP_OK) {
+        rc = settings_ctx_nvs_open(settings_pack_ctx(settings_pack), NVS_READWRITE, &txn->nvs);
+        if (rc != ESP_OK)
+            ESP_LOGE(TAG, "nvs open error %s", esp_err_to_name(rc));
+    }
+    if (rc != ESP_OK) {
+        settings_unlock();
+        return rc;
+    }
+    txn->pack = settings_pack;
+    return ESP_OK;
+}
+
+esp_err_t settings_txn_commit(settings_txn_t *txn)
+{
+    int64_t           start = settings_metrics_start();
+    settings_undo_t  *undo_log = NULL;
+    settings_index_t *index;
+    esp_err_t         rc = ESP_OK;
+    uint32_t          written = 0;
+    uint32_t          skipped = 0;
+
+    if (!txn || !txn->pack)
+        return ESP_ERR_INVALID_STATE;
+
+    /* looked up once, every write of the pack is accounted to it */
+    index = settings_index_get(txn->pack);
+
+    for (const settings_group_t *gr = txn->pack; gr->id && rc == ESP_OK; gr++) {
+#ifdef CONFIG_SETTINGS_STORAGE_GROUP_BLOB
+        uint32_t dirty = 0;
+
+        for (setting_t *setting = gr->settings; setting->id && rc == ESP_OK; setting++) {
+            if (!setting->dirty)
+                skipped++;
+            else if (setting_is_persistent(setting))
+                dirty++;
+            else if ((rc = setting_nvs_write(index, setting, txn->nvs)) == ESP_OK)
+                written++;
+        }
+        if (rc != ESP_OK || !dirty)
+            continue;
+
+        /* any change rewrites the whole group blob */
+        rc = group_undo_push(&undo_log, gr, txn->nvs);
+        if (rc == ESP_OK)
+            rc = settings_group_nvs_write(index, gr, txn->nvs);
+        if (rc != ESP_OK) {
+            ESP_LOGE(TAG, "nvs set %s: %s", gr->id, esp_err_to_name(rc));
+            break;
+        }
+        written += dirty;
+#else
+        for (setting_t *setting = gr->settings; setting->id; setting++) {
+            if (!setting->dirty) {
+                skipped++;
+                continue;
+            }
+            if (setting_is_persistent(setting)) {
+                rc = setting_undo_push(&undo_log, setting, txn->nvs);
+                if (rc != ESP_OK)
+                    break;
+            }
+            rc = setting_nvs_write(index, setting, txn->nvs);
+            if (rc != ESP_OK) {
+                ESP_LOGE(TAG, "nvs set %s: %s", setting->nvs_id, esp_err_to_name(rc));
+                break;
+            }
+            written++;
+        }
+#endif
+    }
+    if (rc == ESP_OK && written > 0)
+        rc = settings_nvs_commit(txn->nvs);
+    /* the undo log is the largest allocation of a save */
+    settings_metrics_http_sample();
+
+    if (rc == ESP_OK) {
+        settings_pack_set_dirty(txn->pack, false);
+        nvs_stats.written += written;
+        nvs_stats.skipped += skipped;
+        ESP_LOGD(TAG, "nvs write: %" PRIu32 " written, %" PRIu32 " skipped", written, skipped);
+    } else {
+        /* restore keys already overwritten - settings stay dirty for retry */
+        settings_undo_rollback(undo_log, index, txn->nvs);
+        settings_nvs_commit(txn->nvs);
+    }
+    settings_undo_free(undo_log);
+
+    nvs_close(txn->nvs);
+    txn->pack = NULL;
+    settings_unlock();
+    settings_metrics_op(SETTINGS_METRIC_NVS_WRITE, start, rc);
+    return rc;
+}
+
+void settings_txn_abort(settings_txn_t *txn)
+{
+    if (!txn || !txn->pack)
+        return;
+
+    /* revert uncommitted in-memory changes to the stored or default values */
+    for (const settings_group_t *gr = txn->pack; gr->id; gr++) {
+#ifdef CONFIG_SETTINGS_STORAGE_GROUP_BLOB
+        bool dirty = false;
+
+        for (setting_t *setting = gr->settings; setting->id; setting++) {
+            if (!setting->dirty || !setting_is_persistent(setting))
+                continue;
+            setting_set_defaults(setting);
+            dirty = true;
+        }
+        if (dirty)
+            settings_group_nvs_read(gr, txn->nvs, true);
+        settings_group_set_dirty(gr, false);
+#else
+        for (setting_t *setting = gr->settings; setting->id; setting++) {
+            if (!setting->dirty || !setting_is_persistent(setting))
+                continue;
+            setting_set_defaults(setting);
+            setting_nvs_read(setting, txn->nvs);
+            setting->dirty = false;
+        }
+#endif
+    }
+    nvs_close(txn->nvs);
+    txn->pack = NULL;
+    settings_unlock();
+}
+
+esp_err_t setting_nvs_write_single(setting_t *setting)
+{
+    int64_t      start = settings_metrics_start();
+    nvs_handle_t nvs;
+    esp_err_t    rc;
+
+    rc = settings_ctx_nvs_open(setting_ctx(setting), NVS_READWRITE, &nvs);
+    if (rc != ESP_OK) {
+        ESP_LOGE(TAG, "nvs open error %s", esp_err_to_name(rc));
+        settings_metrics_op(SETTINGS_METRIC_NVS_WRITE_SINGLE, start, rc);
+        return rc;
+    }
+
+    settings_lock();
+#ifdef CONFIG_SETTINGS_STORAGE_GROUP_BLOB
+    const settings_group_t *gr = NULL;
+    settings_index_t       *index = setting_is_persistent(setting) ? settings_index_of(setting, &gr) : NULL;
+
+    /* a key of its own would never be read back, the group blob needs the pack index */
+    if (gr)
+        rc = settings_group_nvs_write(index, gr, nvs);
+    else if (setting_is_persistent(setting))
+        rc = ESP_ERR_INVALID_STATE;
+    else
+        rc = setting_nvs_write(NULL, setting, nvs);
+#else
+    rc = setting_nvs_write(setting_index(setting), setting, nvs);
+#endif
+    if (rc == ESP_OK) {
+        settings_nvs_commit(nvs);
+#ifdef CONFIG_SETTINGS_STORAGE_GROUP_BLOB
+        /* the blob holds current values of the whole group */
+        if (gr)
+            settings_group_set_dirty(gr, false);
+#endif
+        setting->dirty = false;
+        nvs_stats.written++;
+    } else {
+        ESP_LOGE(TAG, "nvs set: %s", esp_err_to_name(rc));
+    }
+    settings_unlock();
+    nvs_close(nvs);
+    settings_metrics_op(SETTINGS_METRIC_NVS_WRITE_SINGLE, start, rc);
+    return rc;
+}
+
+esp_err_t settings_nvs_write(const settings_group_t *settings_pack)
+{
+    settings_txn_t txn;
+    esp_err_t      rc;
+
+    rc = settings_txn_begin(&txn, settings_pack);
+    if (rc != ESP_OK)
+        return rc;
+
+    return settings_txn_commit(&txn);
+}
+
+esp_err_t settings_flush(void)
+{
+    esp_err_t rc = ESP_OK;
+    bool      loaded = false;
+
+    settings_lock();
+    for (settings_index_t *index = settings_indexes; index; index = index->next) {
+        esp_err_t err;
+
+        if (!index->loaded)
+            continue;
+        loaded = true;
+        err = settings_nvs_write(index->pack);
+        if (rc == ESP_OK)
+            rc = err;
+    }
+    settings_unlock();
+    return loaded ? rc : ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t settings_nvs_erase(settings_group_t *settings_pack)
+{
+    nvs_handle nvs;
+    esp_err_t  rc;
+#ifdef CONFIG_SETTINGS_LAZY_TEXT
+    /* values not fetched yet exist only in NVS */
+    settings_lock();
+    for (const settings_group_t *gr = settings_pack; gr->id; gr++) {
+        for (setting_t *setting = gr->settings; setting->id; setting++) {
+            if (setting_text_lazy(setting))
+                setting_text_load(setting);
+        }
+    }
+    settings_unlock();
+#endif
+    rc = settings_ctx_nvs_open(settings_pack_ctx(settings_pack), NVS_READWRITE, &nvs);
+    if (rc == ESP_OK) {
         nvs_erase_all(nvs);
+        settings_nvs_commit(nvs);
+        nvs_close(nvs);
         ESP_LOGW(TAG, "nvs erased");
-        if (settings_handler != NULL)
-            settings_handler(settings_pack, handler_arg);
+        /* nothing is stored anymore - next write has to persist everything */
+        settings_pack_mark_dirty(settings_pack);
+        settings_handler_call(settings_pack);
+    } else {
+        ESP_LOGE(TAG, "nvs open error %s", esp_err_to_name(rc));
+    }
+    return rc;
+}
+
+esp_err_t settings_nvs_get_stats(settings_nvs_stats_t *stats)
+{
+    if (!stats)
+        return ESP_ERR_INVALID_ARG;
+
+    *stats = nvs_stats;
+    return ESP_OK;
+}
+
+void settings_nvs_reset_stats(void)
+{
+    memset(&nvs_stats, 0, sizeof(nvs_stats));
+}
+
+#ifdef CONFIG_SETTINGS_WEAR_STATS
+/* counters of the setting, `hour_writes` only while their hour lasts */
+static bool setting_wear_copy(const settings_index_t *index, const settings_group_t *gr, const setting_t *setting,
+                              setting_wear_t *wear)
+{
+    uint32_t slot;
+
+    if (!settings_index_lookup(index, gr->id, setting->id, &slot))
+        return false;
+
+    *wear = index->wear[slot];
+    if (wear->hour != esp_timer_get_time() / SETTINGS_WEAR_HOUR_US)
+        wear->hour_writes = 0;
+    return true;
+}
+
+esp_err_t settings_wear_get(const settings_group_t *settings_pack, settings_wear_t *wear)
+{
+    const settings_index_t *index;
+    const char             *part;
+    nvs_stats_t             stats;
+    nvs_handle_t            nvs;
+    size_t                  ns_entries = 0;
+    double                  days;
+    esp_err_t               rc;
+
+    if (!settings_pack || !wear)
+        return ESP_ERR_INVALID_ARG;
+
+    memset(wear, 0, sizeof(*wear));
+    settings_lock();
+    index = settings_index_get(settings_pack);
+    if (!index) {
+        settings_unlock();
+        return ESP_ERR_INVALID_STATE;
+    }
+    part = settings_ctx_partition(index->ctx);
+    wear->uptime_s = esp_timer_get_time() / 1000000;
+    wear->writes = index->wear_writes;
+    wear->bytes = index->wear_bytes;
+    wear->entries = index->wear_entries;
+    for (const settings_group_t *gr = settings_pack; gr->id; gr++) {
+        for (setting_t *setting = gr->settings; setting->id; setting++) {
+            setting_wear_t key;
+
+            if (setting_wear_copy(index, gr, setting, &key) && key.hour_writes >= CONFIG_SETTINGS_WEAR_HOT_WRITES)
+                wear->hot_keys++;
+        }
+    }
+    /* packs sharing the partition wear the same pages */
+    for (const settings_index_t *it = settings_indexes; it; it = it->next) {
+        if (!strcmp(settings_ctx_partition(it->ctx), part))
+            wear->partition_entries += it->wear_entries;
+    }
+    settings_unlock();
+
+    rc = nvs_get_stats(part, &stats);
+    if (rc != ESP_OK)
+        return rc;
+    wear->used_entries = stats.used_entries;
+    wear->free_entries = stats.free_entries;
+    wear->total_entries = stats.total_entries;
+    if (settings_ctx_nvs_open(index->ctx, NVS_READONLY, &nvs) == ESP_OK) {
+        nvs_get_used_entry_count(nvs, &ns_entries);
+        nvs_close(nvs);
+    }
+    wear->ns_entries = ns_entries;
+
+    /* entry writes the partition takes before its pages are worn out, spent at the rate seen since boot,
+     * less the time already spent; double because erase cycles times entries times uptime overflows 64 bits */
+    if (!wear->partition_entries) {
+        wear->lifetime_days = UINT32_MAX;
+    } else {
+        days = ((double)stats.total_entries * CONFIG_SETTINGS_WEAR_ERASE_CYCLES / wear->partition_entries - 1) *
+               wear->uptime_s / 86400;
+        wear->lifetime_days = days <= 0 ? 0 : days < UINT32_MAX ? (uint32_t)days : UINT32_MAX;
+    }
+    return ESP_OK;
+}
+
+esp_err_t setting_wear_get(const setting_t *setting, uint32_t *writes, uint32_t *hour_writes)
+{
+    const settings_group_t *gr;
+    settings_index_t       *index;
+    setting_wear_t          wear;
+    bool                    found = false;
+
+    if (!setting)
+        return ESP_ERR_INVALID_ARG;
+
+    settings_lock();
+    index = settings_index_of(setting, &gr);
+    if (index)
+        found = setting_wear_copy(index, gr, setting, &wear);
+    settings_unlock();
+    if (!found)
+        return ESP_ERR_NOT_FOUND;
+
+    if (writes)
+        *writes = wear.writes;
+    if (hour_writes)
+        *hour_writes = wear.hour_writes;
+    return ESP_OK;
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_METRICS
+esp_err_t settings_metrics_get(settings_metrics_t *dst)
+{
+    if (!dst)
+        return ESP_ERR_INVALID_ARG;
+
+    settings_lock();
+    *dst = metrics;
+    dst->nvs_commits = __atomic_load_n(&metrics.nvs_commits, __ATOMIC_RELAXED);
+    settings_unlock();
+    return ESP_OK;
+}
+
+void settings_metrics_reset(void)
+{
+    settings_lock();
+    memset(&metrics, 0, sizeof(metrics));
+    settings_unlock();
+}
+#endif
+
+esp_err_t settings_handler_register(settings_handler_t handler, void *arg)
+{
+    settings_handler = handler;
+    handler_arg = arg;
+    return ESP_OK;
+}
+
+static bool settings_ctx_same_storage(const settings_ctx_t *a, const settings_ctx_t *b)
+{
+    return !strcmp(settings_ctx_partition(a), settings_ctx_partition(b)) &&
+           !strcmp(settings_ctx_namespace(a), settings_ctx_namespace(b));
+}
+
+esp_err_t settings_ctx_init(settings_ctx_t *ctx)
+{
+    settings_index_t *index = NULL;
+    esp_err_t         rc;
+
+    if (!ctx || !ctx->pack)
+        return ESP_ERR_INVALID_ARG;
+    if (ctx->nvs_namespace && (!*ctx->nvs_namespace || strlen(ctx->nvs_namespace) >= NVS_KEY_NAME_MAX_SIZE))
+        return ESP_ERR_INVALID_ARG;
+    /* that storage belongs to the packs without a context */
+    if (!strcmp(settings_ctx_namespace(ctx), NVS_STORAGE) &&
+        !strcmp(settings_ctx_partition(ctx), NVS_DEFAULT_PART_NAME))
+        return ESP_ERR_INVALID_ARG;
+
+    if (ctx->partition) {
+        rc = nvs_flash_init_partition(ctx->partition);
+        if (rc != ESP_OK) {
+            ESP_LOGE(TAG, "nvs partition %s: %s", ctx->partition, esp_err_to_name(rc));
+            return rc;
+        }
+    }
+
+    settings_lock();
+    rc = settings_pack_update_nvs_ids(ctx->pack);
+    if (rc == ESP_OK)
+        index = settings_index_get(ctx->pack);
+    /* one context per pack, packs sharing a namespace would overwrite each other's keys */
+    if (index && index->ctx && index->ctx != ctx)
+        rc = ESP_ERR_INVALID_STATE;
+    for (settings_index_t *other = settings_indexes; index && rc == ESP_OK && other; other = other->next) {
+        if (other != index && other->ctx && settings_ctx_same_storage(other->ctx, ctx)) {
+            ESP_LOGE(TAG, "namespace %s already used", settings_ctx_namespace(ctx));
+            rc = ESP_ERR_INVALID_STATE;
+        }
+    }
+    if (rc == ESP_OK) {
+        index->ctx = ctx;
+        settings_ctx_used = true;
+    }
+    settings_unlock();
+    return rc;
+}
+
+esp_err_t settings_ctx_nvs_read(settings_ctx_t *ctx)
+{
+    return ctx ? settings_nvs_read(ctx->pack) : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t settings_ctx_nvs_write(settings_ctx_t *ctx)
+{
+    return ctx ? settings_nvs_write(ctx->pack) : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t settings_ctx_nvs_erase(settings_ctx_t *ctx)
+{
+    return ctx ? settings_nvs_erase((settings_group_t *)ctx->pack) : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t settings_ctx_handler_register(settings_ctx_t *ctx, settings_handler_t handler, void *arg)
+{
+    if (!ctx)
+        return ESP_ERR_INVALID_ARG;
+
+    settings_lock();
+    ctx->handler = handler;
+    ctx->handler_arg = arg;
+    settings_unlock();
+    return ESP_OK;
+}
+
+#ifdef CONFIG_SETTINGS_NOTIFY_SUPPORT
+typedef struct {
+    settings_filter_t    filter;
+    settings_notify_cb_t cb;
+    void                *arg;
+} settings_subscriber_t;
+
+/* one settings_notify() call - `changes` holds `count` entries plus as many for filtering */
+typedef struct {
+    settings_change_t *changes;
+    size_t             count;
+} settings_notify_msg_t;
+
+static settings_subscriber_t subscribers[CONFIG_SETTINGS_NOTIFY_MAX_SUBSCRIBERS];
+static QueueHandle_t         notify_queue;
+
+static bool settings_filter_match(const settings_filter_t *filter, const settings_change_t *change)
+{
+    if (filter->group_id && strcmp(filter->group_id, change->group->id))
+        return false;
+    if (filter->setting_id && strcmp(filter->setting_id, change->setting->id))
+        return false;
+    /* custom types have no mask bit and are matched by an empty type filter only */
+    if (filter->types &&
+        (change->setting->type >= SETTING_TYPE_CUSTOM || !(filter->types & SETTING_TYPE_MASK(change->setting->type))))
+        return false;
+    return true;
+}
+
+static void settings_notify_task(void *arg)
+{
+    settings_subscriber_t subs[CONFIG_SETTINGS_NOTIFY_MAX_SUBSCRIBERS];
+    settings_notify_msg_t msg;
+
+    for (;;) {
+        if (xQueueReceive(notify_queue, &msg, portMAX_DELAY) != pdTRUE)
+            continue;
+
+        /* callbacks run unlocked, they may change settings or (un)subscribe */
+        settings_lock();
+        memcpy(subs, subscribers, sizeof(subs));
+        settings_unlock();
+
+        for (int i = 0; i < CONFIG_SETTINGS_NOTIFY_MAX_SUBSCRIBERS; i++) {
+            settings_change_t *matched = msg.changes + msg.count;
+            size_t             n = 0;
+
+            if (!subs[i].cb)
+                continue;
+            for (size_t c = 0; c < msg.count; c++) {
+                if (settings_filter_match(&subs[i].filter, &msg.changes[c]))
+                    matched[n++] = msg.changes[c];
+            }
+            if (n)
+                subs[i].cb(matched, n, subs[i].arg);
+        }
+        free(msg.changes);
+    }
+}
+
+esp_err_t settings_subscribe(const settings_filter_t *filter, settings_notify_cb_t cb, void *arg)
+{
+    settings_subscriber_t *slot = NULL;
+    esp_err_t              rc = ESP_OK;
+
+    if (!cb)
+        return ESP_ERR_INVALID_ARG;
+
+    settings_lock();
+    if (!notify_queue) {
+        notify_queue = xQueueCreate(CONFIG_SETTINGS_NOTIFY_QUEUE_LEN, sizeof(settings_notify_msg_t));
+        if (notify_queue && xTaskCreate(settings_notify_task, "settings_notify", CONFIG_SETTINGS_NOTIFY_TASK_STACK_SIZE,
+                                        NULL, CONFIG_SETTINGS_NOTIFY_TASK_PRIORITY, NULL) != pdPASS) {
+            vQueueDelete(notify_queue);
+            notify_queue = NULL;
+        }
+    }
+    for (int i = 0; i < CONFIG_SETTINGS_NOTIFY_MAX_SUBSCRIBERS && !slot; i++) {
+        if (!subscribers[i].cb)
+            slot = &subscribers[i];
+    }
+    if (notify_queue && slot) {
+        slot->filter = filter ? *filter : (settings_filter_t){ 0 };
+        slot->cb = cb;
+        slot->arg = arg;
+    } else {
+        ESP_LOGE(TAG, "subscribe: %s", notify_queue ? "no free slot" : "task start failed");
+        rc = ESP_ERR_NO_MEM;
+    }
+    settings_unlock();
+    return rc;
+}
+
+esp_err_t settings_unsubscribe(settings_notify_cb_t cb, void *arg)
+{
+    esp_err_t rc = ESP_ERR_NOT_FOUND;
+
+    settings_lock();
+    for (int i = 0; i < CONFIG_SETTINGS_NOTIFY_MAX_SUBSCRIBERS; i++) {
+        if (subscribers[i].cb == cb && subscribers[i].arg == arg) {
+            memset(&subscribers[i], 0, sizeof(subscribers[i]));
+            rc = ESP_OK;
+            break;
+        }
+    }
+    settings_unlock();
+    return rc;
+}
+
+esp_err_t settings_notify(const settings_group_t *settings_pack)
+{
+    settings_notify_msg_t msg = { 0 };
+
+    settings_lock();
+    /* nobody listens - just forget the changes */
+    if (!notify_queue) {
+        settings_pack_clear_changed(settings_pack);
+        settings_unlock();
+        return ESP_OK;
+    }
+
+    for (const settings_group_t *gr = settings_pack; gr->id; gr++) {
+        for (setting_t *setting = gr->settings; setting->id; setting++)
+            msg.count += setting->changed;
+    }
+    if (!msg.count) {
+        settings_unlock();
+        return ESP_OK;
+    }
+
+    msg.changes = malloc(2 * msg.count * sizeof(settings_change_t));
+    if (!msg.changes) {
+        settings_unlock();
+        return ESP_ERR_NO_MEM;
+    }
+    msg.count = 0;
+    for (const settings_group_t *gr = settings_pack; gr->id; gr++) {
+        for (setting_t *setting = gr->settings; setting->id; setting++) {
+            if (setting->changed)
+                msg.changes[msg.count++] = (settings_change_t){ .group = gr, .setting = setting };
+        }
+    }
+
+    /* never block the caller - undelivered changes stay marked for the next call */
+    if (xQueueSend(notify_queue, &msg, 0) != pdTRUE) {
+        settings_unlock();
+        free(msg.changes);
+        ESP_LOGW(TAG, "notify queue full");
+        return ESP_ERR_TIMEOUT;
+    }
+    settings_pack_clear_changed(settings_pack);
+    settings_unlock();
+    return ESP_OK;
+}
+#endif
+
+/*
+ * Streaming JSON writer: compact JSON is collected in a small fixed buffer
+ * and sent as HTTP chunks whenever the buffer fills up, so peak memory use
+ * does not depend on the settings pack size. Without a request the output
+ * is only hashed (used for the schema ETag), websocket clients get it as
+ * fragments of one message.
+ *
+ * With `cbor` set the same document is written as CBOR (RFC 8949) instead:
+ * objects and arrays become indefinite-length maps and arrays, numbers,
+ * colors and IP addresses are sent as integers and types as their
+ * `SETTINGS_CBOR_TYPE_*` codes.
+ */
+struct json_stream {
+    httpd_req_t   *req;
+    esp_err_t      rc;
+    uint32_t       hash;
+    bool           comma;
+    bool           cbor;
+#ifdef CONFIG_SETTINGS_WS_PUSH
+    httpd_handle_t ws_hd;
+    int            ws_fd;
+    bool           ws_cont; /* a fragment of the message was sent */
+#endif
+    size_t         len;
+    char           buf[CONFIG_SETTINGS_JSON_CHUNK_SIZE];
+};
+
+/* CBOR major types and simple values */
+#define CBOR_UINT         0
+#define CBOR_NINT         1
+#define CBOR_BYTES        2
+#define CBOR_TEXT         3
+#define CBOR_ARRAY        4
+#define CBOR_MAP          5
+#define CBOR_TAG          6
+#define CBOR_MAJOR_SIMPLE 7
+
+#define CBOR_FALSE      0xf4
+#define CBOR_TRUE       0xf5
+#define CBOR_BREAK      0xff
+#define CBOR_INDEFINITE 31
+
+/* which parts of a setting are serialized */
+#define SETTING_JSON_SCHEMA (1 << 0) /* label, type, defaults, ranges, options */
+#define SETTING_JSON_VALUES (1 << 1) /* current values */
+#define SETTING_JSON_ALL (SETTING_JSON_SCHEMA | SETTING_JSON_VALUES)
+
+#ifdef CONFIG_SETTINGS_WS_PUSH
+/* websocket output: every flush is one fragment of a single text message */
+static void json_stream_ws_send(json_stream_t *js, bool final)
+{
+    httpd_ws_frame_t frame = {
+        .final = final,
+        .fragmented = true,
+        .type = js->ws_cont ? HTTPD_WS_TYPE_CONTINUE : HTTPD_WS_TYPE_TEXT,
+        .payload = (uint8_t *)js->buf,
+        .len = js->len,
+    };
+
+    if (js->rc == ESP_OK && (js->len || final)) {
+        js->rc = httpd_ws_send_frame_async(js->ws_hd, js->ws_fd, &frame);
+        js->ws_cont = true;
+    }
+    js->len = 0;
+}
+#endif
+
+static void json_stream_flush(json_stream_t *js)
+{
+#ifdef CONFIG_SETTINGS_WS_PUSH
+    if (js->ws_hd) {
+        json_stream_ws_send(js, false);
+        return;
+    }
+#endif
+    if (!js->req) {
+        for (size_t i = 0; i < js->len; i++)
+            js->hash = (js->hash ^ (uint8_t)js->buf[i]) * 16777619u;
+    } else if (js->len && js->rc == ESP_OK) {
+        /* copies made for the response are still held */
+        settings_metrics_http_sample();
+        js->rc = httpd_resp_send_chunk(js->req, js->buf, js->len);
+    }
+    js->len = 0;
+}
+
+static void json_stream_write(json_stream_t *js, const char *data, size_t len)
+{
+    while (len) {
+        size_t n = sizeof(js->buf) - js->len;
+
+        if (n > len)
+            n = len;
+        memcpy(&js->buf[js->len], data, n);
+        js->len += n;
+        data += n;
+        len -= n;
+        if (js->len == sizeof(js->buf))
+            json_stream_flush(js);
+    }
+}
+
+static void json_stream_puts(json_stream_t *js, const char *str)
+{
+    json_stream_write(js, str, strlen(str));
+}
+
+static void cbor_stream_head(json_stream_t *js, uint8_t major, uint32_t val)
+{
+    uint8_t head[5];
+    size_t  len = 1;
+
+    if (val < 24) {
+        head[0] = major << 5 | val;
+    } else if (val <= UINT8_MAX) {
+        head[0] = major << 5 | 24;
+        head[len++] = val;
+    } else if (val <= UINT16_MAX) {
+        head[0] = major << 5 | 25;
+        head[len++] = val >> 8;
+        head[len++] = val;
+    } else {
+        head[0] = major << 5 | 26;
+        head[len++] = val >> 24;
+        head[len++] = val >> 16;
+        head[len++] = val >> 8;
+        head[len++] = val;
+    }
+    json_stream_write(js, (const char *)head, len);
+}
+
+static void cbor_stream_int(json_stream_t *js, int32_t val)
+{
+    if (val < 0)
+        cbor_stream_head(js, CBOR_NINT, (uint32_t)-(val + 1));
+    else
+        cbor_stream_head(js, CBOR_UINT, val);
+}
+
+static void cbor_stream_simple(json_stream_t *js, uint8_t val)
+{
+    json_stream_write(js, (const char *)&val, 1);
+}
+
+/* separator before next value in an object or array */
+static void json_stream_sep(json_stream_t *js)
+{
+    if (js->comma && !js->cbor)
+        json_stream_write(js, ",", 1);
+    js->comma = true;
+}
+
+static void json_stream_string(json_stream_t *js, const char *str)
+{
+    const char *run = str;
+    char        esc[8];
+
+    if (js->cbor) {
+        size_t len = strlen(str);
+
+        cbor_stream_head(js, CBOR_TEXT, len);
+        json_stream_write(js, str, len);
+        return;
+    }
+
+    json_stream_write(js, "\"", 1);
+    for (; *str; str++) {
+        unsigned char c = *str;
+
+        if (c >= 0x20 && c != '"' && c != '\\')
+            continue;
+
+        json_stream_write(js, run, str - run);
+        run = str + 1;
+        switch (c) {
+        case '"':
+            json_stream_puts(js, "\\\"");
+            break;
+        case '\\':
+            json_stream_puts(js, "\\\\");
+            break;
+        case '\b':
+            json_stream_puts(js, "\\b");
+            break;
+        case '\f':
+            json_stream_puts(js, "\\f");
+            break;
+        case '\n':
+            json_stream_puts(js, "\\n");
+            break;
+        case '\r':
+            json_stream_puts(js, "\\r");
+            break;
+        case '\t':
+            json_stream_puts(js, "\\t");
+            break;
+        default:
+            snprintf(esc, sizeof(esc), "\\u%04x", c);
+            json_stream_puts(js, esc);
+            break;
+        }
+    }
+    json_stream_write(js, run, str - run);
+    json_stream_write(js, "\"", 1);
+}
+
+static void json_stream_key(json_stream_t *js, const char *key)
+{
+    json_stream_sep(js);
+    json_stream_string(js, key);
+    if (!js->cbor)
+        json_stream_write(js, ":", 1);
+    js->comma = false;
+}
+
+static void json_stream_open(json_stream_t *js, char bracket)
+{
+    json_stream_sep(js);
+    if (js->cbor)
+        cbor_stream_head(js, bracket == '[' ? CBOR_ARRAY : CBOR_MAP, CBOR_INDEFINITE);
+    else
+        json_stream_write(js, &bracket, 1);
+    js->comma = false;
+}
+
+static void json_stream_close(json_stream_t *js, char bracket)
+{
+    if (js->cbor)
+        cbor_stream_simple(js, CBOR_BREAK);
+    else
+        json_stream_write(js, &bracket, 1);
+    js->comma = true;
+}
+
+static void json_stream_add_str(json_stream_t *js, const char *key, const char *val)
+{
+    json_stream_key(js, key);
+    json_stream_sep(js);
+    json_stream_string(js, val ? val : "");
+}
+
+static void json_stream_int(json_stream_t *js, int val)
+{
+    char num[12];
+
+    json_stream_sep(js);
+    if (js->cbor) {
+        cbor_stream_int(js, val);
+        return;
+    }
+    snprintf(num, sizeof(num), "%d", val);
+    json_stream_puts(js, num);
+}
+
+static void json_stream_add_int(json_stream_t *js, const char *key, int val)
+{
+    json_stream_key(js, key);
+    json_stream_int(js, val);
+}
+
+static void json_stream_u32(json_stream_t *js, uint32_t val)
+{
+    char num[12];
+
+    json_stream_sep(js);
+    if (js->cbor) {
+        cbor_stream_head(js, CBOR_UINT, val);
+        return;
+    }
+    snprintf(num, sizeof(num), "%" PRIu32, val);
+    json_stream_puts(js, num);
+}
+
+static void json_stream_add_u32(json_stream_t *js, const char *key, uint32_t val)
+{
+    json_stream_key(js, key);
+    json_stream_u32(js, val);
+}
+
+static void json_stream_add_bool(json_stream_t *js, const char *key, bool val)
+{
+    json_stream_key(js, key);
+    json_stream_sep(js);
+    if (js->cbor)
+        cbor_stream_simple(js, val ? CBOR_TRUE : CBOR_FALSE);
+    else
+        json_stream_puts(js, val ? "true" : "false");
+}
+
+#ifdef CONFIG_SETTINGS_COLOR_SUPPORT
+/* "#rrggbb" in JSON, 0xRRGGBB in CBOR */
+static void json_stream_add_color(json_stream_t *js, const char *key, const color_t *color)
+{
+    char buf[8];
+
+#ifdef CONFIG_SETTINGS_CBOR_SUPPORT
+    if (js->cbor) {
+        json_stream_add_u32(js, key, (uint32_t)color->r << 16 | color->g << 8 | color->b);
+        return;
+    }
+#endif
+    snprintf(buf, sizeof(buf), "#%02x%02x%02x", color->r, color->g, color->b);
+    json_stream_add_str(js, key, buf);
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_NET_SUPPORT
+/* dotted quad in JSON, first octet in the most significant byte in CBOR */
+static void json_stream_add_ipaddr(json_stream_t *js, const char *key, const ipaddr_t *ipaddr)
+{
+    char buf[16];
+
+#ifdef CONFIG_SETTINGS_CBOR_SUPPORT
+    if (js->cbor) {
+        json_stream_add_u32(js, key, setting_ipaddr_to_u32(ipaddr));
+        return;
+    }
+#endif
+    setting_ipaddr_to_string(ipaddr, buf, sizeof(buf));
+    json_stream_add_str(js, key, buf);
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_ARRAY_SUPPORT
+/* shortest of 7 and 9 digits that reads back the same, NaN and infinity are null in JSON */
+static void json_stream_float(json_stream_t *js, float val)
+{
+    char     num[20];
+    uint8_t  head[5] = { CBOR_MAJOR_SIMPLE << 5 | 26 };
+    uint32_t bits;
+
+    json_stream_sep(js);
+    if (js->cbor) {
+        memcpy(&bits, &val, sizeof(bits));
+        for (int i = 0; i < 4; i++)
+            head[1 + i] = bits >> (24 - 8 * i);
+        json_stream_write(js, (const char *)head, sizeof(head));
+        return;
+    }
+    if (!isfinite(val)) {
+        json_stream_puts(js, "null");
+        return;
+    }
+    snprintf(num, sizeof(num), "%.7g", val);
+    if (strtof(num, NULL) != val)
+        snprintf(num, sizeof(num), "%.9g", val);
+    json_stream_puts(js, num);
+}
+
+static void json_stream_add_array(json_stream_t *js, const char *key, const setting_t *setting, const void *vals)
+{
+    json_stream_key(js, key);
+    json_stream_open(js, '[');
+    for (size_t i = 0; i < setting->array.len; i++) {
+        float val = setting_array_elem_get(setting, vals, i);
+
+        if (setting->array.elem == SETTING_ARRAY_FLOAT)
+            json_stream_float(js, val);
+        else
+            json_stream_int(js, (int)val);
+    }
+    json_stream_close(js, ']');
+}
+#endif
+
+static void json_stream_add_type(json_stream_t *js, const setting_ops_t *ops)
+{
+#ifdef CONFIG_SETTINGS_CBOR_SUPPORT
+    if (js->cbor) {
+        json_stream_add_int(js, "type", ops->cbor_type);
+        return;
+    }
+#endif
+    json_stream_add_str(js, "type", ops->name);
+}
+
+static void setting_bool_to_json(json_stream_t *js, setting_t *setting, setting_t *orig, bool values, bool schema)
+{
+    if (values)
+        json_stream_add_bool(js, "val", setting->boolean.val);
+    if (schema)
+        json_stream_add_bool(js, "def", setting->boolean.def);
+}
+
+static void setting_num_to_json(json_stream_t *js, setting_t *setting, setting_t *orig, bool values, bool schema)
+{
+    if (values)
+        json_stream_add_int(js, "val", setting->num.val);
+    if (schema) {
+        json_stream_add_int(js, "def", setting->num.def);
+        json_stream_add_int(js, "min", setting->num.range[0]);
+        json_stream_add_int(js, "max", setting->num.range[1]);
+    }
+}
+
+static void setting_oneof_to_json(json_stream_t *js, setting_t *setting, setting_t *orig, bool values, bool schema)
+{
+    if (values)
+        json_stream_add_int(js, "val", setting->oneof.val);
+    if (schema) {
+        json_stream_add_int(js, "def", setting->oneof.def);
+        json_stream_key(js, "options");
+        json_stream_open(js, '[');
+        for (const char **opt = setting->oneof.options; *opt != NULL; opt++) {
+            json_stream_sep(js);
+            json_stream_string(js, *opt);
+        }
+        json_stream_close(js, ']');
+    }
+}
+
+/* text values up to this size are copied on the stack for output, longer ones to the heap */
+#define SETTING_TEXT_COPY_LEN 64
+
+static void setting_text_to_json(json_stream_t *js, setting_t *setting, setting_t *orig, bool values, bool schema)
+{
+    char   local[SETTING_TEXT_COPY_LEN];
+    char  *buf = local;
+    size_t size = sizeof(local);
+    bool   fetched;
+
+    if (values) {
+        /* text buffers are shared with snapshots - copied under the lock, sent after it */
+        if (setting->text.len > size) {
+            size = setting->text.len;
+            buf = malloc(size);
+        }
+        settings_lock();
+        if (buf) {
+            snprintf(buf, size, "%s", setting_text_borrow(orig, &fetched));
+            setting_text_return(orig, fetched);
+            settings_unlock();
+            json_stream_add_str(js, "val", buf);
+            if (buf != local)
+                free(buf);
+        } else {
+            json_stream_add_str(js, "val", setting_text_borrow(orig, &fetched));
+            setting_text_return(orig, fetched);
+            settings_unlock();
+        }
+    }
+    if (schema) {
+        json_stream_add_str(js, "def", setting->text.def);
+        json_stream_add_int(js, "len", setting->text.len);
+    }
+}
+
+#ifdef CONFIG_SETTINGS_DATETIME_SUPPORT
+static void setting_time_to_json(json_stream_t *js, setting_t *setting, setting_t *orig, bool values, bool schema)
+{
+    if (values) {
+        json_stream_add_int(js, "hh", setting->time.hh);
+        json_stream_add_int(js, "mm", setting->time.mm);
+        json_stream_add_int(js, "ss", setting->time.ss);
+    }
+}
+
+static void setting_date_to_json(json_stream_t *js, setting_t *setting, setting_t *orig, bool values, bool schema)
+{
+    if (values) {
+        json_stream_add_int(js, "day", setting->date.day);
+        json_stream_add_int(js, "month", setting->date.month);
+        json_stream_add_int(js, "year", setting->date.year);
+    }
+}
+
+static void setting_datetime_to_json(json_stream_t *js, setting_t *setting, setting_t *orig, bool values,
+                                     bool schema)
+{
+    if (values) {
+        datetime_gettimeofday(&setting->datetime);
+        json_stream_add_int(js, "hh", setting->datetime.time.hh);
+        json_stream_add_int(js, "mm", setting->datetime.time.mm);
+        json_stream_add_int(js, "ss", setting->datetime.time.ss);
+        json_stream_add_int(js, "day", setting->datetime.date.day);
+        json_stream_add_int(js, "month", setting->datetime.date.month);
+        json_stream_add_int(js, "year", setting->datetime.date.year);
+    }
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_COLOR_SUPPORT
+static void setting_color_to_json(json_stream_t *js, setting_t *setting, setting_t *orig, bool values, bool schema)
+{
+    if (values)
+        json_stream_add_color(js, "val", &setting->color.val);
+    if (schema)
+        json_stream_add_color(js, "def", &setting->color.def);
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_NET_SUPPORT
+static void setting_ipaddr_to_json(json_stream_t *js, setting_t *setting, setting_t *orig, bool values, bool schema)
+{
+    if (values)
+        json_stream_add_ipaddr(js, "val", &setting->ipaddr.val);
+    if (schema)
+        json_stream_add_ipaddr(js, "def", &setting->ipaddr.def);
+}
+
+static void setting_netif_to_json(json_stream_t *js, setting_t *setting, setting_t *orig, bool values, bool schema)
+{
+    if (values)
+        json_stream_add_bool(js, "dhcp", setting->netif.val.dhcp);
+    if (schema)
+        json_stream_add_bool(js, "def_dhcp", setting->netif.def.dhcp);
+    if (values) {
+        json_stream_add_ipaddr(js, "ip", &setting->netif.val.ip);
+        json_stream_add_ipaddr(js, "netmask", &setting->netif.val.netmask);
+        json_stream_add_ipaddr(js, "gateway", &setting->netif.val.gateway);
+    }
+    if (schema) {
+        json_stream_add_ipaddr(js, "def_ip", &setting->netif.def.ip);
+        json_stream_add_ipaddr(js, "def_netmask", &setting->netif.def.netmask);
+        json_stream_add_ipaddr(js, "def_gateway", &setting->netif.def.gateway);
+    }
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_ARRAY_SUPPORT
+static const char *const setting_array_elem_names[] = {
+    [SETTING_ARRAY_INT16] = "int16",
+    [SETTING_ARRAY_UINT8] = "uint8",
+    [SETTING_ARRAY_FLOAT] = "float",
+};
+
+static void setting_array_to_json(json_stream_t *js, setting_t *setting, setting_t *orig, bool values, bool schema)
+{
+    if (values) {
+        /* the buffer is shared with the snapshot - copied rather than sent under the lock */
+        void *vals = malloc(setting_array_size(setting));
+
+        if (vals) {
+            setting_get_array(orig, 0, vals, setting->array.len);
+            json_stream_add_array(js, "val", setting, vals);
+            free(vals);
+        } else {
+            settings_lock();
+            json_stream_add_array(js, "val", setting, orig->array.val);
+            settings_unlock();
+        }
+    }
+    if (schema) {
+        if (setting->array.def)
+            json_stream_add_array(js, "def", setting, setting->array.def);
+        json_stream_add_str(js, "elem", setting_array_elem_names[setting->array.elem]);
+        json_stream_add_int(js, "len", setting->array.len);
+    }
+}
+#endif
+
+static void setting_to_json(json_stream_t *js, setting_t *setting, int parts)
+{
+    const setting_ops_t *ops = setting_ops(setting);
+    bool                 schema = parts & SETTING_JSON_SCHEMA;
+    bool                 values = parts & SETTING_JSON_VALUES;
+    setting_t           *orig = setting;
+    setting_t            snap;
+
+    /* values may be updated by other tasks while the response is sent */
+    if (values)
+        setting = setting_snapshot(setting, &snap);
+
+    json_stream_open(js, '{');
+    if (schema)
+        json_stream_add_str(js, "label", setting->label);
+    json_stream_add_str(js, "id", setting->id);
+    if (schema && *ops->name)
+        json_stream_add_type(js, ops);
+    if (ops->to_json)
+        ops->to_json(js, setting, orig, values, schema);
+    json_stream_close(js, '}');
+}
+
+/*
+ * GET selectors: `group` lists group IDs and `keys` lists "group:id" pairs,
+ * both comma separated. Only settings matching either list are serialized,
+ * groups without such settings are left out. No selector means everything.
+ */
+typedef struct {
+    char       *buf;
+    const char *groups;
+    const char *keys;
+#ifdef CONFIG_SETTINGS_CHANGE_FEED
+    /* ?since=<epoch>-<gen>: only settings changed after that generation */
+    bool        feed;
+    bool        delta; /* false when the client fell behind the feed */
+    uint32_t    epoch;
+    uint32_t    since;
+    uint32_t    gen;
+    uint32_t    wait_ms;
+    setting_t **changed;
+    size_t      changed_count;
+#endif
+} settings_select_t;
+
+/* next item of a comma separated list, NULL after the last one */
+static const char *select_list_next(const char **list, size_t *len)
+{
+    const char *item = *list;
+    const char *end;
+
+    if (!item)
+        return NULL;
+    end = strchr(item, ',');
+    *len = end ? (size_t)(end - item) : strlen(item);
+    *list = end ? end + 1 : NULL;
+    return item;
+}
+
+static bool select_item_is(const char *item, size_t len, const char *str)
+{
+    return !strncmp(item, str, len) && str[len] == '\0';
+}
+
+static bool settings_select_all(const settings_select_t *sel)
+{
+    return !sel || (!sel->groups && !sel->keys);
+}
+
+static bool settings_select_group(const settings_select_t *sel, const settings_group_t *gr)
+{
+    const char *list;
+    const char *item;
+    size_t      len;
+
+    if (settings_select_all(sel))
+        return true;
+    list = sel->groups;
+    while ((item = select_list_next(&list, &len))) {
+        if (select_item_is(item, len, gr->id))
+            return true;
+    }
+    return false;
+}
+
+/* "gr:id" item of the keys list, any setting of the group if setting is NULL */
+static bool settings_select_key(const settings_select_t *sel, const settings_group_t *gr, const setting_t *setting)
+{
+    const char *list = sel->keys;
+    const char *item;
+    size_t      gr_len = strlen(gr->id);
+    size_t      len;
+
+    while ((item = select_list_next(&list, &len))) {
+        if (len <= gr_len + 1 || item[gr_len] != ':' || strncmp(item, gr->id, gr_len))
+            continue;
+        if (!setting || select_item_is(item + gr_len + 1, len - gr_len - 1, setting->id))
+            return true;
+    }
+    return false;
+}
+
+static bool settings_select_delta(const settings_select_t *sel)
+{
+#ifdef CONFIG_SETTINGS_CHANGE_FEED
+    return sel && sel->delta;
+#else
+    return false;
+#endif
+}
+
+static bool settings_select_changed(const settings_select_t *sel, const setting_t *setting)
+{
+#ifdef CONFIG_SETTINGS_CHANGE_FEED
+    if (settings_select_delta(sel)) {
+        for (size_t i = 0; i < sel->changed_count; i++) {
+            if (sel->changed[i] == setting)
+                return true;
+        }
+        return false;
+    }
+#endif
+    return true;
+}
+
+static void settings_group_open_json(json_stream_t *js, const settings_group_t *gr, int parts)
+{
+    json_stream_open(js, '{');
+    if (parts & SETTING_JSON_SCHEMA)
+        json_stream_add_str(js, "label", gr->label);
+    json_stream_add_str(js, "id", gr->id);
+    json_stream_key(js, "settings");
+    json_stream_open(js, '[');
+}
+
+static void settings_pack_to_json(json_stream_t *js, const settings_group_t *settings_pack, int parts,
+                                  const settings_select_t *sel)
+{
+    json_stream_open(js, '{');
+    json_stream_key(js, "groups");
+    json_stream_open(js, '[');
+    for (const settings_group_t *gr = settings_pack; gr->label; gr++) {
+        bool whole = settings_select_group(sel, gr);
+        bool open = false;
+
+        if (!whole && !settings_select_key(sel, gr, NULL))
+            continue;
+
+        /* a delta lists only groups with changed settings */
+        if (whole && !settings_select_delta(sel)) {
+            settings_group_open_json(js, gr, parts);
+            open = true;
+        }
+        for (setting_t *setting = gr->settings; setting->label; setting++) {
+            if (!whole && !settings_select_key(sel, gr, setting))
+                continue;
+            if (!settings_select_changed(sel, setting))
+                continue;
+            if (!open) {
+                settings_group_open_json(js, gr, parts);
+                open = true;
+            }
+            setting_to_json(js, setting, parts);
+        }
+        if (open) {
+            json_stream_close(js, ']');
+            json_stream_close(js, '}');
+        }
+    }
+    json_stream_close(js, ']');
+    json_stream_close(js, '}');
+}
+
+/* schema never changes at runtime - its hash is computed once per pack */
+static uint32_t settings_pack_schema_etag(const settings_group_t *settings_pack)
+{
+    settings_index_t *index = settings_index_get(settings_pack);
+    json_stream_t     js = { .req = NULL, .hash = 2166136261u };
+
+    if (index && index->schema_etag)
+        return index->schema_etag;
+
+    settings_pack_to_json(&js, settings_pack, SETTING_JSON_SCHEMA, NULL);
+    json_stream_flush(&js);
+    if (js.hash == 0)
+        js.hash = 1;
+    if (index)
+        index->schema_etag = js.hash;
+    return js.hash;
+}
+
+/* true if the client already has the representation identified by etag */
+static bool httpd_etag_matches(httpd_req_t *req, const char *etag)
+{
+    char   value[64];
+    size_t len = httpd_req_get_hdr_value_len(req, "If-None-Match");
+
+    if (len == 0 || len >= sizeof(value))
+        return false;
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", value, sizeof(value)) != ESP_OK)
+        return false;
+    return strstr(value, etag) != NULL;
+}
+
+/* true if the request header field lists the media type */
+static bool httpd_hdr_has_type(httpd_req_t *req, const char *field, const char *type)
+{
+    char   value[128];
+    size_t len = httpd_req_get_hdr_value_len(req, field);
+
+    if (len == 0 || len >= sizeof(value))
+        return false;
+    if (httpd_req_get_hdr_value_str(req, field, value, sizeof(value)) != ESP_OK)
+        return false;
+    return strstr(value, type) != NULL;
+}
+
+static bool httpd_hdr_has_cbor(httpd_req_t *req, const char *field)
+{
+#ifdef CONFIG_SETTINGS_CBOR_SUPPORT
+    return httpd_hdr_has_type(req, field, SETTINGS_HTTPD_TYPE_CBOR);
+#else
+    return false;
+#endif
+}
+
+static esp_err_t httpd_send_not_modified(httpd_req_t *req, const char *etag)
+{
+#ifdef CONFIG_SETTINGS_CBOR_SUPPORT
+    httpd_resp_set_hdr(req, "Vary", "Accept");
+#endif
+    httpd_resp_set_status(req, "304 Not Modified");
+    httpd_resp_set_hdr(req, "ETag", etag);
+    return httpd_resp_send(req, NULL, 0);
+}
+
+/*
+ * Generations are sent as "<epoch>-<gen>" tokens, the counter restarts at
+ * boot and the epoch tells a token of an earlier boot from a current one.
+ */
+#define SETTINGS_GEN_TOKEN_LEN 20
+
+static void settings_gen_token(char *buf, size_t size, uint32_t gen)
+{
+    snprintf(buf, size, "%08" PRIx32 "-%" PRIu32, settings_epoch, gen);
+}
+
+/* whole response document: generation counters and the selected settings */
+static void settings_doc_to_json(json_stream_t *js, const settings_group_t *settings_pack, int parts,
+                                 const settings_select_t *sel)
+{
+    json_stream_open(js, '{');
+    if (parts == SETTING_JSON_VALUES) {
+        uint32_t gen = settings_generation;
+        char     token[SETTINGS_GEN_TOKEN_LEN];
+
+#ifdef CONFIG_SETTINGS_CHANGE_FEED
+        /* the generation the change feed was read at */
+        if (sel && sel->feed)
+            gen = sel->gen;
+#endif
+        settings_gen_token(token, sizeof(token), gen);
+        json_stream_add_str(js, "gen", token);
+#ifdef CONFIG_SETTINGS_CHANGE_FEED
+        if (settings_select_delta(sel)) {
+            settings_gen_token(token, sizeof(token), sel->since);
+            json_stream_add_str(js, "since", token);
+        }
+#endif
+    }
+    if (settings_pack) {
+        json_stream_key(js, "data");
+        settings_pack_to_json(js, settings_pack, parts, sel);
+    }
+    json_stream_close(js, '}');
+}
+
+static esp_err_t send_json_response(httpd_req_t *req, const settings_group_t *settings_pack, int parts,
+                                    const settings_select_t *sel)
+{
+    int64_t       start = settings_metrics_start();
+    json_stream_t js = { .req = req, .rc = ESP_OK };
+
+#ifdef CONFIG_SETTINGS_CBOR_SUPPORT
+    /* same URL serves both representations */
+    httpd_resp_set_hdr(req, "Vary", "Accept");
+    js.cbor = httpd_hdr_has_cbor(req, "Accept");
+    if (js.cbor)
+        httpd_resp_set_type(req, SETTINGS_HTTPD_TYPE_CBOR);
+    else
+#endif
+        httpd_resp_set_type(req, HTTPD_TYPE_JSON);
+    settings_doc_to_json(&js, settings_pack, parts, sel);
+    json_stream_flush(&js);
+    if (js.rc == ESP_OK)
+        js.rc = httpd_resp_send_chunk(req, NULL, 0);
+    settings_metrics_op(SETTINGS_METRIC_SERIALIZE, start, js.rc);
+    return js.rc;
+}
+
+static void setting_bool_from_string(setting_t *setting, const char *value)
+{
+    setting_set_bool(setting, !strcmp("on", value));
+}
+
+static void setting_num_from_string(setting_t *setting, const char *value)
+{
+    setting_set_num(setting, atoi(value));
+}
+
+static void setting_oneof_from_string(setting_t *setting, const char *value)
+{
+    setting_set_oneof(setting, atoi(value));
+}
+
+static void setting_text_from_string(setting_t *setting, const char *value)
+{
+    setting_set_text(setting, value);
+}
+
+#ifdef CONFIG_SETTINGS_DATETIME_SUPPORT
+static void setting_time_from_string(setting_t *setting, const char *value)
+{
+    setting_time_t time;
+
+    sscanf(value, "%d:%d", &time.hh, &time.mm);
+    setting_set_time(setting, &time);
+}
+
+static void setting_date_from_string(setting_t *setting, const char *value)
+{
+    setting_date_t date;
+
+    sscanf(value, "%d-%d-%d", &date.year, &date.month, &date.day);
+    setting_set_date(setting, &date);
+}
+
+static void setting_datetime_from_string(setting_t *setting, const char *value)
+{
+    setting_date_t     date;
+    setting_time_t     time;
+    setting_datetime_t combined;
+
+    sscanf(value, "%d-%d-%dT%d:%d", &date.year, &date.month, &date.day, &time.hh, &time.mm);
+    combined.date = date;
+    combined.time = time;
+    setting_set_datetime(setting, &combined);
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_COLOR_SUPPORT
+static void setting_color_from_form(setting_t *setting, const char *value)
+{
+    color_t color = { .combined = strtol(value + 1, NULL, 16) };
+
+    setting_set_color(setting, &color);
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_NET_SUPPORT
+static void setting_ipaddr_from_form(setting_t *setting, const char *value)
+{
+    ipaddr_t ipaddr;
+
+    if (setting_ipaddr_from_string(value, &ipaddr))
+        setting_set_ipaddr(setting, &ipaddr);
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_ARRAY_SUPPORT
+/* comma separated elements from the first one */
+static void setting_array_from_string(setting_t *setting, const char *value)
+{
+    setting_array_update_t upd;
+    char                  *end;
+
+    if (!setting_array_update_begin(setting, &upd))
+        return;
+    while (*value) {
+        float val = strtof(value, &end);
+
+        if (end == value) {
+            upd.ok = false;
+            break;
+        }
+        setting_array_update_put(setting, &upd, val);
+        for (value = end; *value == ',' || *value == ' ';)
+            value++;
+    }
+    setting_array_update_end(setting, &upd);
+}
+#endif
+
+static void setting_set_from_string(setting_t *setting, const char *value)
+{
+    const setting_ops_t *ops = setting_ops(setting);
+
+    if (ops->from_string)
+        ops->from_string(setting, value);
+}
+
+/* decode application/x-www-form-urlencoded text in place */
+static void form_urldecode(char *text)
+{
+    char *out = text;
+
+    for (char *in = text; *in; in++) {
+        if (*in == '+') {
+            *out++ = ' ';
+        } else if (*in == '%' && isxdigit((unsigned char)in[1]) && isxdigit((unsigned char)in[2])) {
+            char hex[3] = { in[1], in[2], '\0' };
+
+            *out++ = (char)strtol(hex, NULL, 16);
+            in += 2;
+        } else {
+            *out++ = *in;
+        }
+    }
+    *out = '\0';
+}
+
+#ifdef CONFIG_SETTINGS_NET_SUPPORT
+/* netif fields arrive as separate "gr:id:field" keys - merged before one setter call */
+typedef struct {
+    uint32_t     slot;
+    bool         has_value;
+    netif_conf_t netif;
+} form_netif_t;
+
+static form_netif_t *form_netif_get(form_netif_t **netifs, size_t *count, uint32_t slot, const setting_t *setting)
+{
+    form_netif_t *pending;
+
+    for (size_t i = 0; i < *count; i++) {
+        if ((*netifs)[i].slot == slot)
+            return &(*netifs)[i];
+    }
+
+    pending = realloc(*netifs, (*count + 1) * sizeof(form_netif_t));
+    if (!pending)
+        return NULL;
+
+    *netifs = pending;
+    pending = &pending[(*count)++];
+    pending->slot = slot;
+    pending->has_value = false;
+    pending->netif = setting->netif.val;
+    pending->netif.dhcp = false; /* unchecked box is not sent */
+    return pending;
+}
+#endif
+
+/*
+ * Apply urlencoded form body to the settings pack in a single pass.
+ * Tokens are split and decoded in place and dispatched through the lookup
+ * index. Checkboxes are only sent when checked, so bool settings missing
+ * from the form are cleared afterwards.
+ */
+static esp_err_t settings_form_apply(const settings_group_t *settings_pack, char *form)
+{
+    settings_index_t *index = settings_index_get(settings_pack);
+    uint32_t         *seen;
+    char             *next;
+#ifdef CONFIG_SETTINGS_NET_SUPPORT
+    form_netif_t *netifs = NULL;
+    size_t        netif_count = 0;
+#endif
+
+    if (!index)
+        return ESP_ERR_INVALID_STATE;
+
+    seen = calloc(index->mask / 32 + 1, sizeof(uint32_t));
+    if (!seen)
+        return ESP_ERR_NO_MEM;
+
+    for (char *key = form; key; key = next) {
+        setting_t *setting;
+        uint32_t   slot;
+        char      *value;
+        char      *id;
+        char      *field;
+
+        next = strchr(key, '&');
+        if (next)
+            *next++ = '\0';
+
+        value = strchr(key, '=');
+        if (!value)
+            continue;
+        *value++ = '\0';
+        form_urldecode(key);
+        form_urldecode(value);
+
+        id = strchr(key, ':');
+        if (!id)
+            continue;
+        *id++ = '\0';
+        field = strchr(id, ':');
+        if (field)
+            *field++ = '\0';
+
+        setting = settings_index_lookup(index, key, id, &slot);
+        if (!setting)
+            continue;
+        seen[slot / 32] |= 1u << (slot % 32);
+
+#ifdef CONFIG_SETTINGS_NET_SUPPORT
+        if (setting->type == SETTING_TYPE_NETIF) {
+            form_netif_t *pending;
+            ipaddr_t      ipaddr;
+
+            if (!field)
+                continue;
+
+            pending = form_netif_get(&netifs, &netif_count, slot, setting);
+            if (!pending)
+                continue;
+
+            if (!strcmp(field, "dhcp")) {
+                pending->netif.dhcp = !strcmp("on", value);
+            } else if (!strcmp(field, "ip")) {
+                pending->has_value = true;
+                if (setting_ipaddr_from_string(value, &ipaddr))
+                    pending->netif.ip = ipaddr;
+            } else if (!strcmp(field, "netmask")) {
+                pending->has_value = true;
+                if (setting_ipaddr_from_string(value, &ipaddr))
+                    pending->netif.netmask = ipaddr;
+            } else if (!strcmp(field, "gateway")) {
+                pending->has_value = true;
+                if (setting_ipaddr_from_string(value, &ipaddr))
+                    pending->netif.gateway = ipaddr;
+            }
+            continue;
+        }
+#endif
+        if (!field)
+            setting_set_from_string(setting, value);
+    }
+
+    for (uint32_t slot = 0; slot <= index->mask; slot++) {
+        setting_t *setting = index->slots[slot];
+
+        if (!setting)
+            continue;
+
+        /* Set bool settings to false by default(if false then not in request)*/
+        if (setting->type == SETTING_TYPE_BOOL && !(seen[slot / 32] & (1u << (slot % 32))) &&
+            setting->boolean.val)
+            setting_set_bool(setting, false);
+#ifdef CONFIG_SETTINGS_NET_SUPPORT
+        if (setting->type == SETTING_TYPE_NETIF) {
+            form_netif_t *pending = form_netif_get(&netifs, &netif_count, slot, setting);
+
+            if (pending && (pending->has_value || pending->netif.dhcp != setting->netif.val.dhcp))
+                setting_set_netif(setting, &pending->netif);
+        }
+#endif
+    }
+
+#ifdef CONFIG_SETTINGS_NET_SUPPORT
+    free(netifs);
+#endif
+    free(seen);
+    return ESP_OK;
+}
+
+/*
+ * JSON update reader, a pull tokenizer over the received body. Updates have
+ * the shape { group id: { setting id: value, ... }, ... } with values as in
+ * the values response and only the listed settings are changed, null resets
+ * a setting to its default. No tree is built: strings are unescaped in place
+ * and the body must be NUL terminated. Values of unknown keys or of an
+ * unexpected type are skipped, malformed documents stop the update with
+ * ESP_ERR_INVALID_ARG.
+ */
+#define JSON_MAX_DEPTH 8
+
+struct json_reader {
+    char *pos;
+    char *end;
+    bool  err;
+};
+
+/* first character of the next token, '\0' at the end of the body */
+static char json_peek(json_reader_t *rd)
+{
+    while (rd->pos < rd->end && (*rd->pos == ' ' || *rd->pos == '\t' || *rd->pos == '\n' || *rd->pos == '\r'))
+        rd->pos++;
+    return rd->pos < rd->end && !rd->err ? *rd->pos : '\0';
+}
+
+static bool json_expect(json_reader_t *rd, char c)
+{
+    if (json_peek(rd) != c) {
+        rd->err = true;
+        return false;
+    }
+    rd->pos++;
+    return true;
+}
+
+static bool json_literal(json_reader_t *rd, const char *literal)
+{
+    size_t len = strlen(literal);
+
+    if (json_peek(rd) != *literal || (size_t)(rd->end - rd->pos) < len || strncmp(rd->pos, literal, len)) {
+        rd->err = true;
+        return false;
+    }
+    rd->pos += len;
+    return true;
+}
+
+static int json_hex4(const char *pos)
+{
+    int val = 0;
+
+    for (int i = 0; i < 4; i++) {
+        char c = pos[i];
+
+        val <<= 4;
+        if (c >= '0' && c <= '9')
+            val |= c - '0';
+        else if (c >= 'a' && c <= 'f')
+            val |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            val |= c - 'A' + 10;
+        else
+            return -1;
+    }
+    return val;
+}
+
+/* \uXXXX escape (and the low half of a surrogate pair) as UTF-8 */
+static char *json_unescape_unicode(json_reader_t *rd, char *dst)
+{
+    long cp = rd->end - rd->pos >= 4 ? json_hex4(rd->pos) : -1;
+
+    if (cp < 0)
+        goto fail;
+    rd->pos += 4;
+    if (cp >= 0xd800 && cp <= 0xdbff) {
+        long low = rd->end - rd->pos >= 6 && rd->pos[0] == '\\' && rd->pos[1] == 'u' ? json_hex4(rd->pos + 2) : -1;
+
+        if (low < 0xdc00 || low > 0xdfff)
+            goto fail;
+        rd->pos += 6;
+        cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+    } else if (cp >= 0xdc00 && cp <= 0xdfff) {
+        goto fail;
+    }
+
+    /* never longer than the escape it replaces */
+    if (cp < 0x80) {
+        *dst++ = cp;
+    } else if (cp < 0x800) {
+        *dst++ = 0xc0 | cp >> 6;
+        *dst++ = 0x80 | (cp & 0x3f);
+    } else if (cp < 0x10000) {
+        *dst++ = 0xe0 | cp >> 12;
+        *dst++ = 0x80 | (cp >> 6 & 0x3f);
+        *dst++ = 0x80 | (cp & 0x3f);
+    } else {
+        *dst++ = 0xf0 | cp >> 18;
+        *dst++ = 0x80 | (cp >> 12 & 0x3f);
+        *dst++ = 0x80 | (cp >> 6 & 0x3f);
+        *dst++ = 0x80 | (cp & 0x3f);
+    }
+    return dst;
+
+fail:
+    rd->err = true;
+    return dst;
+}
+
+/* string token unescaped and terminated in place */
+static bool json_read_string(json_reader_t *rd, char **str)
+{
+    char *dst;
+
+    if (!json_expect(rd, '"'))
+        return false;
+    *str = dst = rd->pos;
+    while (!rd->err) {
+        char c;
+
+        if (rd->pos >= rd->end || (unsigned char)*rd->pos < 0x20) {
+            rd->err = true;
+            break;
+        }
+        c = *rd->pos++;
+        if (c == '"') {
+            *dst = '\0';
+            return true;
+        }
+        if (c != '\\') {
+            *dst++ = c;
+            continue;
+        }
+        c = rd->pos < rd->end ? *rd->pos++ : '\0';
+        switch (c) {
+        case '"':
+        case '\\':
+        case '/':
+            *dst++ = c;
+            break;
+        case 'b':
+            *dst++ = '\b';
+            break;
+        case 'f':
+            *dst++ = '\f';
+            break;
+        case 'n':
+            *dst++ = '\n';
+            break;
+        case 'r':
+            *dst++ = '\r';
+            break;
+        case 't':
+            *dst++ = '\t';
+            break;
+        case 'u':
+            dst = json_unescape_unicode(rd, dst);
+            break;
+        default:
+            rd->err = true;
+            break;
+        }
+    }
+    return false;
+}
+
+static void json_skip_depth(json_reader_t *rd, int depth);
+
+/* members or elements of a container up to its closing bracket */
+static void json_skip_items(json_reader_t *rd, char close, int depth)
+{
+    char *str;
+
+    rd->pos++;
+    if (json_peek(rd) == close) {
+        rd->pos++;
+        return;
+    }
+    while (!rd->err) {
+        if (close == '}' && (!json_read_string(rd, &str) || !json_expect(rd, ':')))
+            return;
+        json_skip_depth(rd, depth + 1);
+        if (json_peek(rd) != ',')
+            break;
+        rd->pos++;
+    }
+    json_expect(rd, close);
+}
+
+static void json_skip_depth(json_reader_t *rd, int depth)
+{
+    char *str;
+
+    if (depth > JSON_MAX_DEPTH) {
+        rd->err = true;
+        return;
+    }
+    switch (json_peek(rd)) {
+    case '"':
+        json_read_string(rd, &str);
+        break;
+    case '{':
+        json_skip_items(rd, '}', depth);
+        break;
+    case '[':
+        json_skip_items(rd, ']', depth);
+        break;
+    case 't':
+        json_literal(rd, "true");
+        break;
+    case 'f':
+        json_literal(rd, "false");
+        break;
+    case 'n':
+        json_literal(rd, "null");
+        break;
+    default:
+        /* number, validated loosely */
+        str = rd->pos;
+        while (rd->pos < rd->end && strchr("+-.0123456789eE", *rd->pos))
+            rd->pos++;
+        if (rd->pos == str)
+            rd->err = true;
+        break;
+    }
+}
+
+static void json_skip(json_reader_t *rd)
+{
+    json_skip_depth(rd, 0);
+}
+
+static bool json_object_begin(json_reader_t *rd)
+{
+    if (json_peek(rd) != '{')
+        return false;
+    rd->pos++;
+    return true;
+}
+
+/* true with the key of the next member, false after the closing brace */
+static bool json_object_next(json_reader_t *rd, bool *first, char **key)
+{
+    if (json_peek(rd) == '}') {
+        rd->pos++;
+        return false;
+    }
+    if (!*first && !json_expect(rd, ','))
+        return false;
+    *first = false;
+    return json_read_string(rd, key) && json_expect(rd, ':');
+}
+
+static bool json_read_int(json_reader_t *rd, int *val)
+{
+    char *end;
+    long  num;
+
+    if (json_peek(rd) != '-' && !(*rd->pos >= '0' && *rd->pos <= '9')) {
+        json_skip(rd);
+        return false;
+    }
+    errno = 0;
+    num = strtol(rd->pos, &end, 10);
+    if (end == rd->pos) {
+        rd->err = true;
+        return false;
+    }
+    if (*end == '.' || *end == 'e' || *end == 'E') {
+        json_skip(rd);
+        return false;
+    }
+    rd->pos = end;
+    if (errno || num < INT_MIN || num > INT_MAX)
+        return false;
+    *val = num;
+    return true;
+}
+
+static bool json_read_bool(json_reader_t *rd, bool *val)
+{
+    switch (json_peek(rd)) {
+    case 't':
+        *val = true;
+        return json_literal(rd, "true");
+    case 'f':
+        *val = false;
+        return json_literal(rd, "false");
+    default:
+        json_skip(rd);
+        return false;
+    }
+}
+
+static bool json_read_str(json_reader_t *rd, char **str)
+{
+    if (json_peek(rd) != '"') {
+        json_skip(rd);
+        return false;
+    }
+    return json_read_string(rd, str);
+}
+
+#ifdef CONFIG_SETTINGS_ARRAY_SUPPORT
+static bool json_read_float(json_reader_t *rd, float *val)
+{
+    char *end;
+
+    if (json_peek(rd) != '-' && !(*rd->pos >= '0' && *rd->pos <= '9')) {
+        json_skip(rd);
+        return false;
+    }
+    *val = strtof(rd->pos, &end);
+    if (end == rd->pos) {
+        rd->err = true;
+        return false;
+    }
+    rd->pos = end;
+    return true;
+}
+
+/* list of elements or a single number */
+static void json_read_array(json_reader_t *rd, const setting_t *setting, setting_array_update_t *upd)
+{
+    float val;
+
+    if (json_peek(rd) != '[') {
+        upd->scalar = true;
+        if (json_read_float(rd, &val))
+            setting_array_update_put(setting, upd, val);
+        else
+            upd->ok = false;
+        return;
+    }
+    rd->pos++;
+    if (json_peek(rd) == ']') {
+        rd->pos++;
+        return;
+    }
+    while (!rd->err) {
+        if (json_read_float(rd, &val))
+            setting_array_update_put(setting, upd, val);
+        else
+            upd->ok = false;
+        if (json_peek(rd) != ',')
+            break;
+        rd->pos++;
+    }
+    json_expect(rd, ']');
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_DATETIME_SUPPORT
+/* object of integer fields, fields not in the object keep their value */
+static bool json_read_int_fields(json_reader_t *rd, const char *const *names, int *const *vals)
+{
+    bool  first = true;
+    char *key;
+
+    if (!json_object_begin(rd)) {
+        json_skip(rd);
+        return false;
+    }
+    while (json_object_next(rd, &first, &key)) {
+        int i = 0;
+
+        while (names[i] && strcmp(key, names[i]))
+            i++;
+        if (names[i])
+            json_read_int(rd, vals[i]);
+        else
+            json_skip(rd);
+    }
+    return !rd->err;
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_NET_SUPPORT
+static bool json_read_netif(json_reader_t *rd, netif_conf_t *netif)
+{
+    bool  first = true;
+    char *key;
+    char *str;
+
+    if (!json_object_begin(rd)) {
+        json_skip(rd);
+        return false;
+    }
+    while (json_object_next(rd, &first, &key)) {
+        ipaddr_t *ipaddr = NULL;
+
+        if (!strcmp(key, "dhcp")) {
+            json_read_bool(rd, &netif->dhcp);
+            continue;
+        }
+        if (!strcmp(key, "ip"))
+            ipaddr = &netif->ip;
+        else if (!strcmp(key, "netmask"))
+            ipaddr = &netif->netmask;
+        else if (!strcmp(key, "gateway"))
+            ipaddr = &netif->gateway;
+
+        if (!ipaddr)
+            json_skip(rd);
+        else if (json_read_str(rd, &str))
+            setting_ipaddr_from_string(str, ipaddr);
+    }
+    return !rd->err;
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_COLOR_SUPPORT
+/* "#rrggbb" */
+static bool setting_color_from_string(const char *text, color_t *color)
+{
+    char    *end;
+    uint32_t rgb;
+
+    if (text[0] != '#' || strlen(text) != 7)
+        return false;
+    rgb = strtoul(text + 1, &end, 16);
+    if (*end)
+        return false;
+    color->r = rgb >> 16;
+    color->g = rgb >> 8;
+    color->b = rgb;
+    return true;
+}
+#endif
+
+static void setting_bool_from_json(setting_t *setting, json_reader_t *rd)
+{
+    bool val;
+
+    if (json_read_bool(rd, &val))
+        setting_set_bool(setting, val);
+}
+
+static void setting_num_from_json(setting_t *setting, json_reader_t *rd)
+{
+    int val;
+
+    if (json_read_int(rd, &val))
+        setting_set_num(setting, val);
+}
+
+static void setting_oneof_from_json(setting_t *setting, json_reader_t *rd)
+{
+    int val;
+
+    if (json_read_int(rd, &val))
+        setting_set_oneof(setting, val);
+}
+
+static void setting_text_from_json(setting_t *setting, json_reader_t *rd)
+{
+    char *str;
+
+    if (json_read_str(rd, &str))
+        setting_set_text(setting, str);
+}
+
+#ifdef CONFIG_SETTINGS_DATETIME_SUPPORT
+static void setting_time_from_json(setting_t *setting, json_reader_t *rd)
+{
+    static const char *const names[] = { "hh", "mm", "ss", NULL };
+    setting_time_t           time;
+    int *const               vals[] = { &time.hh, &time.mm, &time.ss };
+
+    setting_get_time(setting, &time);
+    if (json_read_int_fields(rd, names, vals))
+        setting_set_time(setting, &time);
+}
+
+static void setting_date_from_json(setting_t *setting, json_reader_t *rd)
+{
+    static const char *const names[] = { "day", "month", "year", NULL };
+    setting_date_t           date;
+    int *const               vals[] = { &date.day, &date.month, &date.year };
+
+    setting_get_date(setting, &date);
+    if (json_read_int_fields(rd, names, vals))
+        setting_set_date(setting, &date);
+}
+
+static void setting_datetime_from_json(setting_t *setting, json_reader_t *rd)
+{
+    static const char *const names[] = { "hh", "mm", "ss", "day", "month", "year", NULL };
+    setting_datetime_t       dt;
+    int *const vals[] = { &dt.time.hh, &dt.time.mm, &dt.time.ss, &dt.date.day, &dt.date.month, &dt.date.year };
+
+    setting_get_datetime(setting, &dt);
+    if (json_read_int_fields(rd, names, vals))
+        setting_set_datetime(setting, &dt);
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_COLOR_SUPPORT
+static void setting_color_from_json(setting_t *setting, json_reader_t *rd)
+{
+    color_t color;
+    char   *str;
+
+    setting_get_color(setting, &color);
+    if (json_read_str(rd, &str) && setting_color_from_string(str, &color))
+        setting_set_color(setting, &color);
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_NET_SUPPORT
+static void setting_ipaddr_from_json(setting_t *setting, json_reader_t *rd)
+{
+    ipaddr_t ipaddr;
+    char    *str;
+
+    if (json_read_str(rd, &str) && setting_ipaddr_from_string(str, &ipaddr))
+        setting_set_ipaddr(setting, &ipaddr);
+}
+
+static void setting_netif_from_json(setting_t *setting, json_reader_t *rd)
+{
+    netif_conf_t netif;
+
+    setting_get_netif(setting, &netif);
+    if (json_read_netif(rd, &netif))
+        setting_set_netif(setting, &netif);
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_ARRAY_SUPPORT
+/* whole array as a list, or a range as {"offset": 8, "val": [...]} or {"offset": 8, "count": 4, "val": 0} */
+static void setting_array_from_json(setting_t *setting, json_reader_t *rd)
+{
+    setting_array_update_t upd;
+    bool                   first = true;
+    char                  *key;
+    int                    num;
+
+    if (!setting_array_update_begin(setting, &upd)) {
+        json_skip(rd);
+        return;
+    }
+    if (json_object_begin(rd)) {
+        while (json_object_next(rd, &first, &key)) {
+            if (!strcmp(key, "val")) {
+                json_read_array(rd, setting, &upd);
+            } else if (!strcmp(key, "offset") || !strcmp(key, "count")) {
+                if (!json_read_int(rd, &num) || num < 0)
+                    upd.ok = false;
+                else if (key[0] == 'o')
+                    upd.offset = num;
+                else
+                    upd.fill = num;
+            } else {
+                json_skip(rd);
+            }
+        }
+    } else {
+        json_read_array(rd, setting, &upd);
+    }
+    if (rd->err)
+        upd.ok = false;
+    setting_array_update_end(setting, &upd);
+}
+#endif
+
+static void setting_set_from_json(setting_t *setting, json_reader_t *rd)
+{
+    const setting_ops_t *ops = setting_ops(setting);
+
+    if (json_peek(rd) == 'n') {
+        if (json_literal(rd, "null"))
+            setting_set_defaults(setting);
+        return;
+    }
+
+    if (ops->from_json)
+        ops->from_json(setting, rd);
+    else
+        json_skip(rd);
+}
+
+/* JSON update: { group id: { setting id: value, ... }, ... } */
+static esp_err_t settings_json_apply(const settings_group_t *settings_pack, char *data, size_t len)
+{
+    settings_index_t *index = settings_index_get(settings_pack);
+    json_reader_t     rd = { .pos = data, .end = data + len };
+    bool              groups_first = true;
+    char             *gr_id;
+
+    if (!index)
+        return ESP_ERR_INVALID_STATE;
+    if (!json_object_begin(&rd))
+        return ESP_ERR_INVALID_ARG;
+
+    while (json_object_next(&rd, &groups_first, &gr_id)) {
+        bool  first = true;
+        char *id;
+
+        if (!json_object_begin(&rd)) {
+            json_skip(&rd);
+            continue;
+        }
+        while (json_object_next(&rd, &first, &id)) {
+            setting_t *setting = settings_index_lookup(index, gr_id, id, NULL);
+
+            if (setting)
+                setting_set_from_json(setting, &rd);
+            else
+                json_skip(&rd);
+        }
+    }
+    if (json_peek(&rd) != '\0')
+        rd.err = true;
+    return rd.err ? ESP_ERR_INVALID_ARG : ESP_OK;
+}
+
+#ifdef CONFIG_SETTINGS_CBOR_SUPPORT
+/*
+ * CBOR update reader. Only what a settings update needs is decoded:
+ * integers up to 32 bits, definite-length text, booleans and maps of
+ * either length kind. Values of unknown keys or of an unexpected type are
+ * skipped, a malformed document stops the update with ESP_ERR_INVALID_ARG.
+ */
+#define CBOR_MAX_DEPTH 8
+
+struct cbor_reader {
+    const uint8_t *pos;
+    const uint8_t *end;
+    bool           err;
+};
+
+typedef struct {
+    uint32_t left;
+    bool     indefinite;
+} cbor_map_t;
+
+static bool cbor_peek(cbor_reader_t *rd, uint8_t major)
+{
+    return !rd->err && rd->pos < rd->end && *rd->pos >> 5 == major;
+}
+
+static bool cbor_peek_indefinite(cbor_reader_t *rd)
+{
+    return rd->pos < rd->end && (*rd->pos & 0x1f) == CBOR_INDEFINITE;
+}
+
+/* initial byte and argument of the next item, 64-bit arguments are refused */
+static bool cbor_read_head(cbor_reader_t *rd, uint8_t *major, uint32_t *val)
+{
+    uint8_t info;
+    size_t  len;
+
+    if (rd->err || rd->pos >= rd->end) {
+        rd->err = true;
+        return false;
+    }
+    *major = *rd->pos >> 5;
+    info = *rd->pos++ & 0x1f;
+    *val = info;
+    if (info < 24 || info == CBOR_INDEFINITE)
+        return true;
+
+    len = info <= 26 ? 1u << (info - 24) : 0;
+    if (!len || (size_t)(rd->end - rd->pos) < len) {
+        rd->err = true;
+        return false;
+    }
+    *val = 0;
+    while (len--)
+        *val = *val << 8 | *rd->pos++;
+    return true;
+}
+
+/* items of an indefinite-length container up to its break */
+static void cbor_skip_items(cbor_reader_t *rd, int depth);
+
+static void cbor_skip_depth(cbor_reader_t *rd, int depth)
+{
+    bool     indefinite = cbor_peek_indefinite(rd);
+    uint8_t  major;
+    uint32_t val;
+
+    if (depth > CBOR_MAX_DEPTH)
+        rd->err = true;
+    if (!cbor_read_head(rd, &major, &val))
+        return;
+
+    switch (major) {
+    case CBOR_TEXT:
+    case CBOR_BYTES:
+        if (indefinite)
+            cbor_skip_items(rd, depth);
+        else if ((size_t)(rd->end - rd->pos) < val)
+            rd->err = true;
+        else
+            rd->pos += val;
+        break;
+    case CBOR_ARRAY:
+    case CBOR_MAP:
+        if (indefinite) {
+            cbor_skip_items(rd, depth);
+            break;
+        }
+        for (uint64_t n = (uint64_t)val << (major == CBOR_MAP); n && !rd->err; n--)
+            cbor_skip_depth(rd, depth + 1);
+        break;
+    case CBOR_TAG:
+        cbor_skip_depth(rd, depth + 1);
+        break;
+    case CBOR_MAJOR_SIMPLE:
+        /* a break outside of an indefinite-length item */
+        if (indefinite)
+            rd->err = true;
+        break;
+    default:
+        break;
+    }
+}
+
+static void cbor_skip_items(cbor_reader_t *rd, int depth)
+{
+    while (!rd->err && rd->pos < rd->end && *rd->pos != CBOR_BREAK)
+        cbor_skip_depth(rd, depth + 1);
+    if (rd->pos >= rd->end)
+        rd->err = true;
+    else
+        rd->pos++;
+}
+
+static void cbor_skip(cbor_reader_t *rd)
+{
+    cbor_skip_depth(rd, 0);
+}
+
+static bool cbor_map_begin(cbor_reader_t *rd, cbor_map_t *map)
+{
+    uint8_t major;
+
+    if (!cbor_peek(rd, CBOR_MAP))
+        return false;
+    map->indefinite = cbor_peek_indefinite(rd);
+    return cbor_read_head(rd, &major, &map->left);
+}
+
+/* true while there is another key-value pair in the map */
+static bool cbor_map_next(cbor_reader_t *rd, cbor_map_t *map)
+{
+    if (rd->err)
+        return false;
+    if (!map->indefinite) {
+        if (!map->left)
+            return false;
+        map->left--;
+        return true;
+    }
+    if (rd->pos >= rd->end) {
+        rd->err = true;
+        return false;
+    }
+    if (*rd->pos == CBOR_BREAK) {
+        rd->pos++;
+        return false;
+    }
+    return true;
+}
+
+/* text item in place, not terminated */
+static bool cbor_read_text(cbor_reader_t *rd, const char **text, size_t *len)
+{
+    uint8_t  major;
+    uint32_t val;
+
+    if (!cbor_peek(rd, CBOR_TEXT) || cbor_peek_indefinite(rd)) {
+        cbor_skip(rd);
+        return false;
+    }
+    if (!cbor_read_head(rd, &major, &val))
+        return false;
+    if ((size_t)(rd->end - rd->pos) < val) {
+        rd->err = true;
+        return false;
+    }
+    *text = (const char *)rd->pos;
+    *len = val;
+    rd->pos += val;
+    return true;
+}
+
+/* map key copied into a terminated buffer, longer keys are not matched */
+static bool cbor_read_key(cbor_reader_t *rd, char *key, size_t key_size)
+{
+    const char *text;
+    size_t      len;
+
+    if (!cbor_read_text(rd, &text, &len) || len >= key_size)
+        return false;
+    memcpy(key, text, len);
+    key[len] = '\0';
+    return true;
+}
+
+static bool cbor_read_int(cbor_reader_t *rd, int *val)
+{
+    uint8_t  major;
+    uint32_t arg;
+
+    if (!cbor_peek(rd, CBOR_UINT) && !cbor_peek(rd, CBOR_NINT)) {
+        cbor_skip(rd);
+        return false;
+    }
+    if (!cbor_read_head(rd, &major, &arg) || arg > INT32_MAX)
+        return false;
+    *val = major == CBOR_UINT ? (int)arg : -1 - (int)arg;
+    return true;
+}
+
+static bool cbor_read_u32(cbor_reader_t *rd, uint32_t *val)
+{
+    uint8_t major;
+
+    if (!cbor_peek(rd, CBOR_UINT)) {
+        cbor_skip(rd);
+        return false;
+    }
+    return cbor_read_head(rd, &major, val);
+}
+
+static bool cbor_read_bool(cbor_reader_t *rd, bool *val)
+{
+    if (rd->err || rd->pos >= rd->end || (*rd->pos != CBOR_TRUE && *rd->pos != CBOR_FALSE)) {
+        cbor_skip(rd);
+        return false;
+    }
+    *val = *rd->pos++ == CBOR_TRUE;
+    return true;
+}
+
+#ifdef CONFIG_SETTINGS_ARRAY_SUPPORT
+/* integer or half, single or double precision float */
+static bool cbor_read_float(cbor_reader_t *rd, float *val)
+{
+    uint64_t bits = 0;
+    size_t   len;
+    int      num;
+
+    if (cbor_peek(rd, CBOR_UINT) || cbor_peek(rd, CBOR_NINT)) {
+        if (!cbor_read_int(rd, &num))
+            return false;
+        *val = num;
+        return true;
+    }
+    if (!cbor_peek(rd, CBOR_MAJOR_SIMPLE) || (*rd->pos & 0x1f) < 25 || (*rd->pos & 0x1f) > 27) {
+        cbor_skip(rd);
+        return false;
+    }
+    len = 1u << ((*rd->pos & 0x1f) - 24);
+    if ((size_t)(rd->end - rd->pos) <= len) {
+        rd->err = true;
+        return false;
+    }
+    for (size_t i = 1; i <= len; i++)
+        bits = bits << 8 | rd->pos[i];
+    rd->pos += 1 + len;
+
+    if (len == 2) {
+        uint32_t exp = bits >> 10 & 0x1f;
+        uint32_t mant = bits & 0x3ff;
+
+        if (exp == 0x1f)
+            *val = mant ? NAN : INFINITY;
+        else if (exp)
+            *val = (mant | 0x400) * (exp >= 25 ? (float)(1u << (exp - 25)) : 1.0f / (1u << (25 - exp)));
+        else
+            *val = mant / 16777216.0f;
+        if (bits & 0x8000)
+            *val = -*val;
+    } else if (len == 4) {
+        uint32_t single = bits;
+
+        memcpy(val, &single, sizeof(*val));
     } else {
-        ESP_LOGE(TAG, "nvs open error %s", esp_err_to_name(rc));
+        double dbl;
+
+        memcpy(&dbl, &bits, sizeof(dbl));
+        *val = dbl;
     }
-    return rc;
+    return true;
+}
+
+static void cbor_read_array(cbor_reader_t *rd, const setting_t *setting, setting_array_update_t *upd)
+{
+    bool     indefinite;
+    uint8_t  major;
+    uint32_t left;
+    float    val;
+
+    if (!cbor_peek(rd, CBOR_ARRAY)) {
+        upd->scalar = true;
+        if (cbor_read_float(rd, &val))
+            setting_array_update_put(setting, upd, val);
+        else
+            upd->ok = false;
+        return;
+    }
+    indefinite = cbor_peek_indefinite(rd);
+    if (!cbor_read_head(rd, &major, &left))
+        return;
+    while (!rd->err) {
+        if (indefinite) {
+            if (rd->pos >= rd->end) {
+                rd->err = true;
+                break;
+            }
+            if (*rd->pos == CBOR_BREAK) {
+                rd->pos++;
+                break;
+            }
+        } else if (!left--) {
+            break;
+        }
+        if (cbor_read_float(rd, &val))
+            setting_array_update_put(setting, upd, val);
+        else
+            upd->ok = false;
+    }
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_DATETIME_SUPPORT
+/* map of integer fields, fields not in the map keep their value */
+static bool cbor_read_int_fields(cbor_reader_t *rd, const char *const *names, int *const *vals)
+{
+    cbor_map_t map;
+    char       key[8];
+
+    if (!cbor_map_begin(rd, &map)) {
+        cbor_skip(rd);
+        return false;
+    }
+    while (cbor_map_next(rd, &map)) {
+        int i = 0;
+
+        if (cbor_read_key(rd, key, sizeof(key))) {
+            while (names[i] && strcmp(key, names[i]))
+                i++;
+        } else {
+            while (names[i])
+                i++;
+        }
+        if (names[i])
+            cbor_read_int(rd, vals[i]);
+        else
+            cbor_skip(rd);
+    }
+    return !rd->err;
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_NET_SUPPORT
+static bool cbor_read_netif(cbor_reader_t *rd, netif_conf_t *netif)
+{
+    cbor_map_t map;
+    char       key[8];
+    uint32_t   val;
+
+    if (!cbor_map_begin(rd, &map)) {
+        cbor_skip(rd);
+        return false;
+    }
+    while (cbor_map_next(rd, &map)) {
+        ipaddr_t *ipaddr = NULL;
+
+        if (!cbor_read_key(rd, key, sizeof(key))) {
+            cbor_skip(rd);
+            continue;
+        }
+        if (!strcmp(key, "dhcp")) {
+            cbor_read_bool(rd, &netif->dhcp);
+            continue;
+        }
+        if (!strcmp(key, "ip"))
+            ipaddr = &netif->ip;
+        else if (!strcmp(key, "netmask"))
+            ipaddr = &netif->netmask;
+        else if (!strcmp(key, "gateway"))
+            ipaddr = &netif->gateway;
+
+        if (ipaddr && cbor_read_u32(rd, &val))
+            setting_ipaddr_from_u32(val, ipaddr);
+        else if (!ipaddr)
+            cbor_skip(rd);
+    }
+    return !rd->err;
+}
+#endif
+
+static void setting_bool_from_cbor(setting_t *setting, cbor_reader_t *rd)
+{
+    bool val;
+
+    if (cbor_read_bool(rd, &val))
+        setting_set_bool(setting, val);
+}
+
+static void setting_num_from_cbor(setting_t *setting, cbor_reader_t *rd)
+{
+    int val;
+
+    if (cbor_read_int(rd, &val))
+        setting_set_num(setting, val);
+}
+
+static void setting_oneof_from_cbor(setting_t *setting, cbor_reader_t *rd)
+{
+    int val;
+
+    if (cbor_read_int(rd, &val))
+        setting_set_oneof(setting, val);
+}
+
+/* text and timezone */
+static void setting_text_from_cbor(setting_t *setting, cbor_reader_t *rd)
+{
+    const char *text;
+    size_t      len;
+    char       *buf;
+
+    if (!cbor_read_text(rd, &text, &len))
+        return;
+    /* setters take terminated strings and truncate to the buffer length */
+    if (len >= setting->text.len)
+        len = setting->text.len ? setting->text.len - 1 : 0;
+    buf = malloc(len + 1);
+    if (!buf)
+        return;
+    memcpy(buf, text, len);
+    buf[len] = '\0';
+    setting_set_text(setting, buf);
+    free(buf);
+}
+
+#ifdef CONFIG_SETTINGS_DATETIME_SUPPORT
+static void setting_time_from_cbor(setting_t *setting, cbor_reader_t *rd)
+{
+    static const char *const names[] = { "hh", "mm", "ss", NULL };
+    setting_time_t           time;
+    int *const               vals[] = { &time.hh, &time.mm, &time.ss };
+
+    setting_get_time(setting, &time);
+    if (cbor_read_int_fields(rd, names, vals))
+        setting_set_time(setting, &time);
+}
+
+static void setting_date_from_cbor(setting_t *setting, cbor_reader_t *rd)
+{
+    static const char *const names[] = { "day", "month", "year", NULL };
+    setting_date_t           date;
+    int *const               vals[] = { &date.day, &date.month, &date.year };
+
+    setting_get_date(setting, &date);
+    if (cbor_read_int_fields(rd, names, vals))
+        setting_set_date(setting, &date);
+}
+
+static void setting_datetime_from_cbor(setting_t *setting, cbor_reader_t *rd)
+{
+    static const char *const names[] = { "hh", "mm", "ss", "day", "month", "year", NULL };
+    setting_datetime_t       dt;
+    int *const vals[] = { &dt.time.hh, &dt.time.mm, &dt.time.ss, &dt.date.day, &dt.date.month, &dt.date.year };
+
+    setting_get_datetime(setting, &dt);
+    if (cbor_read_int_fields(rd, names, vals))
+        setting_set_datetime(setting, &dt);
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_COLOR_SUPPORT
+static void setting_color_from_cbor(setting_t *setting, cbor_reader_t *rd)
+{
+    color_t  color;
+    uint32_t val;
+
+    if (!cbor_read_u32(rd, &val))
+        return;
+    setting_get_color(setting, &color);
+    color.r = val >> 16;
+    color.g = val >> 8;
+    color.b = val;
+    setting_set_color(setting, &color);
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_NET_SUPPORT
+static void setting_ipaddr_from_cbor(setting_t *setting, cbor_reader_t *rd)
+{
+    ipaddr_t ipaddr;
+    uint32_t val;
+
+    if (cbor_read_u32(rd, &val)) {
+        setting_ipaddr_from_u32(val, &ipaddr);
+        setting_set_ipaddr(setting, &ipaddr);
+    }
+}
+
+static void setting_netif_from_cbor(setting_t *setting, cbor_reader_t *rd)
+{
+    netif_conf_t netif;
+
+    setting_get_netif(setting, &netif);
+    if (cbor_read_netif(rd, &netif))
+        setting_set_netif(setting, &netif);
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_ARRAY_SUPPORT
+static void setting_array_from_cbor(setting_t *setting, cbor_reader_t *rd)
+{
+    setting_array_update_t upd;
+    cbor_map_t             map;
+    char                   key[8];
+    int                    num;
+
+    if (!setting_array_update_begin(setting, &upd)) {
+        cbor_skip(rd);
+        return;
+    }
+    if (cbor_map_begin(rd, &map)) {
+        while (cbor_map_next(rd, &map)) {
+            if (!cbor_read_key(rd, key, sizeof(key))) {
+                cbor_skip(rd);
+            } else if (!strcmp(key, "val")) {
+                cbor_read_array(rd, setting, &upd);
+            } else if (!strcmp(key, "offset") || !strcmp(key, "count")) {
+                if (!cbor_read_int(rd, &num) || num < 0)
+                    upd.ok = false;
+                else if (key[0] == 'o')
+                    upd.offset = num;
+                else
+                    upd.fill = num;
+            } else {
+                cbor_skip(rd);
+            }
+        }
+    } else {
+        cbor_read_array(rd, setting, &upd);
+    }
+    if (rd->err)
+        upd.ok = false;
+    setting_array_update_end(setting, &upd);
+}
+#endif
+
+static void setting_set_from_cbor(setting_t *setting, cbor_reader_t *rd)
+{
+    const setting_ops_t *ops = setting_ops(setting);
+
+    if (ops->from_cbor)
+        ops->from_cbor(setting, rd);
+    else
+        cbor_skip(rd);
+}
+
+/* CBOR update: { group id: { setting id: value, ... }, ... } */
+static esp_err_t settings_cbor_apply(const settings_group_t *settings_pack, const uint8_t *data, size_t len)
+{
+    settings_index_t *index = settings_index_get(settings_pack);
+    cbor_reader_t     rd = { .pos = data, .end = data + len };
+    cbor_map_t        groups;
+    cbor_map_t        settings;
+    char              gr_id[SETTINGS_NVS_ID_LEN];
+    char              id[SETTINGS_NVS_ID_LEN];
+
+    if (!index)
+        return ESP_ERR_INVALID_STATE;
+    if (!cbor_map_begin(&rd, &groups))
+        return ESP_ERR_INVALID_ARG;
+
+    while (cbor_map_next(&rd, &groups)) {
+        if (!cbor_read_key(&rd, gr_id, sizeof(gr_id)) || !cbor_map_begin(&rd, &settings)) {
+            cbor_skip(&rd);
+            continue;
+        }
+        while (cbor_map_next(&rd, &settings)) {
+            setting_t *setting = NULL;
+
+            if (cbor_read_key(&rd, id, sizeof(id)))
+                setting = settings_index_lookup(index, gr_id, id, NULL);
+            if (setting)
+                setting_set_from_cbor(setting, &rd);
+            else
+                cbor_skip(&rd);
+        }
+    }
+    return rd.err ? ESP_ERR_INVALID_ARG : ESP_OK;
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_CUSTOM_TYPES
+/*
+ * Application defined types: values are raw blobs of `custom.size` bytes and
+ * travel as text produced and parsed by the registered descriptor.
+ */
+typedef struct {
+    setting_ops_t              ops;
+    const setting_type_desc_t *desc;
+} setting_custom_type_t;
+
+static setting_custom_type_t setting_custom_types[CONFIG_SETTINGS_CUSTOM_TYPES_MAX];
+
+static const setting_type_desc_t *setting_custom_desc(const setting_t *setting)
+{
+    return setting_custom_types[setting->type - SETTING_TYPE_CUSTOM].desc;
+}
+
+static bool setting_custom_format(const setting_t *setting, const void *val, char *buf)
+{
+    if (setting_custom_desc(setting)->format(setting, val, buf, CONFIG_SETTINGS_CUSTOM_TYPE_TEXT_LEN))
+        return true;
+    buf[0] = '\0';
+    return false;
+}
+
+static void setting_custom_set_default(setting_t *setting)
+{
+    memcpy(setting->custom.val, setting->custom.def, setting->custom.size);
+}
+
+static size_t setting_custom_encode(const setting_t *setting, void *buf)
+{
+    return value_put(buf, setting->custom.val, setting->custom.size);
+}
+
+static esp_err_t setting_custom_decode(setting_t *setting, const void *val, size_t len)
+{
+    if (len != setting->custom.size)
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    setting_set_custom(setting, val);
+    return ESP_OK;
+}
+
+static esp_err_t setting_custom_nvs_read(setting_t *setting, nvs_handle_t nvs)
+{
+    return setting_buf_nvs_read(setting, nvs, setting->custom.val, setting->custom.size);
+}
+
+static esp_err_t setting_custom_nvs_write(setting_t *setting, nvs_handle_t nvs)
+{
+    return nvs_set_blob(nvs, setting->nvs_id, setting->custom.val, setting->custom.size);
+}
+
+static void setting_custom_print(setting_t *setting)
+{
+    char buf[CONFIG_SETTINGS_CUSTOM_TYPE_TEXT_LEN];
+
+    setting_custom_format(setting, setting->custom.val, buf);
+    printf("%s\n", buf);
+}
+
+static void setting_custom_to_json(json_stream_t *js, setting_t *setting, setting_t *orig, bool values, bool schema)
+{
+    char buf[CONFIG_SETTINGS_CUSTOM_TYPE_TEXT_LEN];
+
+    if (values) {
+        /* the value buffer is shared with the snapshot */
+        settings_lock();
+        setting_custom_format(orig, orig->custom.val, buf);
+        settings_unlock();
+        json_stream_add_str(js, "val", buf);
+    }
+    if (schema) {
+        setting_custom_format(setting, setting->custom.def, buf);
+        json_stream_add_str(js, "def", buf);
+    }
+}
+
+static void setting_custom_from_string(setting_t *setting, const char *value)
+{
+    void *val = malloc(setting->custom.size);
+
+    if (!val)
+        return;
+    setting_get_custom(setting, val);
+    if (setting_custom_desc(setting)->parse(setting, value, val))
+        setting_set_custom(setting, val);
+    else
+        ESP_LOGW(TAG, "%s: invalid value '%s'", setting->nvs_id, value);
+    free(val);
+}
+
+static void setting_custom_from_json(setting_t *setting, json_reader_t *rd)
+{
+    char *str;
+
+    if (json_read_str(rd, &str))
+        setting_custom_from_string(setting, str);
+}
+
+#ifdef CONFIG_SETTINGS_CBOR_SUPPORT
+static void setting_custom_from_cbor(setting_t *setting, cbor_reader_t *rd)
+{
+    char        buf[CONFIG_SETTINGS_CUSTOM_TYPE_TEXT_LEN];
+    const char *text;
+    size_t      len;
+
+    if (!cbor_read_text(rd, &text, &len))
+        return;
+    if (len >= sizeof(buf))
+        len = sizeof(buf) - 1;
+    memcpy(buf, text, len);
+    buf[len] = '\0';
+    setting_custom_from_string(setting, buf);
+}
+#endif
+
+esp_err_t settings_type_register(setting_type_t type, const setting_type_desc_t *desc)
+{
+    setting_custom_type_t *custom;
+
+    if (type < SETTING_TYPE_CUSTOM || type >= SETTING_TYPE_CUSTOM + CONFIG_SETTINGS_CUSTOM_TYPES_MAX || !desc ||
+        !desc->name || !desc->format || !desc->parse)
+        return ESP_ERR_INVALID_ARG;
+
+    custom = &setting_custom_types[type - SETTING_TYPE_CUSTOM];
+    if (custom->desc)
+        return ESP_ERR_INVALID_STATE;
+
+    custom->ops = (setting_ops_t){
+        .name = desc->name,
+#ifdef CONFIG_SETTINGS_CBOR_SUPPORT
+        .cbor_type = type,
+        .from_cbor = setting_custom_from_cbor,
+#endif
+        .nvs_type = NVS_TYPE_BLOB,
+        .set_default = setting_custom_set_default,
+        .encode = setting_custom_encode,
+        .decode = setting_custom_decode,
+        .nvs_read = setting_custom_nvs_read,
+        .nvs_write = setting_custom_nvs_write,
+        .print = setting_custom_print,
+        .to_json = setting_custom_to_json,
+        .from_string = setting_custom_from_string,
+        .from_json = setting_custom_from_json,
+    };
+    custom->desc = desc;
+    return ESP_OK;
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_CBOR_SUPPORT
+#define SETTING_TYPE_CBOR(code, fn) .cbor_type = (code), .from_cbor = (fn),
+#else
+#define SETTING_TYPE_CBOR(code, fn)
+#endif
+
+/*
+ * Codecs of the built-in setting types - each per-type operation is one
+ * indirect call through this table. Types disabled in the configuration have
+ * an empty entry: not stored, printed or parsed, only their id is sent.
+ */
+static const setting_ops_t setting_types[SETTING_TYPE_CUSTOM] = {
+    [SETTING_TYPE_BOOL] = {
+        .name = "BOOL",
+        .nvs_type = NVS_TYPE_I8,
+        .set_default = setting_bool_set_default,
+        .encode = setting_bool_encode,
+        .decode = setting_bool_decode,
+        .print = setting_bool_print,
+        .to_json = setting_bool_to_json,
+        .from_string = setting_bool_from_string,
+        .from_json = setting_bool_from_json,
+        SETTING_TYPE_CBOR(SETTINGS_CBOR_TYPE_BOOL, setting_bool_from_cbor)
+    },
+    [SETTING_TYPE_NUM] = {
+        .name = "NUM",
+        .nvs_type = NVS_TYPE_I32,
+        .set_default = setting_num_set_default,
+        .encode = setting_num_encode,
+        .decode = setting_num_decode,
+        .print = setting_num_print,
+        .to_json = setting_num_to_json,
+        .from_string = setting_num_from_string,
+        .from_json = setting_num_from_json,
+        SETTING_TYPE_CBOR(SETTINGS_CBOR_TYPE_NUM, setting_num_from_cbor)
+    },
+    [SETTING_TYPE_ONEOF] = {
+        .name = "ONEOF",
+        .nvs_type = NVS_TYPE_I8,
+        .set_default = setting_oneof_set_default,
+        .encode = setting_oneof_encode,
+        .decode = setting_oneof_decode,
+        .print = setting_oneof_print,
+        .to_json = setting_oneof_to_json,
+        .from_string = setting_oneof_from_string,
+        .from_json = setting_oneof_from_json,
+        SETTING_TYPE_CBOR(SETTINGS_CBOR_TYPE_ONEOF, setting_oneof_from_cbor)
+    },
+    [SETTING_TYPE_TEXT] = {
+        .name = "TEXT",
+        .nvs_type = NVS_TYPE_STR,
+        .set_default = setting_text_reset,
+        .encode = setting_text_encode,
+        .decode = setting_text_decode,
+        .nvs_read = setting_text_nvs_read,
+        .nvs_write = setting_text_nvs_write,
+        .print = setting_text_print,
+        .to_json = setting_text_to_json,
+        .from_string = setting_text_from_string,
+        .from_json = setting_text_from_json,
+        SETTING_TYPE_CBOR(SETTINGS_CBOR_TYPE_TEXT, setting_text_from_cbor)
+    },
+#ifdef CONFIG_SETTINGS_DATETIME_SUPPORT
+    [SETTING_TYPE_TIME] = {
+        .name = "TIME",
+        .nvs_type = NVS_TYPE_U16,
+        .set_default = setting_time_set_default,
+        .encode = setting_time_encode,
+        .decode = setting_time_decode,
+        .print = setting_time_print,
+        .to_json = setting_time_to_json,
+        .from_string = setting_time_from_string,
+        .from_json = setting_time_from_json,
+        SETTING_TYPE_CBOR(SETTINGS_CBOR_TYPE_TIME, setting_time_from_cbor)
+    },
+    [SETTING_TYPE_DATE] = {
+        .name = "DATE",
+        .nvs_type = NVS_TYPE_U32,
+        .set_default = setting_date_set_default,
+        .encode = setting_date_encode,
+        .decode = setting_date_decode,
+        .print = setting_date_print,
+        .to_json = setting_date_to_json,
+        .from_string = setting_date_from_string,
+        .from_json = setting_date_from_json,
+        SETTING_TYPE_CBOR(SETTINGS_CBOR_TYPE_DATE, setting_date_from_cbor)
+    },
+    [SETTING_TYPE_DATETIME] = {
+        .name = "DATETIME",
+        .nvs_type = NVS_TYPE_ANY,
+        .set_default = setting_datetime_set_default,
+        .nvs_read = setting_datetime_nvs_read,
+        .nvs_write = setting_datetime_nvs_write,
+        .print = setting_datetime_print,
+        .to_json = setting_datetime_to_json,
+        .from_string = setting_datetime_from_string,
+        .from_json = setting_datetime_from_json,
+        SETTING_TYPE_CBOR(SETTINGS_CBOR_TYPE_DATETIME, setting_datetime_from_cbor)
+    },
+#endif
+#ifdef CONFIG_SETTINGS_TIMEZONE_SUPPORT
+    [SETTING_TYPE_TIMEZONE] = {
+        .name = "TIMEZONE",
+        .nvs_type = NVS_TYPE_STR,
+        .set_default = setting_text_reset,
+        .encode = setting_text_encode,
+        .decode = setting_text_decode,
+        .nvs_read = setting_text_nvs_read,
+        .nvs_write = setting_text_nvs_write,
+        .print = setting_text_print,
+        .to_json = setting_text_to_json,
+        .from_string = setting_text_from_string,
+        .from_json = setting_text_from_json,
+        SETTING_TYPE_CBOR(SETTINGS_CBOR_TYPE_TIMEZONE, setting_text_from_cbor)
+    },
+#endif
+#ifdef CONFIG_SETTINGS_COLOR_SUPPORT
+    [SETTING_TYPE_COLOR] = {
+        .name = "COLOR",
+        .nvs_type = NVS_TYPE_U32,
+        .set_default = setting_color_set_default,
+        .encode = setting_color_encode,
+        .decode = setting_color_decode,
+        .print = setting_color_print,
+        .to_json = setting_color_to_json,
+        .from_string = setting_color_from_form,
+        .from_json = setting_color_from_json,
+        SETTING_TYPE_CBOR(SETTINGS_CBOR_TYPE_COLOR, setting_color_from_cbor)
+    },
+#endif
+#ifdef CONFIG_SETTINGS_NET_SUPPORT
+    [SETTING_TYPE_IPADDR] = {
+        .name = "IPADDR",
+        .nvs_type = NVS_TYPE_U32,
+        .set_default = setting_ipaddr_set_default,
+        .encode = setting_ipaddr_encode,
+        .decode = setting_ipaddr_decode,
+        .print = setting_ipaddr_print,
+        .to_json = setting_ipaddr_to_json,
+        .from_string = setting_ipaddr_from_form,
+        .from_json = setting_ipaddr_from_json,
+        SETTING_TYPE_CBOR(SETTINGS_CBOR_TYPE_IPADDR, setting_ipaddr_from_cbor)
+    },
+    [SETTING_TYPE_NETIF] = {
+        .name = "NETIF",
+        .nvs_type = NVS_TYPE_BLOB,
+        .set_default = setting_netif_set_default,
+        .encode = setting_netif_encode,
+        .decode = setting_netif_decode,
+        .print = setting_netif_print,
+        .to_json = setting_netif_to_json,
+        .from_json = setting_netif_from_json,
+        SETTING_TYPE_CBOR(SETTINGS_CBOR_TYPE_NETIF, setting_netif_from_cbor)
+    },
+#endif
+#ifdef CONFIG_SETTINGS_ARRAY_SUPPORT
+    [SETTING_TYPE_ARRAY] = {
+        .name = "ARRAY",
+        .nvs_type = NVS_TYPE_BLOB,
+        .set_default = setting_array_set_default,
+        .encode = setting_array_encode,
+        .decode = setting_array_decode,
+        .nvs_read = setting_array_nvs_read,
+        .nvs_write = setting_array_nvs_write,
+        .print = setting_array_print,
+        .to_json = setting_array_to_json,
+        .from_string = setting_array_from_string,
+        .from_json = setting_array_from_json,
+        SETTING_TYPE_CBOR(SETTINGS_CBOR_TYPE_ARRAY, setting_array_from_cbor)
+    },
+#endif
+};
+
+/* unknown or unregistered type - sent without a "type" */
+static const setting_ops_t setting_type_none = { .name = "", .nvs_type = NVS_TYPE_ANY };
+
+static const setting_ops_t *setting_ops(const setting_t *setting)
+{
+    const setting_ops_t *ops = NULL;
+
+    if (setting->type < SETTING_TYPE_CUSTOM)
+        ops = &setting_types[setting->type];
+#ifdef CONFIG_SETTINGS_CUSTOM_TYPES
+    else if (setting->type < SETTING_TYPE_CUSTOM + CONFIG_SETTINGS_CUSTOM_TYPES_MAX)
+        ops = &setting_custom_types[setting->type - SETTING_TYPE_CUSTOM].ops;
+#endif
+    return ops && ops->name ? ops : &setting_type_none;
 }
 
-esp_err_t settings_handler_register(settings_handler_t handler, void *arg)
+/* request body in the encoding named by its Content-Type */
+static esp_err_t settings_body_parse(httpd_req_t *req, settings_group_t *settings_pack, char *data, size_t len)
 {
-    settings_handler = handler;
-    handler_arg = arg;
-    return ESP_OK;
+#ifdef CONFIG_SETTINGS_CBOR_SUPPORT
+    if (httpd_hdr_has_cbor(req, "Content-Type"))
+        return settings_cbor_apply(settings_pack, (const uint8_t *)data, len);
+#endif
+    if (httpd_hdr_has_type(req, "Content-Type", HTTPD_TYPE_JSON))
+        return settings_json_apply(settings_pack, data, len);
+    return settings_form_apply(settings_pack, data);
 }
 
-static esp_err_t send_json_response(cJSON *js, httpd_req_t *req)
+static esp_err_t settings_body_apply(httpd_req_t *req, settings_group_t *settings_pack, char *data, size_t len)
 {
-    char *js_txt = cJSON_Print(js);
-    cJSON_Delete(js);
+    int64_t   start = settings_metrics_start();
+    esp_err_t rc;
 
-    httpd_resp_set_type(req, HTTPD_TYPE_JSON);
-    httpd_resp_send(req, js_txt, -1);
-    free(js_txt);
-    return ESP_OK;
+    /* the body is the largest allocation of an update */
+    settings_metrics_http_sample();
+    rc = settings_body_parse(req, settings_pack, data, len);
+    settings_metrics_op(SETTINGS_METRIC_PARSE, start, rc);
+    return rc;
 }
 
-static cJSON *settings_pack_to_json(settings_group_t *settings_pack)
+#ifdef CONFIG_SETTINGS_WRITE_BACK
+#define SETTING_SAVED_DIRTY   0x01
+#define SETTING_SAVED_CHANGED 0x02
+
+/*
+ * Values of a pack encoded like in NVS, with the dirty and changed flags.
+ * Write-back updates are undone from this copy, NVS may still lag behind
+ * changes the write-back task has not stored yet.
+ */
+static uint8_t *settings_pack_values_save(const settings_group_t *settings_pack)
 {
-    cJSON *js_groups;
-    cJSON *js_group;
-    cJSON *js_settings;
-    cJSON *js_setting;
-    cJSON *js_labels;
-    cJSON *js;
+    uint8_t *buf;
+    uint8_t *pos;
+    size_t   len = 1;
 
-    const char *types[] = {
-        [SETTING_TYPE_BOOL] = "BOOL",         [SETTING_TYPE_NUM] = "NUM",     [SETTING_TYPE_ONEOF] = "ONEOF",
-        [SETTING_TYPE_TEXT] = "TEXT",
-#ifdef CONFIG_SETTINGS_DATETIME_SUPPORT
-        [SETTING_TYPE_TIME] = "TIME",         [SETTING_TYPE_DATE] = "DATE",   [SETTING_TYPE_DATETIME] = "DATETIME",
-#endif
-#ifdef CONFIG_SETTINGS_TIMEZONE_SUPPORT
-        [SETTING_TYPE_TIMEZONE] = "TIMEZONE",
-#endif
-#ifdef CONFIG_SETTINGS_COLOR_SUPPORT
-        [SETTING_TYPE_COLOR] = "COLOR",
-#endif
-#ifdef CONFIG_SETTINGS_NET_SUPPORT
-        [SETTING_TYPE_IPADDR] = "IPADDR",     [SETTING_TYPE_NETIF] = "NETIF",
-#endif
-    };
+    for (const settings_group_t *gr = settings_pack; gr->id; gr++) {
+        for (setting_t *setting = gr->settings; setting->id; setting++) {
+            if (setting_is_persistent(setting))
+                len += 1 + sizeof(size_t) + setting_ops(setting)->encode(setting, NULL);
+        }
+    }
 
-    if (!settings_pack)
+    buf = malloc(len);
+    if (!buf)
         return NULL;
 
-    js_groups = cJSON_CreateArray();
-    for (settings_group_t *gr = settings_pack; gr->label; gr++) {
-        js_group = cJSON_CreateObject();
-        cJSON_AddStringToObject(js_group, "label", gr->label);
-        cJSON_AddStringToObject(js_group, "id", gr->id);
-        js_settings = cJSON_CreateArray();
-        for (setting_t *setting = gr->settings; setting->label; setting++) {
-            js_setting = cJSON_CreateObject();
-            cJSON_AddStringToObject(js_setting, "label", setting->label);
-            cJSON_AddStringToObject(js_setting, "id", setting->id);
-            cJSON_AddStringToObject(js_setting, "type", types[setting->type]);
-            switch (setting->type) {
-            case SETTING_TYPE_BOOL:
-                cJSON_AddBoolToObject(js_setting, "val", setting->boolean.val);
-                cJSON_AddBoolToObject(js_setting, "def", setting->boolean.def);
-                break;
-            case SETTING_TYPE_NUM:
-                cJSON_AddNumberToObject(js_setting, "val", setting->num.val);
-                cJSON_AddNumberToObject(js_setting, "def", setting->num.def);
-                cJSON_AddNumberToObject(js_setting, "min", setting->num.range[0]);
-                cJSON_AddNumberToObject(js_setting, "max", setting->num.range[1]);
-                break;
-            case SETTING_TYPE_ONEOF:
-                cJSON_AddNumberToObject(js_setting, "val", setting->oneof.val);
-                cJSON_AddNumberToObject(js_setting, "def", setting->oneof.def);
-                js_labels = cJSON_CreateArray();
-                cJSON_AddItemToObject(js_setting, "options", js_labels);
-                for (const char **opt = setting->oneof.options; *opt != NULL; opt++)
-                    cJSON_AddItemToArray(js_labels, cJSON_CreateString(*opt));
-                break;
-            case SETTING_TYPE_TEXT:
-                cJSON_AddStringToObject(js_setting, "val", setting->text.val);
-                cJSON_AddStringToObject(js_setting, "def", setting->text.def);
-                cJSON_AddNumberToObject(js_setting, "len", setting->text.len);
-                break;
-#ifdef CONFIG_SETTINGS_DATETIME_SUPPORT
-            case SETTING_TYPE_TIME:
-                cJSON_AddNumberToObject(js_setting, "hh", setting->time.hh);
-                cJSON_AddNumberToObject(js_setting, "mm", setting->time.mm);
-                cJSON_AddNumberToObject(js_setting, "ss", setting->time.ss);
-                break;
-            case SETTING_TYPE_DATE:
-                cJSON_AddNumberToObject(js_setting, "day", setting->date.day);
-                cJSON_AddNumberToObject(js_setting, "month", setting->date.month);
-                cJSON_AddNumberToObject(js_setting, "year", setting->date.year);
-                break;
-            case SETTING_TYPE_DATETIME:
-                datetime_gettimeofday(&setting->datetime);
-                cJSON_AddNumberToObject(js_setting, "hh", setting->datetime.time.hh);
-                cJSON_AddNumberToObject(js_setting, "mm", setting->datetime.time.mm);
-                cJSON_AddNumberToObject(js_setting, "ss", setting->datetime.time.ss);
-                cJSON_AddNumberToObject(js_setting, "day", setting->datetime.date.day);
-                cJSON_AddNumberToObject(js_setting, "month", setting->datetime.date.month);
-                cJSON_AddNumberToObject(js_setting, "year", setting->datetime.date.year);
-                break;
+    pos = buf;
+    for (const settings_group_t *gr = settings_pack; gr->id; gr++) {
+        for (setting_t *setting = gr->settings; setting->id; setting++) {
+            size_t val_len;
+
+            if (!setting_is_persistent(setting))
+                continue;
+            *pos = setting->dirty ? SETTING_SAVED_DIRTY : 0;
+#ifdef CONFIG_SETTINGS_NOTIFY_SUPPORT
+            if (setting->changed)
+                *pos |= SETTING_SAVED_CHANGED;
 #endif
-#ifdef CONFIG_SETTINGS_TIMEZONE_SUPPORT
-            case SETTING_TYPE_TIMEZONE:
-                cJSON_AddStringToObject(js_setting, "val", setting->timezone.val);
-                cJSON_AddStringToObject(js_setting, "def", setting->timezone.def);
-                cJSON_AddNumberToObject(js_setting, "len", setting->timezone.len);
-                break;
+            pos++;
+            val_len = setting_ops(setting)->encode(setting, pos + sizeof(val_len));
+            memcpy(pos, &val_len, sizeof(val_len));
+            pos += sizeof(val_len) + val_len;
+        }
+    }
+    return buf;
+}
+
+/* setters skip unchanged values, only the settings the update touched are set back */
+static void settings_pack_values_restore(const settings_group_t *settings_pack, const uint8_t *buf)
+{
+    const uint8_t *pos = buf;
+
+    for (const settings_group_t *gr = settings_pack; gr->id; gr++) {
+        for (setting_t *setting = gr->settings; setting->id; setting++) {
+            uint8_t flags;
+            size_t  val_len;
+
+            if (!setting_is_persistent(setting))
+                continue;
+            flags = *pos++;
+            memcpy(&val_len, pos, sizeof(val_len));
+            pos += sizeof(val_len);
+            if (val_len)
+                setting_ops(setting)->decode(setting, pos, val_len);
+#ifdef CONFIG_SETTINGS_LAZY_TEXT
+            else if (setting_text_lazy(setting))
+                setting_text_drop(setting); /* back to the value kept in NVS only */
 #endif
-#ifdef CONFIG_SETTINGS_COLOR_SUPPORT
-            case SETTING_TYPE_COLOR: {
-                char buf[8];
-                char def_buf[8];
-
-                snprintf(buf, sizeof(buf), "#%02x%02x%02x", setting->color.val.r, setting->color.val.g,
-                         setting->color.val.b);
-                snprintf(def_buf, sizeof(def_buf), "#%02x%02x%02x", setting->color.def.r, setting->color.def.g,
-                         setting->color.def.b);
-                cJSON_AddStringToObject(js_setting, "val", buf);
-                cJSON_AddStringToObject(js_setting, "def", def_buf);
-            } break;
+            pos += val_len;
+            setting->dirty = flags & SETTING_SAVED_DIRTY;
+#ifdef CONFIG_SETTINGS_NOTIFY_SUPPORT
+            setting->changed = flags & SETTING_SAVED_CHANGED;
 #endif
-#ifdef CONFIG_SETTINGS_NET_SUPPORT
-            case SETTING_TYPE_IPADDR: {
-                char buf[16];
-                char def_buf[16];
-
-                setting_ipaddr_to_string(&setting->ipaddr.val, buf, sizeof(buf));
-                setting_ipaddr_to_string(&setting->ipaddr.def, def_buf, sizeof(def_buf));
-                cJSON_AddStringToObject(js_setting, "val", buf);
-                cJSON_AddStringToObject(js_setting, "def", def_buf);
-            } break;
-            case SETTING_TYPE_NETIF: {
-                char ip[16];
-                char netmask[16];
-                char gateway[16];
-                char def_ip[16];
-                char def_netmask[16];
-                char def_gateway[16];
-
-                setting_ipaddr_to_string(&setting->netif.val.ip, ip, sizeof(ip));
-                setting_ipaddr_to_string(&setting->netif.val.netmask, netmask, sizeof(netmask));
-                setting_ipaddr_to_string(&setting->netif.val.gateway, gateway, sizeof(gateway));
-                setting_ipaddr_to_string(&setting->netif.def.ip, def_ip, sizeof(def_ip));
-                setting_ipaddr_to_string(&setting->netif.def.netmask, def_netmask, sizeof(def_netmask));
-                setting_ipaddr_to_string(&setting->netif.def.gateway, def_gateway, sizeof(def_gateway));
-                cJSON_AddBoolToObject(js_setting, "dhcp", setting->netif.val.dhcp);
-                cJSON_AddBoolToObject(js_setting, "def_dhcp", setting->netif.def.dhcp);
-                cJSON_AddStringToObject(js_setting, "ip", ip);
-                cJSON_AddStringToObject(js_setting, "netmask", netmask);
-                cJSON_AddStringToObject(js_setting, "gateway", gateway);
-                cJSON_AddStringToObject(js_setting, "def_ip", def_ip);
-                cJSON_AddStringToObject(js_setting, "def_netmask", def_netmask);
-                cJSON_AddStringToObject(js_setting, "def_gateway", def_gateway);
-            } break;
-#endif
-            default:
-                break;
-            }
-            cJSON_AddItemToArray(js_settings, js_setting);
         }
-        cJSON_AddItemToObject(js_group, "settings", js_settings);
-        cJSON_AddItemToArray(js_groups, js_group);
     }
-    js = cJSON_CreateObject();
-    cJSON_AddItemToObject(js, "groups", js_groups);
-    return js;
 }
+#endif
 
 static esp_err_t set_req_handle(httpd_req_t *req)
 {
-    char *req_data;
-    char  srch_id[128];
-    char  value[128];
-    int   bytes_recv = 0;
-    int   rc;
+    settings_txn_t txn;
+    char          *req_data = NULL;
+    int            bytes_recv = 0;
+    int            rc;
 
     settings_group_t *settings_pack = req->user_ctx;
     if (req->content_len) {
@@ -835,126 +6126,62 @@ static esp_err_t set_req_handle(httpd_req_t *req)
             if ((rc = httpd_req_recv(req, req_data + bytes_recv, bytes_left)) <= 0) {
                 if (rc == HTTPD_SOCK_ERR_TIMEOUT)
                     continue;
-                else
-                    return ESP_FAIL;
+                free(req_data);
+                return ESP_FAIL;
             }
             bytes_recv += rc;
             bytes_left -= rc;
         }
+    }
 
-        for (settings_group_t *gr = settings_pack; gr->label; gr++) {
-            for (setting_t *setting = gr->settings; setting->label; setting++) {
-                sprintf(srch_id, "%s:%s", gr->id, setting->id);
-#ifdef CONFIG_SETTINGS_NET_SUPPORT
-                if (setting->type == SETTING_TYPE_NETIF) {
-                    char         req_key[160];
-                    netif_conf_t netif = setting->netif.val;
-                    bool         has_value = false;
-                    ipaddr_t     ipaddr;
-
-                    snprintf(req_key, sizeof(req_key), "%s:dhcp", srch_id);
-                    netif.dhcp = httpd_query_key_value(req_data, req_key, value, sizeof(value)) == ESP_OK &&
-                                 !strcmp("on", value);
-
-                    snprintf(req_key, sizeof(req_key), "%s:ip", srch_id);
-                    if (httpd_query_key_value(req_data, req_key, value, sizeof(value)) == ESP_OK) {
-                        has_value = true;
-                        if (setting_ipaddr_from_string(value, &ipaddr))
-                            netif.ip = ipaddr;
-                    }
-
-                    snprintf(req_key, sizeof(req_key), "%s:netmask", srch_id);
-                    if (httpd_query_key_value(req_data, req_key, value, sizeof(value)) == ESP_OK) {
-                        has_value = true;
-                        if (setting_ipaddr_from_string(value, &ipaddr))
-                            netif.netmask = ipaddr;
-                    }
-
-                    snprintf(req_key, sizeof(req_key), "%s:gateway", srch_id);
-                    if (httpd_query_key_value(req_data, req_key, value, sizeof(value)) == ESP_OK) {
-                        has_value = true;
-                        if (setting_ipaddr_from_string(value, &ipaddr))
-                            netif.gateway = ipaddr;
-                    }
+#ifdef CONFIG_SETTINGS_WRITE_BACK
+    if (settings_writeback_covers(settings_pack)) {
+        /* values are stored by the write-back task, keep flash out of the request */
+        settings_lock();
+        rc = ESP_OK;
+        if (req_data) {
+            uint8_t *saved = settings_pack_values_save(settings_pack);
 
-                    if (has_value || netif.dhcp != setting->netif.val.dhcp)
-                        setting_set_netif(setting, &netif);
-                    continue;
-                }
-#endif
-                /* Set bool settings to false by default(if false then not in request)*/
-                if (httpd_query_key_value(req_data, srch_id, value, sizeof(value)) != ESP_OK) {
-                    if (setting->type == SETTING_TYPE_BOOL)
-                        setting->boolean.val = false;
-                    continue;
-                }
+            /* a rejected body leaves no setting changed, like an aborted transaction */
+            rc = saved ? settings_body_apply(req, settings_pack, req_data, bytes_recv) : ESP_ERR_NO_MEM;
+            if (saved && rc != ESP_OK)
+                settings_pack_values_restore(settings_pack, saved);
+            free(saved);
+        }
+        settings_unlock();
+        free(req_data);
+        if (rc != ESP_OK)
+            return rc;
 
-                switch (setting->type) {
-                case SETTING_TYPE_BOOL: {
-                    setting_set_bool(setting, !strcmp("on", value));
-                } break;
-                case SETTING_TYPE_NUM: {
-                    setting_set_num(setting, atoi(value));
-                } break;
-                case SETTING_TYPE_ONEOF: {
-                    setting_set_oneof(setting, atoi(value));
-                } break;
-                case SETTING_TYPE_TEXT: {
-                    setting_set_text(setting, value);
-                } break;
-#ifdef CONFIG_SETTINGS_DATETIME_SUPPORT
-                case SETTING_TYPE_TIME: {
-                    setting_time_t time;
-                    sscanf(value, "%d:%d", &time.hh, &time.mm);
-                    setting_set_time(setting, &time);
-                } break;
-                case SETTING_TYPE_DATE: {
-                    setting_date_t date;
-                    sscanf(value, "%d-%d-%d", &date.year, &date.month, &date.day);
-                    setting_set_date(setting, &date);
-                } break;
-                case SETTING_TYPE_DATETIME: {
-                    setting_date_t     date;
-                    setting_time_t     time;
-                    setting_datetime_t combined;
-
-                    sscanf(value, "%d-%d-%dT%d:%d", &date.year, &date.month, &date.day, &time.hh, &time.mm);
-                    combined.date = date;
-                    combined.time = time;
-                    setting_set_datetime(setting, &combined);
-                } break;
-#endif
-#ifdef CONFIG_SETTINGS_TIMEZONE_SUPPORT
-                case SETTING_TYPE_TIMEZONE: {
-                    setting_set_timezone(setting, value);
-                } break;
+        settings_handler_call(settings_pack);
+#ifdef CONFIG_SETTINGS_NOTIFY_SUPPORT
+        settings_notify(settings_pack);
 #endif
-#ifdef CONFIG_SETTINGS_COLOR_SUPPORT
-                case SETTING_TYPE_COLOR: {
-                    color_t color = { .combined = strtol(value + 1, NULL, 16) };
-                    setting_set_color(setting, &color);
-                } break;
+        return ESP_OK;
+    }
 #endif
-#ifdef CONFIG_SETTINGS_NET_SUPPORT
-                case SETTING_TYPE_IPADDR: {
-                    ipaddr_t ipaddr;
 
-                    if (setting_ipaddr_from_string(value, &ipaddr))
-                        setting_set_ipaddr(setting, &ipaddr);
-                } break;
-#endif
-                default:
-                    break;
-                }
-            }
-        }
+    rc = settings_txn_begin(&txn, settings_pack);
+    if (rc != ESP_OK) {
+        free(req_data);
+        return rc;
+    }
+
+    if (req_data) {
+        rc = settings_body_apply(req, settings_pack, req_data, bytes_recv);
         free(req_data);
+        if (rc != ESP_OK) {
+            settings_txn_abort(&txn);
+            return rc;
+        }
     }
 
-    if (settings_handler != NULL)
-        settings_handler(settings_pack, handler_arg);
+    settings_handler_call(settings_pack);
 
-    rc = settings_nvs_write(settings_pack);
+    rc = settings_txn_commit(&txn);
+#ifdef CONFIG_SETTINGS_NOTIFY_SUPPORT
+    settings_notify(settings_pack);
+#endif
     if (rc == 0) {
         ESP_LOGI(TAG, "nvs write OK");
         return ESP_OK;
@@ -964,30 +6191,261 @@ static esp_err_t set_req_handle(httpd_req_t *req)
     }
 }
 
-esp_err_t settings_httpd_handler(httpd_req_t *req)
+/* `group` and `keys` query selectors, values are URL decoded */
+static esp_err_t settings_select_init(httpd_req_t *req, settings_select_t *sel)
 {
-    cJSON *js;
-    char  *url_query;
-    size_t qlen;
-    char   value[128];
+    size_t qlen = httpd_req_get_url_query_len(req) + 1;
+    char  *query;
+    char  *groups;
+    char  *keys;
+#ifdef CONFIG_SETTINGS_CHANGE_FEED
+    char  num[SETTINGS_GEN_TOKEN_LEN];
+    char *end;
+#endif
+
+    memset(sel, 0, sizeof(*sel));
+    if (qlen == 1)
+        return ESP_OK;
+
+    sel->buf = malloc(3 * qlen);
+    if (!sel->buf)
+        return ESP_ERR_NO_MEM;
+    query = sel->buf;
+    groups = query + qlen;
+    keys = groups + qlen;
+    if (httpd_req_get_url_query_str(req, query, qlen) != ESP_OK)
+        return ESP_OK;
+
+    if (httpd_query_key_value(query, "group", groups, qlen) == ESP_OK) {
+        form_urldecode(groups);
+        sel->groups = groups;
+    }
+    if (httpd_query_key_value(query, "keys", keys, qlen) == ESP_OK) {
+        form_urldecode(keys);
+        sel->keys = keys;
+    }
+#ifdef CONFIG_SETTINGS_CHANGE_FEED
+    if (httpd_query_key_value(query, "since", num, sizeof(num)) == ESP_OK) {
+        sel->feed = true;
+        /* a token without an epoch never matches, the client gets a snapshot */
+        sel->epoch = strtoul(num, &end, 16);
+        if (*end == '-')
+            sel->since = strtoul(end + 1, NULL, 10);
+        else
+            sel->epoch = ~settings_epoch;
+        if (httpd_query_key_value(query, "wait", num, sizeof(num)) == ESP_OK)
+            sel->wait_ms = strtoul(num, NULL, 10);
+        if (sel->wait_ms > CONFIG_SETTINGS_CHANGE_FEED_MAX_WAIT_MS)
+            sel->wait_ms = CONFIG_SETTINGS_CHANGE_FEED_MAX_WAIT_MS;
+    }
+#endif
+    return ESP_OK;
+}
+
+static void settings_select_free(settings_select_t *sel)
+{
+    free(sel->buf);
+#ifdef CONFIG_SETTINGS_CHANGE_FEED
+    free(sel->changed);
+#endif
+}
+
+static esp_err_t send_selected_response(httpd_req_t *req, const settings_group_t *settings_pack, int parts)
+{
+    settings_select_t sel;
+    esp_err_t         rc;
+
+    rc = settings_select_init(req, &sel);
+    if (rc != ESP_OK)
+        return rc;
+    rc = send_json_response(req, settings_pack, parts, &sel);
+    settings_select_free(&sel);
+    return rc;
+}
+
+#ifdef CONFIG_SETTINGS_CHANGE_FEED
+#ifdef SETTINGS_FEED_ASYNC
+#define SETTINGS_FEED_TASK_STACK_SIZE 2048
+#define SETTINGS_FEED_TASK_PRIORITY   1
+
+/*
+ * Long-poll: a request waiting for the generation to move past `since` is
+ * detached from the server task with an async handler copy and parked on
+ * `feed_waiters`. Generation steps wake the feed task, which hands every
+ * waiter that saw a change or ran out of time back to its server task to
+ * be answered there, so parked requests hold a socket but no task.
+ */
+typedef struct settings_feed_waiter {
+    struct settings_feed_waiter *next;
+    httpd_req_t                 *req; /* async copy of the request */
+    settings_select_t            sel;
+    TickType_t                   deadline;
+} settings_feed_waiter_t;
+
+static esp_err_t settings_feed_send(httpd_req_t *req, settings_select_t *sel);
+
+static void settings_feed_answer(void *arg)
+{
+    settings_feed_waiter_t *waiter = arg;
+
+    settings_feed_send(waiter->req, &waiter->sel);
+    settings_select_free(&waiter->sel);
+    httpd_req_async_handler_complete(waiter->req);
+    free(waiter);
+}
+
+static void settings_feed_task(void *arg)
+{
+    for (;;) {
+        settings_feed_waiter_t  *done = NULL;
+        settings_feed_waiter_t **link;
+        TickType_t               now = xTaskGetTickCount();
+        TickType_t               wait = portMAX_DELAY;
+
+        settings_lock();
+        for (link = &feed_waiters; *link;) {
+            settings_feed_waiter_t *waiter = *link;
+            TickType_t              left = waiter->deadline - now;
+
+            if (waiter->sel.since == settings_generation && left > 0 && left <= portMAX_DELAY / 2) {
+                if (left < wait)
+                    wait = left;
+                link = &waiter->next;
+                continue;
+            }
+            *link = waiter->next;
+            waiter->next = done;
+            done = waiter;
+        }
+        settings_unlock();
+
+        while (done) {
+            settings_feed_waiter_t *waiter = done;
+
+            done = waiter->next;
+            /* async requests may be answered from any task when the server queue is full */
+            if (httpd_queue_work(waiter->req->handle, settings_feed_answer, waiter) != ESP_OK)
+                settings_feed_answer(waiter);
+        }
+        ulTaskNotifyTake(pdTRUE, wait);
+    }
+}
+
+/* ESP_OK - the request is parked and answered later, otherwise it is answered at once */
+static esp_err_t settings_feed_park(httpd_req_t *req, settings_select_t *sel)
+{
+    settings_feed_waiter_t *waiter;
+
+    waiter = calloc(1, sizeof(*waiter));
+    if (!waiter)
+        return ESP_ERR_NO_MEM;
+
+    settings_lock();
+    if (!feed_task && xTaskCreate(settings_feed_task, "settings_feed", SETTINGS_FEED_TASK_STACK_SIZE, NULL,
+                                  SETTINGS_FEED_TASK_PRIORITY, &feed_task) != pdPASS) {
+        ESP_LOGE(TAG, "feed task start failed");
+        feed_task = NULL;
+        settings_unlock();
+        free(waiter);
+        return ESP_FAIL;
+    }
+    /* changed already - nothing to wait for */
+    if (sel->since != settings_generation || httpd_req_async_handler_begin(req, &waiter->req) != ESP_OK) {
+        settings_unlock();
+        free(waiter);
+        return ESP_ERR_INVALID_STATE;
+    }
+    waiter->sel = *sel;
+    waiter->deadline = xTaskGetTickCount() + pdMS_TO_TICKS(sel->wait_ms);
+    waiter->next = feed_waiters;
+    feed_waiters = waiter;
+    xTaskNotifyGive(feed_task);
+    settings_unlock();
+    return ESP_OK;
+}
+#endif
+
+/*
+ * Settings changed after generation `since`. When the feed no longer holds
+ * all of them - the client fell behind, or its generation is from an earlier
+ * boot - the response is a full snapshot instead of a delta.
+ */
+static esp_err_t settings_feed_collect(settings_select_t *sel)
+{
+    uint32_t count;
+
+    sel->changed = malloc(CONFIG_SETTINGS_CHANGE_FEED_LEN * sizeof(setting_t *));
+    if (!sel->changed)
+        return ESP_ERR_NO_MEM;
+
+    settings_lock();
+    sel->gen = settings_generation;
+    count = sel->gen - sel->since;
+    sel->delta = sel->epoch == settings_epoch && sel->since >= feed_start && sel->since <= sel->gen &&
+                 count <= CONFIG_SETTINGS_CHANGE_FEED_LEN;
+    for (uint32_t gen = sel->since + 1; sel->delta && gen <= sel->gen; gen++) {
+        setting_t *setting = feed_ring[gen % CONFIG_SETTINGS_CHANGE_FEED_LEN];
+        size_t     i = 0;
+
+        while (i < sel->changed_count && sel->changed[i] != setting)
+            i++;
+        if (i == sel->changed_count)
+            sel->changed[sel->changed_count++] = setting;
+    }
+    settings_unlock();
+    return ESP_OK;
+}
+
+/* deltas depend on the client generation, not on the current values alone */
+static esp_err_t settings_feed_send(httpd_req_t *req, settings_select_t *sel)
+{
+    esp_err_t rc;
+
+    rc = settings_feed_collect(sel);
+    if (rc == ESP_OK) {
+        httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+        rc = send_json_response(req, req->user_ctx, SETTING_JSON_VALUES, sel);
+    }
+    return rc;
+}
+#endif
 
-    js = cJSON_CreateObject();
+esp_err_t settings_httpd_handler(httpd_req_t *req)
+{
+    char     *url_query;
+    size_t    qlen;
+    char      value[128];
+    esp_err_t rc;
 
     settings_group_t *settings_pack = req->user_ctx;
 
+    settings_metrics_http_begin();
     //parse URL query
     qlen = httpd_req_get_url_query_len(req) + 1;
     if (qlen > 1) {
         url_query = malloc(qlen);
-        if (httpd_req_get_url_query_str(req, url_query, qlen) == ESP_OK) {
+        if (url_query && httpd_req_get_url_query_str(req, url_query, qlen) == ESP_OK) {
             if (httpd_query_key_value(url_query, "action", value, sizeof(value)) == ESP_OK) {
                 if (!strcmp(value, "set")) {
-                    set_req_handle(req);
+                    rc = set_req_handle(req);
+                    if (rc != ESP_OK) {
+                        free(url_query);
+                        /* the connection is gone if the body could not be received */
+                        if (rc == ESP_FAIL)
+                            return rc;
+                        if (rc == ESP_ERR_INVALID_ARG)
+                            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid settings");
+                        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, esp_err_to_name(rc));
+                    }
                 } else if (!strcmp(value, "erase")) {
                     settings_pack_set_defaults(settings_pack);
                     settings_nvs_erase(settings_pack);
+#ifdef CONFIG_SETTINGS_NOTIFY_SUPPORT
+                    settings_notify(settings_pack);
+#endif
                 } else if (!strcmp(value, "restart")) {
-                    send_json_response(js, req);
+                    free(url_query);
+                    send_json_response(req, NULL, SETTING_JSON_ALL, NULL);
                     esp_restart();
                     return ESP_OK;
                 }
@@ -995,6 +6453,359 @@ esp_err_t settings_httpd_handler(httpd_req_t *req)
         }
         free(url_query);
     }
-    cJSON_AddItemToObject(js, "data", settings_pack_to_json(settings_pack));
-    return send_json_response(js, req);
+    return send_selected_response(req, settings_pack, SETTING_JSON_ALL);
+}
+
+esp_err_t settings_schema_httpd_handler(httpd_req_t *req)
+{
+    const settings_group_t *settings_pack = req->user_ctx;
+    char                    etag[16];
+
+    settings_metrics_http_begin();
+    snprintf(etag, sizeof(etag), "\"%08" PRIx32 "%s\"", settings_pack_schema_etag(settings_pack),
+             httpd_hdr_has_cbor(req, "Accept") ? "c" : "");
+    if (httpd_etag_matches(req, etag))
+        return httpd_send_not_modified(req, etag);
+
+    httpd_resp_set_hdr(req, "ETag", etag);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    return send_selected_response(req, settings_pack, SETTING_JSON_SCHEMA);
+}
+
+esp_err_t settings_values_httpd_handler(httpd_req_t *req)
+{
+    const settings_group_t *settings_pack = req->user_ctx;
+    settings_select_t       sel;
+    char                    token[SETTINGS_GEN_TOKEN_LEN];
+    char                    etag[SETTINGS_GEN_TOKEN_LEN + 4];
+    esp_err_t               rc;
+
+    settings_metrics_http_begin();
+    rc = settings_select_init(req, &sel);
+    if (rc != ESP_OK)
+        return rc;
+
+#ifdef CONFIG_SETTINGS_CHANGE_FEED
+    if (sel.feed) {
+#ifdef SETTINGS_FEED_ASYNC
+        /* a token of an earlier boot is answered at once, the waiter owns the selection once parked */
+        if (sel.wait_ms && sel.epoch == settings_epoch && settings_feed_park(req, &sel) == ESP_OK)
+            return ESP_OK;
+#endif
+        rc = settings_feed_send(req, &sel);
+        settings_select_free(&sel);
+        return rc;
+    }
+#endif
+
+    settings_gen_token(token, sizeof(token), settings_generation);
+    snprintf(etag, sizeof(etag), "\"%s%s\"", token, httpd_hdr_has_cbor(req, "Accept") ? "c" : "");
+    if (httpd_etag_matches(req, etag)) {
+        settings_select_free(&sel);
+        return httpd_send_not_modified(req, etag);
+    }
+
+    httpd_resp_set_hdr(req, "ETag", etag);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    rc = send_json_response(req, settings_pack, SETTING_JSON_VALUES, &sel);
+    settings_select_free(&sel);
+    return rc;
+}
+
+#ifdef CONFIG_SETTINGS_WS_PUSH
+/*
+ * Websocket push: every client has a bounded queue of the settings changed
+ * since its last message. At most one send per client is queued to the
+ * server task, changes arriving meanwhile are merged into the queue, so a
+ * slow client gets fewer and larger deltas instead of a growing backlog.
+ * When the queue overflows the next message is a full snapshot.
+ */
+typedef struct {
+    httpd_handle_t          hd; /* NULL - free slot */
+    int                     fd;
+    const settings_group_t *pack;
+    bool                    busy;     /* send queued to the server task */
+    bool                    overflow; /* changes were lost - send a snapshot */
+    uint32_t                gen;      /* generation of the last message */
+    size_t                  count;
+    setting_t              *queue[CONFIG_SETTINGS_WS_QUEUE_LEN];
+} settings_ws_client_t;
+
+static settings_ws_client_t ws_clients[CONFIG_SETTINGS_WS_MAX_CLIENTS];
+
+static void settings_ws_send_work(void *arg);
+
+/* called locked */
+static void settings_ws_schedule(settings_ws_client_t *client)
+{
+    if (client->busy)
+        return;
+    /* on failure the changes stay queued until the next one */
+    if (httpd_queue_work(client->hd, settings_ws_send_work, client) == ESP_OK)
+        client->busy = true;
+}
+
+/* called locked, by every generation step */
+static void settings_ws_push(setting_t *setting)
+{
+    for (int i = 0; i < CONFIG_SETTINGS_WS_MAX_CLIENTS; i++) {
+        settings_ws_client_t *client = &ws_clients[i];
+        size_t                n = 0;
+
+        if (!client->hd)
+            continue;
+        if (!client->overflow) {
+            while (n < client->count && client->queue[n] != setting)
+                n++;
+            if (n == CONFIG_SETTINGS_WS_QUEUE_LEN)
+                client->overflow = true;
+            else if (n == client->count)
+                client->queue[client->count++] = setting;
+        }
+        settings_ws_schedule(client);
+    }
+}
+
+static esp_err_t settings_ws_send(httpd_handle_t hd, int fd, const settings_group_t *settings_pack,
+                                  const settings_select_t *sel)
+{
+    json_stream_t js = { .rc = ESP_OK, .ws_hd = hd, .ws_fd = fd };
+
+    if (httpd_ws_get_fd_info(hd, fd) != HTTPD_WS_CLIENT_WEBSOCKET)
+        return ESP_ERR_INVALID_STATE;
+    settings_doc_to_json(&js, settings_pack, SETTING_JSON_VALUES, sel);
+    json_stream_ws_send(&js, true);
+    return js.rc;
+}
+
+/* server task: send the queued changes as one message */
+static void settings_ws_send_work(void *arg)
+{
+    settings_ws_client_t   *client = arg;
+    settings_select_t       sel = { .feed = true };
+    const settings_group_t *settings_pack;
+    httpd_handle_t          hd;
+    int                     fd;
+    esp_err_t               rc;
+
+    sel.changed = malloc(CONFIG_SETTINGS_WS_QUEUE_LEN * sizeof(setting_t *));
+
+    settings_lock();
+    hd = client->hd;
+    fd = client->fd;
+    settings_pack = client->pack;
+    sel.since = client->gen;
+    sel.gen = settings_generation;
+    sel.delta = sel.changed && !client->overflow;
+    if (sel.delta) {
+        memcpy(sel.changed, client->queue, client->count * sizeof(setting_t *));
+        sel.changed_count = client->count;
+    }
+    client->count = 0;
+    client->overflow = false;
+    client->gen = sel.gen;
+    settings_unlock();
+
+    rc = settings_ws_send(hd, fd, settings_pack, &sel);
+    free(sel.changed);
+
+    settings_lock();
+    client->busy = false;
+    if (rc != ESP_OK) {
+        ESP_LOGI(TAG, "ws client %d gone", fd);
+        memset(client, 0, sizeof(*client));
+    } else if (client->count || client->overflow) {
+        settings_ws_schedule(client);
+    }
+    settings_unlock();
+}
+
+/* handshake done - register the client and send it a snapshot */
+static esp_err_t settings_ws_client_add(httpd_req_t *req)
+{
+    settings_ws_client_t *slot = NULL;
+    int                   fd = httpd_req_to_sockfd(req);
+
+    settings_lock();
+    for (int i = 0; i < CONFIG_SETTINGS_WS_MAX_CLIENTS; i++) {
+        settings_ws_client_t *client = &ws_clients[i];
+
+        if (client->hd == req->handle && client->fd == fd) {
+            slot = client;
+            break;
+        }
+        /* clients that closed while nothing changed are still listed */
+        if (client->hd && !client->busy && httpd_ws_get_fd_info(client->hd, client->fd) != HTTPD_WS_CLIENT_WEBSOCKET)
+            memset(client, 0, sizeof(*client));
+        if (!client->hd && !slot)
+            slot = client;
+    }
+    if (slot) {
+        if (!slot->hd)
+            *slot = (settings_ws_client_t){ .hd = req->handle, .fd = fd };
+        slot->pack = req->user_ctx;
+        slot->overflow = true;
+        settings_ws_schedule(slot);
+    }
+    settings_unlock();
+
+    if (!slot) {
+        ESP_LOGW(TAG, "ws: no free client slot");
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t settings_ws_httpd_handler(httpd_req_t *req)
+{
+    httpd_ws_frame_t frame = { 0 };
+    uint8_t          buf[32];
+    esp_err_t        rc;
+
+    if (req->method == HTTP_GET)
+        return settings_ws_client_add(req);
+
+    /* clients have nothing to say - read and drop their messages */
+    rc = httpd_ws_recv_frame(req, &frame, 0);
+    if (rc != ESP_OK)
+        return rc;
+    if (frame.len > sizeof(buf))
+        return ESP_ERR_INVALID_SIZE;
+    frame.payload = buf;
+    return httpd_ws_recv_frame(req, &frame, frame.len);
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_WEAR_STATS
+esp_err_t settings_wear_httpd_handler(httpd_req_t *req)
+{
+    const settings_group_t *settings_pack = req->user_ctx;
+    settings_index_t       *index;
+    settings_wear_t         wear;
+    json_stream_t           js = { .req = req, .rc = ESP_OK };
+    esp_err_t               rc;
+
+    rc = settings_wear_get(settings_pack, &wear);
+    if (rc != ESP_OK)
+        return rc;
+    index = settings_index_get(settings_pack);
+
+#ifdef CONFIG_SETTINGS_CBOR_SUPPORT
+    httpd_resp_set_hdr(req, "Vary", "Accept");
+    js.cbor = httpd_hdr_has_cbor(req, "Accept");
+    if (js.cbor)
+        httpd_resp_set_type(req, SETTINGS_HTTPD_TYPE_CBOR);
+    else
+#endif
+        httpd_resp_set_type(req, HTTPD_TYPE_JSON);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+
+    json_stream_open(&js, '{');
+    json_stream_add_u32(&js, "uptime_s", wear.uptime_s);
+    json_stream_add_u32(&js, "writes", wear.writes);
+    json_stream_add_u32(&js, "bytes", wear.bytes);
+    json_stream_add_u32(&js, "entries", wear.entries);
+    json_stream_add_u32(&js, "partition_entries", wear.partition_entries);
+    json_stream_add_u32(&js, "hot_keys", wear.hot_keys);
+    json_stream_add_u32(&js, "ns_entries", wear.ns_entries);
+    json_stream_add_u32(&js, "used_entries", wear.used_entries);
+    json_stream_add_u32(&js, "free_entries", wear.free_entries);
+    json_stream_add_u32(&js, "total_entries", wear.total_entries);
+    json_stream_add_u32(&js, "lifetime_days", wear.lifetime_days);
+    json_stream_key(&js, "keys");
+    json_stream_open(&js, '[');
+    for (const settings_group_t *gr = settings_pack; gr->id; gr++) {
+        for (setting_t *setting = gr->settings; setting->id; setting++) {
+            setting_wear_t key = { 0 };
+
+            settings_lock();
+            setting_wear_copy(index, gr, setting, &key);
+            settings_unlock();
+            if (!key.writes)
+                continue;
+            json_stream_open(&js, '{');
+            json_stream_add_str(&js, "key", setting->nvs_id);
+            json_stream_add_u32(&js, "writes", key.writes);
+            json_stream_add_u32(&js, "hour_writes", key.hour_writes);
+            json_stream_add_bool(&js, "hot", key.hour_writes >= CONFIG_SETTINGS_WEAR_HOT_WRITES);
+            json_stream_close(&js, '}');
+        }
+    }
+    json_stream_close(&js, ']');
+    json_stream_close(&js, '}');
+    json_stream_flush(&js);
+    if (js.rc == ESP_OK)
+        js.rc = httpd_resp_send_chunk(req, NULL, 0);
+    return js.rc;
+}
+#endif
+
+#ifdef CONFIG_SETTINGS_METRICS
+static const char *const metric_op_names[SETTINGS_METRIC_OP_COUNT] = {
+    [SETTINGS_METRIC_NVS_READ] = "nvs_read",
+    [SETTINGS_METRIC_NVS_WRITE] = "nvs_write",
+    [SETTINGS_METRIC_NVS_WRITE_SINGLE] = "nvs_write_single",
+    [SETTINGS_METRIC_SERIALIZE] = "serialize",
+    [SETTINGS_METRIC_PARSE] = "parse",
+};
+
+esp_err_t settings_metrics_httpd_handler(httpd_req_t *req)
+{
+    settings_metrics_t snap;
+    json_stream_t      js = { .req = req, .rc = ESP_OK };
+    char               query[32];
+    char               value[4];
+
+    settings_metrics_get(&snap);
+#ifdef CONFIG_SETTINGS_CBOR_SUPPORT
+    httpd_resp_set_hdr(req, "Vary", "Accept");
+    js.cbor = httpd_hdr_has_cbor(req, "Accept");
+    if (js.cbor)
+        httpd_resp_set_type(req, SETTINGS_HTTPD_TYPE_CBOR);
+    else
+#endif
+        httpd_resp_set_type(req, HTTPD_TYPE_JSON);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+
+    json_stream_open(&js, '{');
+    for (int op = 0; op < SETTINGS_METRIC_OP_COUNT; op++) {
+        const settings_op_metrics_t *m = &snap.ops[op];
+
+        json_stream_key(&js, metric_op_names[op]);
+        json_stream_open(&js, '{');
+        json_stream_add_u32(&js, "count", m->count);
+        json_stream_add_u32(&js, "errors", m->errors);
+        json_stream_add_u32(&js, "avg_us", m->count ? m->total_us / m->count : 0);
+        json_stream_add_u32(&js, "max_us", m->max_us);
+        json_stream_key(&js, "hist");
+        json_stream_open(&js, '[');
+        for (int i = 0; i < SETTINGS_METRICS_BUCKETS; i++)
+            json_stream_u32(&js, m->hist[i]);
+        json_stream_close(&js, ']');
+        json_stream_close(&js, '}');
+    }
+    json_stream_add_u32(&js, "nvs_keys_written", snap.nvs_keys_written);
+    json_stream_add_u32(&js, "nvs_bytes_written", snap.nvs_bytes_written);
+    json_stream_add_u32(&js, "nvs_commits", snap.nvs_commits);
+    json_stream_add_u32(&js, "http_heap_peak", snap.http_heap_peak);
+    json_stream_close(&js, '}');
+    json_stream_flush(&js);
+    if (js.rc == ESP_OK)
+        js.rc = httpd_resp_send_chunk(req, NULL, 0);
+
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "reset", value, sizeof(value)) == ESP_OK && !strcmp(value, "1"))
+        settings_metrics_reset();
+    return js.rc;
+}
+#endif
+
+uint32_t settings_get_generation(void)
+{
+    return settings_generation;
+}
+
+uint32_t settings_get_epoch(void)
+{
+    return settings_epoch;
 }